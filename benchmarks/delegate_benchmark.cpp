@@ -0,0 +1,143 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+/*
+ * Compares the subscriber call cost of ES::Delegate with the former std::function/std::bind storage.
+ *
+ * Build with optimizations enabled (CMAKE_BUILD_TYPE=Release) to get meaningful numbers.
+ * The output is one CSV line per measurement: case,storage,calls,ns_per_call
+ */
+
+#include "EventDelegate.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace {
+
+const std::size_t callCount = 20000000;
+
+// sink that prevents the compiler from removing the calls
+volatile long sink = 0;
+
+void freeHandler(int arg)
+{
+  sink += arg;
+}
+
+struct Receiver
+{
+  long counter = 0;
+  void memberHandler(int arg)
+  {
+    counter += arg;
+    sink += arg;
+  }
+};
+
+// measure the time per call of f
+template<typename F>
+double measure(const F& f)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < callCount; ++i)
+  {
+    f(static_cast<int>(i & 0xFF));
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / callCount;
+}
+
+void report(const char* name, const char* storage, double nsPerCall)
+{
+  std::printf("%s,%s,%zu,%.3f\n", name, storage, callCount, nsPerCall);
+}
+
+}  // namespace
+
+int main()
+{
+  std::printf("case,storage,calls,ns_per_call\n");
+
+  // free function
+  {
+    std::function<void(int)> fn(freeHandler);
+    ES::Delegate<void(int)> dg(freeHandler);
+    report("free_function", "std::function", measure(fn));
+    report("free_function", "Delegate", measure([&dg](int arg) { dg.invoke(arg); }));
+  }
+
+  // member function bound to an object
+  {
+    Receiver receiver;
+    std::function<void(int)> fn(std::bind(&Receiver::memberHandler, &receiver, std::placeholders::_1));
+    ES::Delegate<void(int)> dg(&Receiver::memberHandler, &receiver);
+    report("member_function", "std::function+bind", measure(fn));
+    report("member_function", "Delegate", measure([&dg](int arg) { dg.invoke(arg); }));
+  }
+
+  // lambda with a small capture
+  {
+    long a = 1, b = 2;
+    auto lambda = [&a, &b](int arg) { sink += arg * a + b; };
+    std::function<void(int)> fn(lambda);
+    ES::Delegate<void(int)> dg(lambda);
+    report("small_lambda", "std::function", measure(fn));
+    report("small_lambda", "Delegate", measure([&dg](int arg) { dg.invoke(arg); }));
+  }
+
+  // construction cost, which includes allocation for bound member functions
+  {
+    Receiver receiver;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < callCount / 10; ++i)
+    {
+      std::function<void(int)> fn(std::bind(&Receiver::memberHandler, &receiver, std::placeholders::_1));
+      fn(1);
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < callCount / 10; ++i)
+    {
+      ES::Delegate<void(int)> dg(&Receiver::memberHandler, &receiver);
+      dg.invoke(1);
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::printf("construct_member,std::function+bind,%zu,%.3f\n", callCount / 10,
+        std::chrono::duration<double, std::nano>(mid - start).count() / (callCount / 10));
+    std::printf("construct_member,Delegate,%zu,%.3f\n", callCount / 10,
+        std::chrono::duration<double, std::nano>(end - mid).count() / (callCount / 10));
+  }
+
+  return 0;
+}
@@ -0,0 +1,507 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/*
+ * Microbenchmarks for the publish, queue, dispatch and registry paths.
+ *
+ * Build with optimizations enabled (CMAKE_BUILD_TYPE=Release) to get meaningful numbers.
+ * The output is one CSV line per measurement: benchmark,variant,parameter,operations,ns_per_op
+ * Every measurement is repeated and the fastest run is reported, which makes the numbers
+ * reasonably stable between runs on an otherwise idle machine.
+ *
+ * An optional command line argument scales the operation counts, e.g. 0.1 for a quick run.
+ */
+
+#include "EventSystem.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int repetitions = 3;
+
+// scale factor for the operation counts, set from the command line
+double scale = 1.0;
+
+// sink that prevents the compiler from removing the calls
+volatile long sink = 0;
+
+std::size_t scaled(std::size_t operations)
+{
+  std::size_t result = static_cast<std::size_t>(operations * scale);
+  return result > 0 ? result : 1;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedNs(Clock::time_point start, Clock::time_point end)
+{
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+void report(const char* benchmark, const char* variant, std::size_t parameter, std::size_t operations,
+    double nsPerOp)
+{
+  std::printf("%s,%s,%zu,%zu,%.3f\n", benchmark, variant, parameter, operations, nsPerOp);
+}
+
+// run f, which performs the given number of operations and returns the time it measured in ns,
+// several times and report the fastest run.
+template<typename F>
+void run(const char* benchmark, const char* variant, std::size_t parameter, std::size_t operations, F f)
+{
+  double best = -1;
+  for (int i = 0; i < repetitions; ++i)
+  {
+    double ns = f();
+    if (best < 0 || ns < best)
+    {
+      best = ns;
+    }
+  }
+  report(benchmark, variant, parameter, operations, best / operations);
+}
+
+// deterministic pseudo random numbers, so that every run does the same work
+struct Lcg
+{
+  unsigned long long state;
+  explicit Lcg(unsigned long long seed) : state(seed) {}
+  std::size_t next(std::size_t bound)
+  {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<std::size_t>(state >> 33) % bound;
+  }
+};
+
+// publish by name/handle and call by name/handle
+void benchmarkPublishVsCall()
+{
+  const std::size_t batch = 10000;
+  const std::size_t operations = scaled(1000000) / batch * batch + batch;
+
+  ES::EventSystem es;
+  auto handle = es.registerEvent<int>("Event");
+  es.subscribe("Event", [](int arg) { sink += arg; });
+  es.getQueue().reserve<int>(batch);
+
+  // only the publish calls are timed, the queue is drained between batches
+  run("publish", "by_name", 1, operations, [&]() {
+    double ns = 0;
+    for (std::size_t done = 0; done < operations; done += batch)
+    {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < batch; ++i)
+      {
+        es.publish("Event", static_cast<int>(i));
+      }
+      ns += elapsedNs(start, Clock::now());
+      es.process();
+    }
+    return ns;
+  });
+  run("publish", "by_handle", 1, operations, [&]() {
+    double ns = 0;
+    for (std::size_t done = 0; done < operations; done += batch)
+    {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < batch; ++i)
+      {
+        es.publish(handle, static_cast<int>(i));
+      }
+      ns += elapsedNs(start, Clock::now());
+      es.process();
+    }
+    return ns;
+  });
+  run("publish", "by_handle_and_process", 1, operations, [&]() {
+    auto start = Clock::now();
+    for (std::size_t done = 0; done < operations; done += batch)
+    {
+      for (std::size_t i = 0; i < batch; ++i)
+      {
+        es.publish(handle, static_cast<int>(i));
+      }
+      es.process();
+    }
+    return elapsedNs(start, Clock::now());
+  });
+  run("call", "by_name", 1, operations, [&]() {
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < operations; ++i)
+    {
+      es.call("Event", static_cast<int>(i));
+    }
+    return elapsedNs(start, Clock::now());
+  });
+  run("call", "by_handle", 1, operations, [&]() {
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < operations; ++i)
+    {
+      es.call(handle, static_cast<int>(i));
+    }
+    return elapsedNs(start, Clock::now());
+  });
+}
+
+// enqueue_tuple from concurrent producers, total time per event
+void benchmarkProducers(ES::EventQueueMode mode, const char* variant)
+{
+  const std::size_t operations = scaled(400000);
+  const std::size_t producerCounts[] = {1, 4, 16};
+
+  for (std::size_t producers : producerCounts)
+  {
+    ES::EventQueue queue(mode);
+    ES::SubscriberCollection<int> subscribers;
+    subscribers.addSubscriber([](int arg) { sink += arg; });
+    queue.reserve<int>(operations);
+    std::size_t perProducer = operations / producers;
+
+    run("enqueue_tuple", variant, producers, perProducer * producers, [&]() {
+      std::vector<std::thread> threads;
+      auto start = Clock::now();
+      for (std::size_t p = 0; p < producers; ++p)
+      {
+        threads.emplace_back([&]() {
+          for (std::size_t i = 0; i < perProducer; ++i)
+          {
+            queue.enqueue_tuple(&subscribers, std::make_tuple(static_cast<int>(i)));
+          }
+        });
+      }
+      for (auto& thread : threads)
+      {
+        thread.join();
+      }
+      double ns = elapsedNs(start, Clock::now());
+      queue.clear();
+      return ns;
+    });
+  }
+}
+
+// process() time per event, depending on the number of queued events
+void benchmarkDrain()
+{
+  const std::size_t depths[] = {10, 100, 1000, 10000, 100000};
+  const std::size_t operations = scaled(1000000);
+
+  for (std::size_t depth : depths)
+  {
+    ES::EventQueue queue;
+    ES::SubscriberCollection<int> subscribers;
+    subscribers.addSubscriber([](int arg) { sink += arg; });
+    queue.reserve<int>(depth);
+    std::size_t rounds = operations / depth > 0 ? operations / depth : 1;
+
+    run("process", "drain", depth, rounds * depth, [&]() {
+      double ns = 0;
+      for (std::size_t round = 0; round < rounds; ++round)
+      {
+        for (std::size_t i = 0; i < depth; ++i)
+        {
+          queue.enqueue(&subscribers, static_cast<int>(i));
+        }
+        auto start = Clock::now();
+        queue.process();
+        ns += elapsedNs(start, Clock::now());
+      }
+      return ns;
+    });
+  }
+}
+
+// call_tuple cost depending on the number of subscribers and the payload size. The subscribers
+// take the payload by value, so a copied payload is copied once per subscriber, a shared one not.
+void benchmarkDispatch()
+{
+  const std::size_t subscriberCounts[] = {1, 4, 16, 64};
+  const std::size_t payloadSizes[] = {8, 256, 4096};
+
+  for (std::size_t payloadSize : payloadSizes)
+  {
+    for (std::size_t count : subscriberCounts)
+    {
+      const std::size_t operations = scaled(4000000) / count;
+      char variant[64];
+
+      ES::SubscriberCollection<std::vector<char>> copied;
+      ES::SubscriberCollection<ES::Shared<std::vector<char>>> shared;
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        copied.addSubscriber([](std::vector<char> payload) { sink += payload[0]; });
+        shared.addSubscriber([](ES::Shared<std::vector<char>> payload) { sink += (*payload)[0]; });
+      }
+
+      std::vector<char> payload(payloadSize, 1);
+      auto copiedArgs = std::make_tuple(payload);
+      std::snprintf(variant, sizeof(variant), "copied_%zu_bytes", payloadSize);
+      run("dispatch", variant, count, operations, [&]() {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < operations; ++i)
+        {
+          copied.call_tuple(copiedArgs);
+        }
+        return elapsedNs(start, Clock::now());
+      });
+
+      auto sharedArgs = std::make_tuple(ES::makeShared<std::vector<char>>(payload));
+      std::snprintf(variant, sizeof(variant), "shared_%zu_bytes", payloadSize);
+      run("dispatch", variant, count, operations, [&]() {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < operations; ++i)
+        {
+          shared.call_tuple(sharedArgs);
+        }
+        return elapsedNs(start, Clock::now());
+      });
+    }
+  }
+}
+
+// subscribers interested in one key each: filtering in every subscriber vs. keyed subscriptions
+void benchmarkKeyed()
+{
+  const std::size_t subscriberCounts[] = {16, 200, 1000};
+
+  for (std::size_t count : subscriberCounts)
+  {
+    const std::size_t operations = scaled(20000000) / count;
+
+    ES::SubscriberCollection<int, double> filtered;
+    ES::SubscriberCollection<int, double> keyed;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      int id = static_cast<int>(i);
+      filtered.addSubscriber([id](int key, double value) {
+        if (key == id)
+        {
+          sink += static_cast<long>(value);
+        }
+      });
+      keyed.addKeyedSubscriber(id, [](int, double value) { sink += static_cast<long>(value); });
+    }
+
+    run("keyed_dispatch", "filtered", count, operations, [&]() {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < operations; ++i)
+      {
+        filtered.call(static_cast<int>(i % count), 1.0);
+      }
+      return elapsedNs(start, Clock::now());
+    });
+    run("keyed_dispatch", "keyed", count, operations, [&]() {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < operations; ++i)
+      {
+        keyed.call(static_cast<int>(i % count), 1.0);
+      }
+      return elapsedNs(start, Clock::now());
+    });
+  }
+}
+
+// getOrRegister cost for an existing event, depending on the number of registered events
+void benchmarkLookup()
+{
+  const std::size_t eventCounts[] = {10, 100, 1000, 10000};
+  const std::size_t operations = scaled(2000000);
+
+  for (std::size_t eventCount : eventCounts)
+  {
+    ES::EventRegistry registry;
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < eventCount; ++i)
+    {
+      names.push_back("Event" + std::to_string(i));
+      registry.registerEvent<int>(names.back());
+    }
+    // visit the names in a fixed random order, so that the lookups don't benefit from locality
+    Lcg random(eventCount);
+    std::vector<const std::string*> order;
+    for (std::size_t i = 0; i < 4096; ++i)
+    {
+      order.push_back(&names[random.next(eventCount)]);
+    }
+
+    run("getOrRegister", "existing", eventCount, operations, [&]() {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < operations; ++i)
+      {
+        sink += registry.getOrRegister<int>(*order[i & 4095]) != NULL;
+      }
+      return elapsedNs(start, Clock::now());
+    });
+
+    registry.freeze();
+    run("getOrRegister", "frozen", eventCount, operations, [&]() {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < operations; ++i)
+      {
+        sink += registry.getOrRegister<int>(*order[i & 4095]) != NULL;
+      }
+      return elapsedNs(start, Clock::now());
+    });
+  }
+}
+
+// register many events one by one and in bulk
+void benchmarkRegistration()
+{
+  const std::size_t eventCount = 3000;
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < eventCount; ++i)
+  {
+    names.push_back("Topic" + std::to_string(i));
+  }
+  std::vector<ES::EventName> eventNames(names.begin(), names.end());
+
+  run("registerEvent", "single", eventCount, eventCount, [&]() {
+    auto start = Clock::now();
+    {
+      ES::EventRegistry registry;
+      for (auto& name : names)
+      {
+        registry.registerEvent<int>(name);
+      }
+      sink += registry.getRegisteredEvents().size();
+    }
+    return elapsedNs(start, Clock::now());
+  });
+
+  run("registerEvent", "bulk", eventCount, eventCount, [&]() {
+    auto start = Clock::now();
+    {
+      ES::EventRegistry registry;
+      sink += registry.registerEvents<int>(eventNames).size();
+    }
+    return elapsedNs(start, Clock::now());
+  });
+}
+
+// subscribe followed by unsubscribe, depending on the number of other subscribers
+void benchmarkChurn()
+{
+  const std::size_t subscriberCounts[] = {0, 100, 10000};
+  const std::size_t operations = scaled(500000);
+
+  for (std::size_t count : subscriberCounts)
+  {
+    ES::EventSystem es;
+    auto handle = es.registerEvent<int>("Event");
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      es.subscribe("Event", [](int arg) { sink += arg; });
+    }
+
+    run("subscribe_unsubscribe", "by_handle", count, operations, [&]() {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < operations; ++i)
+      {
+        handle->addSubscriber([](int arg) { sink += arg; }).unsubscribe();
+      }
+      return elapsedNs(start, Clock::now());
+    });
+    run("subscribe_unsubscribe", "by_name", count, operations, [&]() {
+      auto start = Clock::now();
+      for (std::size_t i = 0; i < operations; ++i)
+      {
+        es.subscribe("Event", [](int arg) { sink += arg; }).unsubscribe();
+      }
+      return elapsedNs(start, Clock::now());
+    });
+  }
+}
+
+// calling an event from string arguments
+void benchmarkParse()
+{
+  const std::size_t operations = scaled(1000000);
+
+  ES::EventRegistry registry;
+  auto handle = registry.registerEvent<int, double, std::string>("Event");
+  handle->addSubscriber([](int a, double b, const std::string& c) { sink += a + static_cast<long>(b) + c.size(); });
+  const ES::EventParametersParserBase* parser = handle->getParametersParser();
+
+  std::vector<std::string> strings = {"12345", "2.5", "text"};
+  run("parse", "string_vector", 3, operations, [&]() {
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < operations; ++i)
+    {
+      parser->callEvent(strings);
+    }
+    return elapsedNs(start, Clock::now());
+  });
+  run("parse", "line", 3, operations, [&]() {
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < operations; ++i)
+    {
+      parser->callEventLine("12345 2.5 text");
+    }
+    return elapsedNs(start, Clock::now());
+  });
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc > 1)
+  {
+    scale = std::atof(argv[1]);
+    if (scale <= 0)
+    {
+      std::fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::printf("benchmark,variant,parameter,operations,ns_per_op\n");
+
+  benchmarkPublishVsCall();
+  benchmarkProducers(ES::EventQueueMode::LOCKING, "locking");
+  benchmarkProducers(ES::EventQueueMode::LOCK_FREE, "lock_free");
+  benchmarkDrain();
+  benchmarkDispatch();
+  benchmarkKeyed();
+  benchmarkLookup();
+  benchmarkRegistration();
+  benchmarkChurn();
+  benchmarkParse();
+
+  return 0;
+}
@@ -37,7 +37,21 @@
 
 #include "test_subscriptiononly.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -123,6 +137,21 @@ void pointer_handler(char* str) {
   cout << "pointer_handler got " << str << endl;
 }
 
+// counts copies, to check that event arguments are moved through the queue
+struct CopyCounter
+{
+  static int copies;
+  CopyCounter() = default;
+  CopyCounter(const CopyCounter&) { copies++; }
+  CopyCounter(CopyCounter&&) = default;
+};
+int CopyCounter::copies = 0;
+
+// static events, resolved at compile time
+ES_DEFINE_EVENT(StaticTestEvent, std::string, int);
+ES_DEFINE_EVENT(StaticEmptyEvent);
+ES_DEFINE_EVENT(StaticQueueEvent, int);
+
 bool returning_handler(int param) {
   cout << "returning_handler got " << param << endl;
   return true;
@@ -200,6 +229,67 @@ int main()
   }
   event1->call("Without temp");
 
+  {
+    // Test subscriber churn: removal keeps the order of the remaining subscribers
+    auto churnEvent = es.registerEvent<int>("ChurnEvent");
+    std::vector<int> callOrder;
+    std::vector<ES::SubscriptionHandle> churnHandles;
+    for (int i = 0; i < 100; ++i)
+    {
+      churnHandles.push_back(churnEvent->addSubscriber([&callOrder, i](int) { callOrder.push_back(i); }));
+    }
+    // remove every subscriber not divisible by 3, from the back and the front
+    for (int i = 99; i >= 0; --i)
+    {
+      if (i % 3 != 0 && i > 50)
+      {
+        churnHandles[i].unsubscribe();
+      }
+    }
+    for (int i = 0; i <= 50; ++i)
+    {
+      if (i % 3 != 0)
+      {
+        churnHandles[i].unsubscribe();
+      }
+    }
+    churnEvent->call(0);
+    bool churnOk = churnEvent->getHandlerCount() == 34 && callOrder.size() == 34;
+    for (size_t i = 0; churnOk && i < callOrder.size(); ++i)
+    {
+      churnOk = callOrder[i] == static_cast<int>(i * 3) && churnHandles[i * 3].isSubscribed();
+    }
+    churnOk = churnOk && !churnHandles[1].isSubscribed();
+    cout << "Subscriber churn keeps order: " << boolalpha << churnOk << endl;
+    if (!churnOk)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test changing subscriptions during dispatch
+    auto changeEvent = es.registerEvent<int>("ChangeEvent");
+    int selfCalls = 0, victimCalls = 0, lateCalls = 0;
+    ES::ScopedSubscription self, victim;
+    self = changeEvent->addSubscriber([&](int) {
+      selfCalls++;
+      // remove self and a later subscriber, and add a new one
+      self.unsubscribe();
+      victim.unsubscribe();
+      changeEvent->addSubscriber([&lateCalls](int) { lateCalls++; });
+    });
+    victim = changeEvent->addSubscriber([&victimCalls](int) { victimCalls++; });
+    changeEvent->call(1);
+    changeEvent->call(2);
+    bool changeOk = selfCalls == 1 && victimCalls == 0 && lateCalls == 1 && changeEvent->getHandlerCount() == 1;
+    cout << "Subscription changes during dispatch: " << boolalpha << changeOk << endl;
+    if (!changeOk)
+    {
+      nErrors++;
+    }
+  }
+
   {
     // Test stuff with event system
     cout << endl;
@@ -255,6 +345,1533 @@ int main()
     es.processNamed("StrEvent");
 
     es.process();
+
+    // test publishing through a pre-resolved handle
+    auto handleEvent = es.registerEvent<int>("HandleEvent");
+    int handleSum = 0;
+    es.subscribe("HandleEvent", [&handleSum](int param){
+      handleSum += param;
+    });
+    es.publish(handleEvent, 3);
+    es.call(handleEvent, 4);
+    es.process();
+    if (handleSum != 7)
+    {
+      nErrors++;
+      cout << "Publishing through handle failed, got " << handleSum << endl;
+    }
+  }
+
+  {
+    // Test lock-free queue with concurrent producers
+    cout << endl;
+
+    ES::EventSystem es(ES::EventQueueMode::LOCK_FREE);
+    auto orderEvent = es.registerEvent<int, int>("OrderEvent");
+
+    const int nThreads = 4;
+    const int nEvents = 10000;
+    std::vector<int> lastSeen(nThreads, -1);
+    int received = 0;
+    bool ordered = true;
+    es.subscribe("OrderEvent", [&](int thread, int idx) {
+      // events from a single producer must arrive in FIFO order
+      if (idx != lastSeen[thread] + 1)
+      {
+        ordered = false;
+      }
+      lastSeen[thread] = idx;
+      received++;
+    });
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < nThreads; ++t)
+    {
+      producers.emplace_back([&es, orderEvent, t]() {
+        for (int i = 0; i < nEvents; ++i)
+        {
+          es.publish(orderEvent, t, i);
+        }
+      });
+    }
+    // process concurrently to the producers
+    while (received < nThreads * nEvents)
+    {
+      es.process();
+    }
+    for (auto& producer : producers)
+    {
+      producer.join();
+    }
+    cout << "Lock-free queue received " << received << " events, ordered: " << boolalpha << ordered << endl;
+    if (!ordered || received != nThreads * nEvents)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test parallel processing, events of one topic must stay ordered
+    cout << endl;
+
+    ES::EventSystem es;
+    es.setProcessingThreads(3);
+
+    const int nTopics = 8;
+    const int nEvents = 1000;
+    std::vector<int> lastSeen(nTopics, -1);
+    std::vector<int> received(nTopics, 0);
+    std::unique_ptr<std::atomic<bool>[]> inside(new std::atomic<bool>[nTopics]);
+    std::atomic<bool> ordered(true);
+    std::vector<ES::EventHandle<int>> topics;
+    for (int t = 0; t < nTopics; ++t)
+    {
+      inside[t] = false;
+      topics.push_back(es.registerEvent<int>("ParallelEvent" + std::to_string(t)));
+      es.subscribe<int>("ParallelEvent" + std::to_string(t), [&, t](int idx) {
+        // subscribers of one topic must never run concurrently
+        if (inside[t].exchange(true))
+        {
+          ordered = false;
+        }
+        if (idx != lastSeen[t] + 1)
+        {
+          ordered = false;
+        }
+        lastSeen[t] = idx;
+        received[t]++;
+        inside[t] = false;
+      });
+    }
+    for (int i = 0; i < nEvents; ++i)
+    {
+      for (int t = 0; t < nTopics; ++t)
+      {
+        es.publish(topics[t], i);
+      }
+    }
+    es.processUntilEmpty();
+
+    int total = 0;
+    for (int t = 0; t < nTopics; ++t)
+    {
+      total += received[t];
+    }
+    cout << "Parallel processing with " << es.getProcessingThreads() << " threads received " << total
+        << " events, ordered: " << boolalpha << ordered << endl;
+    if (!ordered || total != nTopics * nEvents)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test blocking wait for events
+    cout << endl;
+
+    ES::EventSystem es(ES::EventQueueMode::LOCK_FREE);
+    auto waitEvent = es.registerEvent<int>("WaitEvent");
+    const int nEvents = 1000;
+    int received = 0;
+    es.subscribe<int>("WaitEvent", [&](int) { received++; });
+
+    // empty queue must time out
+    auto start = std::chrono::steady_clock::now();
+    bool processed = es.waitAndProcess(std::chrono::milliseconds(20));
+    auto waited = std::chrono::steady_clock::now() - start;
+    if (processed || waited < std::chrono::milliseconds(20))
+    {
+      nErrors++;
+      cout << "Waiting on empty queue did not time out" << endl;
+    }
+
+    // consumer is woken up by the producer
+    std::thread producer([&es, waitEvent]() {
+      for (int i = 0; i < nEvents; ++i)
+      {
+        es.publish(waitEvent, i);
+        if (i % 100 == 0)
+        {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+    });
+    start = std::chrono::steady_clock::now();
+    while (received < nEvents && std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+    {
+      es.waitAndProcess(std::chrono::seconds(10));
+    }
+    producer.join();
+
+    // wakeUp releases a waiting thread early
+    std::thread waker([&es]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      es.wakeUp();
+    });
+    start = std::chrono::steady_clock::now();
+    es.waitAndProcess(std::chrono::seconds(10));
+    waited = std::chrono::steady_clock::now() - start;
+    waker.join();
+
+    cout << "Blocking wait received " << received << " events" << endl;
+    if (received != nEvents || waited >= std::chrono::seconds(10))
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test subscription changes from another thread while dispatching
+    ES::EventSystem es;
+    auto concurrentEvent = es.registerEvent<int>("ConcurrentEvent");
+    long calls = 0;
+    es.subscribe("ConcurrentEvent", [&calls](int) { calls++; });
+
+    std::atomic<bool> done(false);
+    std::thread subscriber([&]() {
+      while (!done)
+      {
+        ES::ScopedSubscription temp = concurrentEvent->addSubscriber([](int) {});
+      }
+    });
+    for (int i = 0; i < 20000; ++i)
+    {
+      es.call(concurrentEvent, i);
+    }
+    done = true;
+    subscriber.join();
+    cout << "Concurrent subscription changes: " << boolalpha << (calls == 20000) << endl;
+    if (calls != 20000 || concurrentEvent->getHandlerCount() != 1)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test processing single topics, both queue modes must keep the remaining order
+    ES::EventQueueMode modes[] = { ES::EventQueueMode::LOCKING, ES::EventQueueMode::LOCK_FREE };
+    for (ES::EventQueueMode mode : modes)
+    {
+      ES::EventSystem es(mode);
+      std::vector<std::string> log;
+      auto topicA = es.registerEvent<int>("TopicA");
+      auto topicB = es.registerEvent<int>("TopicB");
+      auto topicC = es.registerEvent<int>("TopicC");
+      es.subscribe<int>("TopicA", [&log](int i) { log.push_back("A" + std::to_string(i)); });
+      es.subscribe<int>("TopicB", [&log](int i) { log.push_back("B" + std::to_string(i)); });
+      es.subscribe<int>("TopicC", [&log](int i) { log.push_back("C" + std::to_string(i)); });
+      for (int i = 0; i < 3; ++i)
+      {
+        es.publish(topicA, i);
+        es.publish(topicB, i);
+        es.publish(topicC, i);
+      }
+      es.processNamed(topicB);
+      es.getQueue().processOne();
+      es.processNamed("TopicC");
+      es.publish(topicB, 3);
+      es.process();
+
+      std::string result;
+      for (auto& entry : log)
+      {
+        result += entry + " ";
+      }
+      cout << "Topic processing order: " << result << endl;
+      if (result != "B0 B1 B2 A0 C0 C1 C2 A1 A2 B3 " || !es.getQueue().isEmpty())
+      {
+        nErrors++;
+      }
+    }
+  }
+
+  {
+    // Test bounded queue policies
+    cout << endl;
+    ES::OverflowPolicy policies[] = { ES::OverflowPolicy::DROP_NEWEST, ES::OverflowPolicy::DROP_OLDEST };
+    const char* expected[] = { "0 1 2 ", "2 3 4 " };
+    for (int p = 0; p < 2; ++p)
+    {
+      ES::EventSystem es;
+      es.setQueueCapacity(3, policies[p]);
+      auto boundedEvent = es.registerEvent<int>("BoundedEvent");
+      std::string result;
+      es.subscribe<int>("BoundedEvent", [&result](int i) { result += std::to_string(i) + " "; });
+      int accepted = 0;
+      for (int i = 0; i < 5; ++i)
+      {
+        if (es.publish(boundedEvent, i))
+        {
+          accepted++;
+        }
+      }
+      es.process();
+      cout << "Bounded queue delivered " << result << "accepted " << accepted << endl;
+      if (result != expected[p] || accepted != (p == 0 ? 3 : 5))
+      {
+        nErrors++;
+      }
+    }
+
+    {
+      // conflating topic, other topics are unaffected
+      ES::EventSystem es;
+      auto stateEvent = es.registerEvent<int>("StateEvent");
+      auto logEvent = es.registerEvent<int>("LogEvent");
+      es.setEventCapacity(stateEvent, 1, ES::OverflowPolicy::CONFLATE);
+      std::string result;
+      es.subscribe<int>("StateEvent", [&result](int i) { result += "S" + std::to_string(i) + " "; });
+      es.subscribe<int>("LogEvent", [&result](int i) { result += "L" + std::to_string(i) + " "; });
+      bool conflated = true;
+      for (int i = 0; i < 3; ++i)
+      {
+        ES::PublishResult r = es.publish(stateEvent, i);
+        conflated = conflated && r == (i == 0 ? ES::PublishStatus::QUEUED : ES::PublishStatus::CONFLATED);
+        es.publish(logEvent, i);
+      }
+      es.process();
+      cout << "Conflating topic delivered " << result << endl;
+      if (!conflated || result != "S2 L0 L1 L2 " || es.getQueue().getStatistics().conflated != 2)
+      {
+        nErrors++;
+      }
+    }
+
+    {
+      // blocking producer with timeout
+      ES::EventSystem es;
+      es.setQueueCapacity(1, ES::OverflowPolicy::BLOCK);
+      es.getQueue().setBlockTimeout(std::chrono::milliseconds(10));
+      auto blockEvent = es.registerEvent<int>("BlockEvent");
+      int received = 0;
+      es.subscribe<int>("BlockEvent", [&received](int) { received++; });
+      es.publish(blockEvent, 0);
+      ES::PublishResult timedOut = es.publish(blockEvent, 1);
+
+      // blocking producer, released by the consumer
+      es.process();
+      es.getQueue().setBlockTimeout(std::chrono::milliseconds(-1));
+      const int nEvents = 200;
+      std::thread producer([&es, blockEvent]() {
+        for (int i = 0; i < nEvents; ++i)
+        {
+          es.publish(blockEvent, i);
+        }
+      });
+      while (received < nEvents + 1)
+      {
+        es.waitAndProcess(std::chrono::milliseconds(100));
+      }
+      producer.join();
+      ES::EventQueueStatistics stats = es.getQueue().getStatistics();
+      cout << "Blocking queue received " << received << ", high-water " << stats.highWaterMark << endl;
+      if (timedOut != ES::PublishStatus::TIMED_OUT || stats.highWaterMark != 1 || stats.rejected != 1)
+      {
+        nErrors++;
+      }
+    }
+  }
+
+  {
+    // Test latest-value events
+    ES::EventQueueMode modes[] = { ES::EventQueueMode::LOCKING, ES::EventQueueMode::LOCK_FREE };
+    for (ES::EventQueueMode mode : modes)
+    {
+      ES::EventSystem es(mode);
+      auto poseEvent = es.registerEvent<int>("PoseEvent", ES::conflating);
+      es.reserveQueuedEvents<int>(1);
+      std::string result;
+      es.subscribe<int>("PoseEvent", [&result](int i) { result += std::to_string(i) + " "; });
+      for (int round = 0; round < 3; ++round)
+      {
+        for (int i = 0; i < 1000; ++i)
+        {
+          es.publish(poseEvent, round * 1000 + i);
+        }
+        es.process();
+      }
+      cout << "Latest-value event delivered " << result << "heap allocations "
+           << es.getQueue().getHeapAllocationCount() << endl;
+      if (result != "999 1999 2999 " || es.getQueue().getHeapAllocationCount() != 0)
+      {
+        nErrors++;
+      }
+    }
+  }
+
+  {
+    // a merged publish with a higher priority moves the queued latest-value event
+    ES::EventSystem es;
+    std::string result;
+    auto poseEvent = es.registerEvent<int>("PrioPoseEvent", ES::conflating);
+    auto dataEvent = es.registerEvent<int>("PrioMergeDataEvent");
+    es.subscribe<int>("PrioPoseEvent", [&result](int i) { result += "P" + std::to_string(i) + " "; });
+    es.subscribe<int>("PrioMergeDataEvent", [&result](int i) { result += "D" + std::to_string(i) + " "; });
+    es.publishWithPriority(ES::EventPriority::LOW, poseEvent, 0);
+    es.publish(dataEvent, 0);
+    bool conflated = es.publishWithPriority(ES::EventPriority::HIGH, poseEvent, 1) == ES::PublishStatus::CONFLATED;
+    es.publishWithPriority(ES::EventPriority::LOW, poseEvent, 2);
+    es.process();
+    cout << "Merged priority: " << result << endl;
+    if (!conflated || result != "P2 D0 ")
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test priority lanes
+    ES::EventSystem es;
+    std::string result;
+    auto logEvent = es.registerEvent<int>("PrioLogEvent", ES::EventPriority::LOW);
+    auto stopEvent = es.registerEvent<int>("PrioStopEvent", ES::EventPriority::CRITICAL);
+    auto dataEvent = es.registerEvent<int>("PrioDataEvent");
+    es.subscribe<int>("PrioLogEvent", [&result](int i) { result += "L" + std::to_string(i) + " "; });
+    es.subscribe<int>("PrioStopEvent", [&result](int i) { result += "S" + std::to_string(i) + " "; });
+    es.subscribe<int>("PrioDataEvent", [&result](int i) { result += "D" + std::to_string(i) + " "; });
+
+    // strict
+    es.publish(logEvent, 0);
+    es.publish(dataEvent, 0);
+    es.publish(logEvent, 1);
+    es.publish(stopEvent, 0);
+    es.publishWithPriority(ES::EventPriority::HIGH, dataEvent, 1);
+    es.getQueue().processOne();
+    es.process();
+    std::string strict = result;
+
+    // weighted, two normal events per low event
+    result.clear();
+    es.getQueue().setPriorityWeights(1, 1, 2, 1);
+    for (int i = 0; i < 3; ++i)
+    {
+      es.publish(logEvent, i);
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+      es.publish(dataEvent, i);
+    }
+    es.process();
+    cout << "Priority lanes: strict " << strict << "weighted " << result << endl;
+    if (strict != "S0 D1 D0 L0 L1 " || result != "D0 D1 L0 D2 D3 L1 L2 ")
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test batch publishing
+    ES::EventQueueMode modes[] = { ES::EventQueueMode::LOCKING, ES::EventQueueMode::LOCK_FREE };
+    for (ES::EventQueueMode mode : modes)
+    {
+      ES::EventSystem es(mode);
+      auto detectionEvent = es.registerEvent<int, std::string>("DetectionEvent");
+      auto frameEvent = es.registerEvent<int>("FrameEvent");
+      std::string result;
+      es.subscribe<int, std::string>("DetectionEvent", [&result](int i, const std::string& s) {
+        result += s + std::to_string(i) + " ";
+      });
+      es.subscribe<int>("FrameEvent", [&result](int i) { result += "F" + std::to_string(i) + " "; });
+
+      es.publish(frameEvent, 0);
+      {
+        auto batch = es.createBatch(detectionEvent);
+        batch.publish(0, "D");
+        batch.publish(1, "D");
+        // not visible before flushing
+        es.process();
+        batch.publishTuple(std::make_tuple(2, std::string("D")));
+      }
+      std::vector<int> frames = { 1, 2 };
+      size_t queued = es.publishBatch(frameEvent, frames);
+      std::vector<std::tuple<int, std::string>> detections = { std::make_tuple(3, "E"), std::make_tuple(4, "E") };
+      queued += es.publishBatch<int, std::string>("DetectionEvent", detections);
+      es.process();
+
+      // limits apply to every event of the batch
+      es.setQueueCapacity(2, ES::OverflowPolicy::DROP_NEWEST);
+      std::vector<int> tooMany = { 5, 6, 7 };
+      size_t limited = es.publishBatch(frameEvent, tooMany);
+      es.process();
+      cout << "Batch publishing delivered " << result << endl;
+      if (result != "F0 D0 D1 D2 F1 F2 E3 E4 F5 F6 " || queued != 4 || limited != 2)
+      {
+        nErrors++;
+      }
+    }
+  }
+
+  {
+    // batch limits are applied to the batched events themselves
+    ES::EventSystem es;
+    auto pose = es.registerEvent<int>("BatchPose", ES::conflating);
+    auto sample = es.registerEvent<int>("BatchSample");
+    std::string result;
+    es.subscribe<int>("BatchPose", [&result](int i) { result += "P" + std::to_string(i) + " "; });
+    es.subscribe<int>("BatchSample", [&result](int i) { result += "S" + std::to_string(i) + " "; });
+    es.setEventCapacity(sample, 2, ES::OverflowPolicy::DROP_OLDEST);
+
+    std::vector<int> poses = { 1, 2, 3 };
+    size_t posesAccepted = es.publishBatch(pose, poses);
+    std::vector<int> samples = { 1, 2, 3, 4 };
+    size_t samplesAccepted = es.publishBatch(sample, samples);
+    ES::EventQueueStatistics stats = es.getQueue().getStatistics();
+    es.process();
+    cout << "Batch limits delivered " << result << endl;
+    if (result != "P3 S3 S4 " || posesAccepted != 3 || samplesAccepted != 4 || stats.depth != 3
+        || stats.enqueued != 5 || stats.conflated != 2 || stats.discarded != 2)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test queue counters
+    ES::EventSystem es;
+    auto countEvent = es.registerEvent<int>("CountEvent");
+    es.subscribe<int>("CountEvent", [](int) {});
+    for (int i = 0; i < 5; ++i)
+    {
+      es.publish(countEvent, i);
+    }
+    es.getQueue().processOne();
+    es.getQueue().processOne();
+    es.publish(countEvent, 5);
+    size_t depth = es.getQueue().size();
+    es.getQueue().clear();
+    ES::EventQueueStatistics stats = es.getQueue().getStatistics();
+    cout << "Queue counters: depth " << depth << ", high-water " << stats.highWaterMark << ", enqueued "
+         << stats.enqueued << ", processed " << stats.processed << ", discarded " << stats.discarded << endl;
+    if (depth != 4 || stats.depth != 0 || stats.highWaterMark != 5 || stats.enqueued != 6
+        || stats.processed != 2 || stats.discarded != 4)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test pooled queue nodes
+    ES::EventSystem es;
+    auto poolEvent = es.registerEvent<std::string>("PoolEvent");
+    int received = 0;
+    es.subscribe("PoolEvent", [&received](const std::string&) { received++; });
+
+    es.reserveQueuedEvents<std::string>(100);
+    for (int round = 0; round < 10; ++round)
+    {
+      for (int i = 0; i < 100; ++i)
+      {
+        es.publish(poolEvent, "pooled");
+      }
+      es.process();
+    }
+    cout << "Pooled events received: " << received << ", heap allocations: "
+         << es.getQueue().getHeapAllocationCount() << endl;
+    if (received != 1000 || es.getQueue().getHeapAllocationCount() != 0)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test moving arguments through the queue
+    ES::EventSystem es;
+
+    es.subscribe("MoveEvent", [](const CopyCounter&) {});
+    es.publish("MoveEvent", CopyCounter());
+    es.process();
+    cout << "Copies of published rvalue: " << CopyCounter::copies << endl;
+    if (CopyCounter::copies != 0)
+    {
+      nErrors++;
+    }
+
+    // lambda too large for the inline delegate buffer, copied into the subscriber list
+    std::array<long, 16> bigCapture;
+    bigCapture.fill(1);
+    long bigSum = 0;
+    es.subscribe("BigLambdaEvent", [bigCapture, &bigSum](int factor) {
+      for (long value : bigCapture)
+      {
+        bigSum += factor * value;
+      }
+    });
+    es.publish("BigLambdaEvent", 2);
+    es.process();
+    if (bigSum != 32)
+    {
+      nErrors++;
+      cout << "Large lambda subscriber failed, got " << bigSum << endl;
+    }
+
+    // move-only argument with a single subscriber
+    int uniqueValue = 0;
+    es.subscribe("UniqueEvent", [&uniqueValue](std::unique_ptr<int> ptr) {
+      uniqueValue = *ptr;
+    });
+    es.publish("UniqueEvent", std::unique_ptr<int>(new int(5)));
+    es.process();
+    cout << "Move-only argument received: " << uniqueValue << endl;
+    if (uniqueValue != 5)
+    {
+      nErrors++;
+    }
+    try {
+      es.subscribe("UniqueEvent", [](std::unique_ptr<int>) {});
+      nErrors++;
+      cout << "Second subscriber for move-only event was accepted" << endl;
+    } catch (std::logic_error& ex) {
+      cout << "Second subscriber for move-only event rejected: " << ex.what() << endl;
+    }
+  }
+
+  {
+    // Test instrumentation
+    ES::EventSystem es;
+    auto handle = es.registerEvent<int>("InstrumentedEvent");
+    int sum = 0;
+    es.subscribe("InstrumentedEvent", [&sum](int value) { sum += value; });
+    es.subscribe("InstrumentedEvent", [&sum](int value) { sum -= 2 * value; });
+
+    // enqueued while disabled, processed while enabled: only the subscribers are timed
+    es.publish(handle, 1);
+    ES::setInstrumentationEnabled(true);
+    for (int i = 0; i < 5; ++i)
+    {
+      es.publish(handle, i);
+    }
+    es.process();
+    es.call(handle, 1);
+    ES::setInstrumentationEnabled(false);
+    es.publish(handle, 1);
+    es.process();
+
+    ES::EventInstrumentationSnapshot snapshot;
+    for (auto& event : es.getInstrumentation())
+    {
+      if (event.name == "InstrumentedEvent")
+      {
+        snapshot = event;
+      }
+    }
+    cout << "Instrumentation: " << snapshot.published << " queued, " << snapshot.fired << " processed, "
+         << snapshot.subscribers.size() << " subscribers" << endl;
+    if (!ES_ENABLE_INSTRUMENTATION)
+    {
+      // compiled out, nothing is recorded
+    }
+    else if (snapshot.published != 5 || snapshot.fired != 5 || snapshot.queueDelay.count != 5
+        || snapshot.residency.count != 5 || snapshot.residency.totalNs < snapshot.queueDelay.totalNs
+        || snapshot.subscribers.size() != 2 || snapshot.subscribers[0].calls != 7
+        || snapshot.subscribers[1].calls != 7)
+    {
+      nErrors++;
+    }
+    std::ostringstream report;
+    es.printInstrumentation(report);
+    if (ES_ENABLE_INSTRUMENTATION && report.str().find("Event InstrumentedEvent: 5 queued") == std::string::npos)
+    {
+      nErrors++;
+      cout << "Unexpected instrumentation report: " << report.str() << endl;
+    }
+  }
+
+  {
+    // Test registry lookups while the hash table grows
+    ES::EventRegistry registry;
+    registry.registerEvent<int>("Lookup0");
+    std::atomic<bool> stopReaders(false);
+    std::atomic<int> lookupFailures(0);
+    std::thread reader([&]() {
+      while (!stopReaders.load())
+      {
+        if (registry.getSubscribers<int>("Lookup0") == NULL)
+        {
+          lookupFailures++;
+        }
+      }
+    });
+    for (int i = 1; i < 200; ++i)
+    {
+      registry.registerEvent<int>("Lookup" + std::to_string(i));
+    }
+    stopReaders = true;
+    reader.join();
+
+    int found = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+      if (registry.getSubscribers<int>("Lookup" + std::to_string(i)) != NULL)
+      {
+        found++;
+      }
+    }
+    // a character range needs no null terminator
+    const char* text = "Lookup12345";
+    bool rangeFound = registry.getSubscribers(ES::EventName(text, 8)) == registry.getSubscribers("Lookup12");
+    bool missing = registry.getSubscribers("Lookup200") == NULL && registry.getSubscribers("") == NULL;
+    bool ordered = registry.getRegisteredEvents().begin()->first == "Lookup0";
+    cout << "Registry lookups: " << found << " found, " << lookupFailures << " failures" << endl;
+    if (found != 200 || lookupFailures != 0 || !rangeFound || !missing || !ordered)
+    {
+      nErrors++;
+    }
+
+    // type checks compare type tags, the type names are only used for the error message
+    if (!registry.hasRegisteredEvent<const int&>("Lookup1") || registry.hasRegisteredEvent<double>("Lookup1"))
+    {
+      nErrors++;
+      cout << "Registry type check failed" << endl;
+    }
+    try {
+      registry.getOrRegister<std::string>("Lookup1");
+      nErrors++;
+      cout << "Registry accepted mismatched argument types" << endl;
+    } catch (std::invalid_argument& ex) {
+      if (std::string(ex.what()).find("[int]") == std::string::npos)
+      {
+        nErrors++;
+        cout << "Unexpected type mismatch message: " << ex.what() << endl;
+      }
+    }
+  }
+
+  {
+    // Test static events
+    std::string received;
+    {
+      ES::EventSystem es;
+      ES::ScopedSubscription subscription = es.subscribe<StaticTestEvent>([&received](const std::string& text, int count) {
+        for (int i = 0; i < count; ++i)
+        {
+          received += text;
+        }
+      });
+      int emptyCount = 0;
+      ES::ScopedSubscription emptySubscription = es.subscribe<StaticEmptyEvent>([&emptyCount]() {
+        emptyCount++;
+      });
+
+      es.publish<StaticTestEvent>("a", 2);
+      es.publish<StaticEmptyEvent>();
+      // static events interoperate with the by-name methods
+      es.publish("StaticTestEvent", std::string("b"), 1);
+      es.process();
+      es.call<StaticTestEvent>("c", 1);
+      es.call<StaticEmptyEvent>();
+
+      cout << "Static event received: " << received << ", empty event: " << emptyCount << endl;
+      if (received != "aabc" || emptyCount != 2)
+      {
+        nErrors++;
+      }
+      if (es.getRegisteredEvents().count("StaticTestEvent") != 1
+          || es.getSubscribers<std::string, int>("StaticTestEvent") != &StaticTestEvent::getSubscribers())
+      {
+        nErrors++;
+        cout << "Static event is not registered by name" << endl;
+      }
+      try {
+        es.registerEvent<int>("StaticEmptyEvent");
+        nErrors++;
+        cout << "Dynamic event with static event name was accepted" << endl;
+      } catch (std::invalid_argument&) {
+      }
+    }
+
+    // the subscriber collection outlives the event system
+    ES::EventSystem es;
+    es.registerStaticEvent<StaticTestEvent>();
+    es.publish<StaticTestEvent>("d", 1);
+    es.process();
+    if (received != "aabc" || StaticTestEvent::getSubscribers().getHandlerCount() != 0)
+    {
+      nErrors++;
+      cout << "Static event subscription was not removed" << endl;
+    }
+  }
+
+  {
+    // static events are shared by all event systems, so they keep the default queue of each one
+    ES::EventSystem first;
+    ES::EventSystem second;
+    ES::QueueId worker = first.addQueue("worker");
+    int rejected = 0;
+    try
+    {
+      first.setEventQueue(StaticQueueEvent::getHandle(), worker);
+    }
+    catch (std::logic_error&)
+    {
+      rejected++;
+    }
+    try
+    {
+      first.subscribeOn(worker, StaticQueueEvent::getHandle(), [](int) {});
+    }
+    catch (std::logic_error&)
+    {
+      rejected++;
+    }
+    int sum = 0;
+    ES::ScopedSubscription subscription = second.subscribe<StaticQueueEvent>([&sum](int value) { sum += value; });
+    first.publish<StaticQueueEvent>(1);
+    second.publish<StaticQueueEvent>(10);
+    bool queuesOk = first.getQueue(worker).isEmpty() && first.getQueue().size() == 1 && second.getQueue().size() == 1;
+    second.process();
+    first.process();
+    cout << "Static event queues: rejected " << rejected << ", sum " << sum << endl;
+    if (rejected != 2 || !queuesOk || sum != 11 || StaticQueueEvent::getSubscribers().getTargetQueue() != NULL)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // Test shared payloads: one allocation, no copies, same object for every subscriber
+    ES::EventSystem es;
+    auto handle = es.registerEvent<ES::Shared<CopyCounter>>("SharedEvent");
+
+    CopyCounter::copies = 0;
+    std::vector<const CopyCounter*> seen;
+    es.subscribe<ES::Shared<CopyCounter>>("SharedEvent", [&seen](const ES::Shared<CopyCounter>& payload) {
+      seen.push_back(payload.get());
+    });
+    es.subscribe<ES::Shared<CopyCounter>>("SharedEvent", [&seen](ES::Shared<CopyCounter> payload) {
+      seen.push_back(payload.get());
+    });
+    es.subscribe<ES::Shared<CopyCounter>>("SharedEvent", [&seen](const CopyCounter& payload) {
+      seen.push_back(&payload);
+    });
+
+    ES::Shared<CopyCounter> payload = ES::makeShared<CopyCounter>();
+    es.publish(handle, payload);
+    es.publish(handle, CopyCounter());
+    es.process();
+    cout << "Shared payload subscribers: " << seen.size() << ", copies: " << CopyCounter::copies
+         << ", use count: " << payload.useCount() << endl;
+    if (seen.size() != 6 || CopyCounter::copies != 0 || payload.useCount() != 1
+        || seen[0] != payload.get() || seen[1] != payload.get() || seen[2] != payload.get()
+        || seen[3] != seen[4] || seen[4] != seen[5] || seen[3] == payload.get())
+    {
+      nErrors++;
+    }
+
+    std::ostringstream description;
+    handle->appendEventArgsDescription(description);
+    cout << "Shared payload description: " << description.str() << endl;
+    if (description.str().find("ES::Shared<") == std::string::npos)
+    {
+      nErrors++;
+    }
+
+    // shared payloads parse like their payload type
+    auto parsedHandle = es.registerEvent<ES::Shared<std::string>>("SharedStringEvent");
+    std::string parsed;
+    es.subscribe<ES::Shared<std::string>>("SharedStringEvent", [&parsed](const std::string& value) {
+      parsed = value;
+    });
+    auto parser = parsedHandle->getParametersParser();
+    if (parser->getParameterType(0) != ES::ParameterType::STRING)
+    {
+      nErrors++;
+      cout << "Shared payload has wrong parameter type" << endl;
+    }
+    parser->callEvent({"parsed payload"});
+    cout << "Parsed shared payload: " << parsed << endl;
+    if (parsed != "parsed payload")
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // record events to a log file and replay them into another registry
+    const std::string logPath = "/tmp/eslib_test_events.log";
+    ES::EventSystem source;
+    auto intHandle = source.registerEvent<int, std::string>("RecordedEvent");
+    auto vectorHandle = source.registerEvent<std::vector<double>, ES::Shared<std::string>>("RecordedVectorEvent");
+    auto pointerHandle = source.registerEvent<int*>("UnrecordableEvent");
+    {
+      ES::EventRecorder recorder(source, logPath, 64);
+      source.getQueue().setRecorder(&recorder);
+      source.publish(intHandle, 1, std::string("one"));
+      source.publish(vectorHandle, std::vector<double> {1.5, 2.5, 3.5}, ES::makeShared<std::string>("shared"));
+      source.publish(pointerHandle, static_cast<int*>(NULL));
+      source.getQueue().enqueue_tuple(intHandle.get(), std::make_tuple(2, std::string(200, 'x')),
+          ES::EventPriority::HIGH);
+      source.getQueue().setRecorder(NULL);
+      source.process();
+      cout << "Recorded events: " << recorder.getRecordedCount() << ", skipped: " << recorder.getSkippedCount()
+           << endl;
+      if (recorder.getRecordedCount() != 3 || recorder.getSkippedCount() != 1)
+      {
+        nErrors++;
+      }
+    }
+
+    ES::EventSystem target;
+    target.registerEvent<int, std::string>("RecordedEvent");
+    std::vector<std::string> replayed;
+    target.subscribe<int, std::string>("RecordedEvent", [&replayed](int value, const std::string& text) {
+      replayed.push_back(std::to_string(value) + ":" + text.substr(0, 3));
+    });
+    ES::EventReplayer replayer(logPath);
+    std::size_t replayedCount = replayer.replay(target, target.getQueue());
+    target.process();
+    // the high priority event overtakes the first one
+    cout << "Replayed events: " << replayedCount << ", skipped: " << replayer.getSkippedCount() << endl;
+    if (replayedCount != 2 || replayer.getSkippedCount() != 1 || replayed.size() != 2
+        || replayed[0] != "2:xxx" || replayed[1] != "1:one")
+    {
+      nErrors++;
+    }
+
+    target.registerEvent<std::vector<double>, ES::Shared<std::string>>("RecordedVectorEvent");
+    std::vector<double> values;
+    std::string shared;
+    target.subscribe<std::vector<double>, ES::Shared<std::string>>("RecordedVectorEvent",
+        [&values, &shared](const std::vector<double>& v, const std::string& s) {
+          values = v;
+          shared = s;
+        });
+    replayer.replay(target, target.getQueue(), 1000.0);
+    target.process();
+    if (values.size() != 3 || values[2] != 3.5 || shared != "shared" || replayed.size() != 4)
+    {
+      nErrors++;
+      cout << "Replayed vector event mismatch" << endl;
+    }
+
+    // argument types must match
+    ES::EventSystem mismatch;
+    mismatch.registerEvent<int>("RecordedEvent");
+    try
+    {
+      replayer.replay(mismatch, mismatch.getQueue());
+      nErrors++;
+      cout << "Replaying mismatching arguments did not throw" << endl;
+    }
+    catch (std::invalid_argument& e)
+    {
+      cout << "Replay mismatch: " << e.what() << endl;
+    }
+
+    // a log that was not closed ends with the zeros of the grown file
+    {
+      ES::EventRecorder recorder(source, logPath, 64);
+      source.getQueue().setRecorder(&recorder);
+      for (int i = 0; i < 3; ++i)
+      {
+        source.publish(intHandle, i, std::string("crash"));
+      }
+      source.getQueue().setRecorder(NULL);
+      source.process();
+
+      ES::EventReplayer unclosed(logPath);
+      std::size_t unclosedCount = unclosed.replay(target, target.getQueue());
+      target.process();
+      cout << "Replayed unclosed log: " << unclosedCount << endl;
+      if (unclosedCount != 3 || replayed.size() != 7 || replayed.back() != "2:cra")
+      {
+        nErrors++;
+      }
+    }
+    std::remove(logPath.c_str());
+  }
+
+  {
+    // mirror topics into another registry through shared memory
+    const std::string bridgeName = "/eslib_test_bridge_" + std::to_string(getpid());
+    ES::EventSystem source;
+    auto bridgedHandle = source.registerEvent<int, std::string>("BridgedEvent");
+    auto localHandle = source.registerEvent<int>("LocalEvent");
+    auto lateHandle = source.registerEvent<std::vector<float>>("LateBridgedEvent");
+    ES::EventBridgeSender sender(source, bridgeName, 256);
+    sender.addTopic("BridgedEvent");
+    source.getQueue().setRecorder(&sender);
+
+    ES::EventSystem target;
+    target.registerEvent<int, std::string>("BridgedEvent");
+    target.registerEvent<std::vector<float>>("LateBridgedEvent");
+    ES::EventBridgeReceiver receiver(target, bridgeName);
+    int received = 0;
+    std::size_t lateSize = 0;
+    target.subscribe<int, std::string>("BridgedEvent", [&received](int value, const std::string& text) {
+      if (text == "bridged")
+      {
+        received += value;
+      }
+    });
+    target.subscribe<std::vector<float>>("LateBridgedEvent", [&lateSize](const std::vector<float>& values) {
+      lateSize += values.size();
+    });
+
+    // more data than fits into the ring, the rest is dropped
+    for (int i = 1; i <= 20; ++i)
+    {
+      source.publish(bridgedHandle, i, std::string("bridged"));
+    }
+    source.publish(localHandle, 5);
+    std::size_t polled = receiver.poll(target.getQueue());
+    target.process();
+    cout << "Bridged events: " << polled << ", dropped: " << receiver.getDroppedCount() << endl;
+    if (polled == 0 || polled + receiver.getDroppedCount() != 20
+        || received != static_cast<int>(polled * (polled + 1) / 2))
+    {
+      nErrors++;
+    }
+
+    // the ring is free again, and topics can be added while connected
+    sender.addTopic("LateBridgedEvent");
+    source.publish(lateHandle, std::vector<float>(10, 1.0f));
+    source.publish(bridgedHandle, 100, std::string("bridged"));
+    polled = receiver.poll(target.getQueue());
+    target.process();
+    source.getQueue().setRecorder(NULL);
+    source.process();
+    if (polled != 2 || lateSize != 10 || receiver.getSkippedCount() != 0)
+    {
+      nErrors++;
+      cout << "Bridged late topic mismatch" << endl;
+    }
+
+    // a queue can be bridged and recorded at the same time
+    {
+      const std::string groupLogPath = "/tmp/eslib_test_bridge_" + std::to_string(getpid()) + ".log";
+      ES::EventRecorder groupRecorder(source, groupLogPath);
+      ES::EventRecorderGroup group({&sender, &groupRecorder});
+      source.getQueue().setRecorder(&group);
+      source.publish(bridgedHandle, 7, std::string("bridged"));
+      source.publish(localHandle, 1);
+      source.getQueue().setRecorder(NULL);
+      source.process();
+      int before = received;
+      polled = receiver.poll(target.getQueue());
+      target.process();
+      if (polled != 1 || received != before + 7 || groupRecorder.getRecordedCount() != 2)
+      {
+        nErrors++;
+        cout << "Recorder group mismatch" << endl;
+      }
+      std::remove(groupLogPath.c_str());
+    }
+
+    // topic signatures are checked when connecting
+    ES::EventSystem mismatch;
+    mismatch.registerEvent<std::string>("BridgedEvent");
+    try
+    {
+      ES::EventBridgeReceiver mismatchReceiver(mismatch, bridgeName);
+      nErrors++;
+      cout << "Bridge with mismatching arguments did not throw" << endl;
+    }
+    catch (std::invalid_argument& e)
+    {
+      cout << "Bridge mismatch: " << e.what() << endl;
+    }
+
+    // records with an invalid size are rejected
+    int fd = shm_open(bridgeName.c_str(), O_RDWR, 0);
+    std::size_t segmentSize = ES::detail::eventBridgeSegmentSize(256);
+    void* mapping = fd < 0 ? MAP_FAILED : mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    if (mapping == MAP_FAILED)
+    {
+      nErrors++;
+      cout << "Mapping the event bridge failed" << endl;
+    }
+    else
+    {
+      auto* shared = static_cast<ES::detail::EventBridgeHeader*>(mapping);
+      std::uint64_t writePos = shared->writePos.load();
+      ES::detail::EventBridgeRecord corrupt = {4, 0, 0, 0};
+      std::memcpy(shared->data + (writePos & 255), &corrupt, sizeof(corrupt));
+      shared->writePos.store(writePos + 8);
+      try
+      {
+        receiver.poll(target.getQueue());
+        nErrors++;
+        cout << "Corrupt bridge record was accepted" << endl;
+      }
+      catch (std::invalid_argument& e)
+      {
+        cout << "Bridge corruption: " << e.what() << endl;
+      }
+      // the failed record is still unread, overwrite it with one of an undefined priority
+      ES::detail::EventBridgeRecord badPriority = {8, 0, 200, 0};
+      std::memcpy(shared->data + (writePos & 255), &badPriority, sizeof(badPriority));
+      try
+      {
+        receiver.poll(target.getQueue());
+        nErrors++;
+        cout << "Bridge record with undefined priority was accepted" << endl;
+      }
+      catch (std::invalid_argument& e)
+      {
+        cout << "Bridge corruption: " << e.what() << endl;
+      }
+      // a topic count beyond the table is rejected before reading the topic entries
+      ES::detail::EventBridgeRecord laterTopic = {8, 200, 0, 0};
+      std::memcpy(shared->data + (writePos & 255), &laterTopic, sizeof(laterTopic));
+      shared->topicCount.store(100000);
+      try
+      {
+        receiver.poll(target.getQueue());
+        nErrors++;
+        cout << "Bridge with too many topics was accepted" << endl;
+      }
+      catch (std::invalid_argument& e)
+      {
+        cout << "Bridge corruption: " << e.what() << endl;
+      }
+      munmap(mapping, segmentSize);
+    }
+  }
+
+  {
+    // timer wheel: entries come out at their tick, across all levels
+    ES::detail::TimerWheel wheel;
+    std::vector<ES::detail::TimerWheelEntry> entries(2000);
+    std::uint64_t seed = 12345;
+    for (auto& entry : entries)
+    {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      entry.tick = 1 + (seed >> 33) % (std::uint64_t(1) << 25);
+      wheel.insert(&entry);
+    }
+    wheel.remove(&entries[7]);
+    std::size_t dueCount = 0;
+    bool dueOk = true;
+    std::uint64_t lastTick = 0;
+    for (std::uint64_t tick = 997; lastTick < (std::uint64_t(1) << 25); tick = tick * 2 + 12345)
+    {
+      for (ES::detail::TimerWheelEntry* due = wheel.advance(tick); due != NULL; due = due->next)
+      {
+        dueOk = dueOk && due->tick <= tick && due->tick > lastTick;
+        dueCount++;
+      }
+      lastTick = tick;
+    }
+    cout << "Timer wheel due entries: " << dueCount << ", remaining: " << wheel.size() << endl;
+    if (!dueOk || dueCount != entries.size() - 1 || wheel.size() != 0)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // delayed and periodic events
+    ES::EventSystem es;
+    auto handle = es.registerEvent<int>("TimedEvent");
+    std::vector<int> fired;
+    es.subscribe<int>("TimedEvent", [&fired](int value) {
+      fired.push_back(value);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    es.publishAfter(handle, std::chrono::milliseconds(30), 2);
+    es.publishAt("TimedEvent", start + std::chrono::milliseconds(10), 1);
+    ES::TimerHandle cancelled = es.publishAfter(handle, std::chrono::milliseconds(20), 99);
+    ES::TimerHandle periodic = es.publishEvery(handle, std::chrono::milliseconds(15), 7);
+    if (es.publishAfter("UnknownTimedEvent", std::chrono::milliseconds(1), 1).isValid()
+        || !es.cancelTimer(cancelled) || es.cancelTimer(cancelled))
+    {
+      nErrors++;
+      cout << "Timer handle mismatch" << endl;
+    }
+    es.process();
+    if (!fired.empty())
+    {
+      nErrors++;
+      cout << "Timed event fired early" << endl;
+    }
+
+    // the consumer sleeps until the deadlines
+    es.processFor(std::chrono::milliseconds(100));
+    es.cancelTimer(periodic);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::size_t periodicCount = std::count(fired.begin(), fired.end(), 7);
+    cout << "Timed events fired: " << fired.size() << ", periodic: " << periodicCount << endl;
+    if (fired.size() < 4 || fired[0] != 1 || std::find(fired.begin(), fired.end(), 2) == fired.end()
+        || std::find(fired.begin(), fired.end(), 99) != fired.end() || periodicCount < 3 || periodicCount > 7
+        || elapsed < std::chrono::milliseconds(100) || es.getQueue().getTimerCount() != 0)
+    {
+      nErrors++;
+    }
+    try
+    {
+      es.publishEvery(handle, std::chrono::microseconds(10), 1);
+      nErrors++;
+      cout << "Sub-millisecond period did not throw" << endl;
+    }
+    catch (std::invalid_argument&)
+    {
+    }
+  }
+
+  {
+    // keyed subscribers are only called for matching keys
+    ES::EventSystem es;
+    auto handle = es.registerEvent<int, std::string>("ObjectDetected");
+    std::vector<int> calls(200, 0);
+    std::vector<ES::SubscriptionHandle> keyedHandles;
+    for (int id = 0; id < 200; ++id)
+    {
+      keyedHandles.push_back(es.subscribeKeyed("ObjectDetected", id, [&calls, id](int objectId, const std::string&) {
+        if (objectId == id)
+        {
+          calls[id]++;
+        }
+        else
+        {
+          calls[id] += 1000;
+        }
+      }));
+    }
+    int unkeyedCalls = 0;
+    es.subscribe<int, std::string>("ObjectDetected", [&unkeyedCalls](int, std::string) {
+      unkeyedCalls++;
+    });
+    std::vector<std::string> byLabel;
+    try
+    {
+      es.subscribeKeyed<1>(handle, std::string("car"), [&byLabel](int, const std::string& label) {
+        byLabel.push_back(label);
+      });
+      nErrors++;
+      cout << "Keyed subscription with a different key argument did not throw" << endl;
+    }
+    catch (std::logic_error&)
+    {
+    }
+
+    // subscribers added and removed during dispatch
+    ES::ScopedSubscription addedDuringDispatch;
+    es.subscribeKeyed("ObjectDetected", 5, [&](int, const std::string&) {
+      keyedHandles[6].unsubscribe();
+      if (!addedDuringDispatch.isSubscribed())
+      {
+        addedDuringDispatch = es.subscribeKeyed("ObjectDetected", 5, [&calls](int, const std::string&) {
+          calls[5] += 100;
+        });
+      }
+    });
+
+    es.publish(handle, 5, std::string("car"));
+    es.publish(handle, 6, std::string("bike"));
+    es.publish(handle, 7, std::string("car"));
+    es.publish(handle, 500, std::string("none"));
+    es.process();
+    es.publish(handle, 5, std::string("car"));
+    es.process();
+
+    int total = 0;
+    for (int count : calls)
+    {
+      total += count;
+    }
+    cout << "Keyed calls: " << total << ", unkeyed calls: " << unkeyedCalls << ", subscribers: "
+         << handle->getHandlerCount() << endl;
+    if (calls[5] != 102 || calls[6] != 0 || calls[7] != 1 || total != 103 || unkeyedCalls != 5
+        || handle->getHandlerCount() != 202)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // bulk registration and frozen registry
+    ES::EventSystem es;
+    es.registerEvent<int>("Existing");
+    es.reserve(3000);
+    std::vector<std::string> topicNames;
+    for (int i = 0; i < 3000; ++i)
+    {
+      topicNames.push_back("Topic" + std::to_string(i));
+    }
+    std::vector<ES::EventName> names(topicNames.begin(), topicNames.end());
+    names.push_back("Existing");
+    names.push_back("Topic7");
+    auto handles = es.registerEvents<int>(names);
+    bool bulkOk = handles.size() == 3002 && handles[3000].get() == es.getSubscribers<int>("Existing")
+        && handles[3001].get() == handles[7].get() && es.getRegisteredEvents().size() == 3001;
+    try
+    {
+      es.registerEvents<int>({"NotRegistered", "Existing", "Topic1"});
+      es.registerEvents<double>({"AlsoNotRegistered", "Topic2"});
+      bulkOk = false;
+    }
+    catch (std::invalid_argument&)
+    {
+    }
+    bulkOk = bulkOk && es.getRegisteredEvents().size() == 3002 && es.getSubscribers("AlsoNotRegistered") == NULL;
+
+    es.freeze();
+    bool frozenOk = es.isFrozen() && es.getSubscribers<int>("Topic2999") == handles[2999].get()
+        && es.getOrRegister<int>("Topic0") == handles[0].get() && es.getSubscribers("Missing") == NULL;
+    int frozenCalls = 0;
+    es.subscribe<int>("Topic42", [&frozenCalls](int value) {
+      frozenCalls += value;
+    });
+    es.publish<int>("Topic42", 3);
+    es.process();
+    int rejected = 0;
+    try
+    {
+      es.subscribe<int>("Missing", [](int) {});
+    }
+    catch (std::logic_error&)
+    {
+      rejected++;
+    }
+    try
+    {
+      es.registerEvents<int>({"Topic1", "Missing"});
+    }
+    catch (std::logic_error&)
+    {
+      rejected++;
+    }
+    cout << "Bulk registration: " << (bulkOk ? "ok" : "failed") << ", frozen lookups: "
+         << (frozenOk ? "ok" : "failed") << ", frozen calls: " << frozenCalls << ", rejected: " << rejected << endl;
+    if (!bulkOk || !frozenOk || frozenCalls != 3 || rejected != 2 || es.getRegisteredEvents().size() != 3002)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // runtime event graph export
+    ES::EventSystem es;
+    auto handle = es.registerEvent<int, std::string>("Graph\"Event");
+    es.registerEvent<>("GraphSilent");
+    es.subscribe("Graph\"Event", [](int, const std::string&) {});
+    es.subscribe("Graph\"Event", [](int, const std::string&) {});
+    ES::setInstrumentationEnabled(true);
+    for (int i = 0; i < 4; ++i)
+    {
+      es.publish(handle, i, std::string("x"));
+    }
+    es.process();
+    ES::setInstrumentationEnabled(false);
+
+    std::ostringstream graph;
+    es.exportGraph(graph);
+    const std::string json = graph.str();
+    std::size_t nodes = 0;
+    for (std::size_t pos = json.find("\"kind\": "); pos != std::string::npos; pos = json.find("\"kind\": ", pos + 1))
+    {
+      nodes++;
+    }
+    bool graphOk = json.front() == '[' && json.find("\"id\": \"Graph\\\"Event\"}, \"classes\": \"group\"") != std::string::npos
+        && json.find("\"source\": \"Graph\\\"Event::publisher\", \"target\": \"Graph\\\"Event::subscriber1\"") != std::string::npos
+        && json.find("\"signature\": \"(void)\"") != std::string::npos && nodes == 4
+        && json.find("\"subscriberId\": 1,") != std::string::npos && json.find("sourceLine") == std::string::npos
+        && std::count(json.begin(), json.end(), '{') == std::count(json.begin(), json.end(), '}');
+    if (ES_ENABLE_INSTRUMENTATION)
+    {
+      graphOk = graphOk && json.find("\"subscriberCount\": 2, \"published\": 4") != std::string::npos
+          && json.find("\"calls\": 4") != std::string::npos;
+    }
+    cout << "Graph export: " << json.size() << " bytes, " << nodes << " nodes, " << (graphOk ? "ok" : "failed") << endl;
+    if (!graphOk)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // several queues with event and subscriber affinity
+    ES::EventSystem es;
+    ES::QueueId ui = es.addQueue("ui");
+    ES::QueueId logging = es.addQueue("logging", ES::EventQueueMode::LOCK_FREE);
+    auto handle = es.registerEvent<int>("Clicked");
+    es.registerEvent<int>("Tick");
+    es.setEventQueue(handle, ui);
+
+    std::vector<std::string> calls;
+    es.subscribe("Clicked", [&calls](int value) {
+      calls.push_back("ui " + std::to_string(value));
+    });
+    es.subscribe("Tick", [&calls](int value) {
+      calls.push_back("default " + std::to_string(value));
+    });
+    std::atomic<int> logged(0);
+    auto logSubscription = es.subscribeOn(logging, handle, [&logged](int value) {
+      logged += value;
+    });
+    es.subscribeOn(ui, "Tick", [&calls](int value) {
+      calls.push_back("ui tick " + std::to_string(value));
+    });
+
+    std::thread logThread([&es, &logged, logging] {
+      for (int i = 0; i < 1000 && logged.load() != 10; ++i)
+      {
+        es.waitAndProcess(logging, std::chrono::milliseconds(10));
+      }
+    });
+    es.publish(handle, 4);
+    es.publish<int>("Clicked", 6);
+    es.publish<int>("Tick", 1);
+    es.publishAfter(handle, std::chrono::milliseconds(0), 7);
+    auto cancelled = es.publishAfter(handle, std::chrono::hours(1), 8);
+    bool cancelOk = es.cancelTimer(cancelled) && !es.cancelTimer(cancelled);
+    logThread.join();
+
+    es.process();
+    std::size_t afterDefault = calls.size();
+    es.process(ui);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    es.process(ui);
+    // the due timer reached the pinned subscriber, too
+    es.process(logging);
+    logSubscription.unsubscribe();
+    es.publish(handle, 100);
+    es.processUntilEmpty(ui);
+    es.process(logging);
+
+    bool lookupOk = es.getQueueCount() == 3 && es.getQueueId("logging") == logging
+        && es.getQueueId("default") == ES::QueueId() && es.getEventQueue("Clicked") == ui
+        && es.getEventQueue("Tick") == ES::QueueId() && &es.getQueue(ES::QueueId()) == &es.getQueue();
+    int errors = 0;
+    try
+    {
+      es.addQueue("ui");
+    }
+    catch (std::invalid_argument&)
+    {
+      errors++;
+    }
+    try
+    {
+      es.process(ES::QueueId(7));
+    }
+    catch (std::invalid_argument&)
+    {
+      errors++;
+    }
+    try
+    {
+      es.subscribeOn(logging, "MoveOnlyPinned", [](std::unique_ptr<int>) {});
+    }
+    catch (std::logic_error&)
+    {
+      errors++;
+    }
+
+    std::vector<std::string> expected {"default 1", "ui 4", "ui 6", "ui tick 1", "ui 7", "ui 100"};
+    cout << "Queue affinity: " << calls.size() << " calls, logged " << logged.load() << ", errors " << errors << endl;
+    if (calls != expected || afterDefault != 1 || logged.load() != 17 || !cancelOk || !lookupOk || errors != 3)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // pinned subscribers are reached by all ways of publishing and are counted
+    ES::EventSystem es;
+    ES::QueueId worker = es.addQueue("worker");
+    auto handle = es.registerEvent<int>("PinnedOnly");
+    int pinnedSum = 0;
+    es.subscribeOn(worker, handle, [&pinnedSum](int value) {
+      pinnedSum += value;
+    });
+
+    es.call(handle, 1);
+    bool callOk = pinnedSum == 1;
+    bool publishOk = es.publish(handle, 2) && es.getQueue().isEmpty() && !es.getQueue(worker).isEmpty();
+    es.publishAfter(handle, std::chrono::milliseconds(0), 4);
+    std::vector<int> values {8, 16};
+    std::size_t batched = es.publishBatch(handle, values);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    es.process();
+    publishOk = publishOk && es.getQueue().isEmpty();
+    es.processUntilEmpty(worker);
+
+    std::ostringstream graph;
+    es.exportGraph(graph);
+    bool countOk = handle->getHandlerCount() == 1
+        && graph.str().find("\"PinnedOnly::pinned1::subscriber") != std::string::npos;
+    cout << "Pinned subscribers: sum " << pinnedSum << ", batched " << batched << endl;
+    if (!callOk || !publishOk || !countOk || batched != 2 || pinnedSum != 31)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // pinned subscribers follow the event's conflation and capacity settings
+    ES::EventSystem es;
+    ES::QueueId worker = es.addQueue("worker");
+    auto pose = es.registerEvent<int>("PinnedPose", ES::conflating);
+    std::string poses;
+    es.subscribeOn(worker, pose, [&poses](int value) {
+      poses += std::to_string(value) + " ";
+    });
+    for (int i = 1; i <= 3; ++i)
+    {
+      es.publish(pose, i);
+    }
+    bool conflated = es.getQueue(worker).size() == 1;
+    es.process(worker);
+
+    auto command = es.registerEvent<int>("PinnedCommand");
+    es.setEventCapacity(command, 1, ES::OverflowPolicy::DROP_NEWEST);
+    int commands = 0;
+    es.subscribeOn(worker, command, [&commands](int) {
+      commands++;
+    });
+    bool first = es.publish(command, 1) == ES::PublishStatus::QUEUED;
+    bool dropped = es.publish(command, 2) == ES::PublishStatus::DROPPED;
+    es.process(worker);
+
+    cout << "Pinned limits: poses " << poses << "commands " << commands << endl;
+    if (!conflated || poses != "3 " || !first || !dropped || commands != 1)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // a throwing subscriber doesn't leak the events processed with it
+    ES::EventSystem es;
+    ES::EventQueue queue;
+    auto subscribers = es.registerEvent<std::shared_ptr<int>>("ThrowingSubscriber");
+    subscribers->addSubscriber([](std::shared_ptr<int>) {
+      throw std::runtime_error("subscriber failed");
+    });
+    std::shared_ptr<int> value = std::make_shared<int>(1);
+    int thrown = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+      queue.enqueue(subscribers.get(), value);
+    }
+    try
+    {
+      queue.processForSubscribers(subscribers.get());
+    }
+    catch (std::runtime_error&)
+    {
+      thrown++;
+    }
+    queue.enqueue(subscribers.get(), value);
+    try
+    {
+      queue.processOne();
+    }
+    catch (std::runtime_error&)
+    {
+      thrown++;
+    }
+    cout << "Throwing subscriber: " << thrown << " thrown, " << value.use_count() << " references" << endl;
+    if (thrown != 2 || value.use_count() != 1 || !queue.isEmpty())
+    {
+      nErrors++;
+    }
   }
 
   // Test stuff with arg parsing
@@ -284,6 +1901,66 @@ int main()
   event4->getParametersParser()->callEvent({"True"});
   event4->getParametersParser()->callEvent({"fAlSe"});
 
+  // parse from views and from a single command line
+  {
+    std::int64_t parsedLong = 0;
+    std::uint64_t parsedUnsigned = 0;
+    std::string parsedText;
+    double parsedDouble = 0;
+    auto event5 = es.registerEvent<std::int64_t, std::uint64_t, std::string, double>("event5");
+    event5->addSubscriber([&](std::int64_t a, std::uint64_t b, const std::string& c, double d) {
+      parsedLong = a;
+      parsedUnsigned = b;
+      parsedText = c;
+      parsedDouble = d;
+    });
+    auto parser = event5->getParametersParser();
+    parser->callEventLine("  -9223372036854775808 18446744073709551615 \"two words\" 0.25 ");
+    cout << "Parsed line: " << parsedLong << " " << parsedUnsigned << " " << parsedText << " " << parsedDouble << endl;
+    if (parsedLong != std::numeric_limits<std::int64_t>::min()
+        || parsedUnsigned != std::numeric_limits<std::uint64_t>::max() || parsedText != "two words"
+        || parsedDouble != 0.25)
+    {
+      nErrors++;
+    }
+
+    const char* buffer = "7 8 text 1e3";
+    ES::StringView views[] = {ES::StringView(buffer, 1), ES::StringView(buffer + 2, 1),
+                              ES::StringView(buffer + 4, 4), ES::StringView(buffer + 9, 3)};
+    ES::EventQueue queue;
+    parser->enqueueEvent(&queue, views, 4);
+    queue.process();
+    if (parsedLong != 7 || parsedUnsigned != 8 || parsedText != "text" || parsedDouble != 1000)
+    {
+      nErrors++;
+      cout << "Parsing string views failed" << endl;
+    }
+
+    // malformed and out of range values are rejected
+    const char* badLines[] = {"1 2 x", "1 -2 x 0", "1 18446744073709551616 x 0", "9223372036854775808 1 x 0",
+                              "1x 2 x 0", "1 2 x 0.5.1", "1 2 \"x 0", "1 2 x 0 5"};
+    for (const char* line : badLines)
+    {
+      try {
+        parser->callEventLine(line);
+        nErrors++;
+        cout << "Accepted malformed arguments: " << line << endl;
+      } catch (std::invalid_argument&) {
+      }
+    }
+    try {
+      ES::ParameterValueParser<std::int8_t>::parse("128");
+      nErrors++;
+      cout << "Accepted out of range int8_t" << endl;
+    } catch (std::invalid_argument&) {
+    }
+    if (ES::ParameterValueParser<std::int8_t>::parse("-128") != -128
+        || ES::ParameterValueParser<unsigned short>::parse("65535") != 65535)
+    {
+      nErrors++;
+    }
+  }
+
   es.print(cout);
 
   cout << endl << "Test revealed " << nErrors << " errors" << endl;
@@ -0,0 +1,158 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+// Tests for the C++20 awaitable events. Built only if the compiler supports coroutines.
+
+#include "EventAwait.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <tuple>
+
+using namespace std;
+
+namespace {
+
+int nErrors = 0;
+
+ES::EventTask awaitOne(ES::EventSystem& es, int& result)
+{
+  result = co_await es.next<int>("One");
+}
+
+ES::EventTask awaitSeveral(ES::EventSystem& es, std::string& result)
+{
+  std::tuple<int, std::string> args = co_await es.next<int, std::string>("Two");
+  co_await es.next<>("None");
+  result = std::get<1>(args) + std::to_string(std::get<0>(args));
+}
+
+ES::EventTask sumStream(ES::EventStream<int>& stream, int count, int& sum)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    sum += co_await stream.next();
+  }
+}
+
+ES::EventTask awaitRepeatedly(ES::EventSystem& es, int count, std::atomic<int>& received)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    co_await es.next<int>("Race");
+    received++;
+  }
+}
+
+}  // namespace
+
+int main()
+{
+  {
+    // awaiting single events
+    ES::EventSystem es;
+    int one = 0;
+    std::string several;
+    awaitOne(es, one);
+    awaitSeveral(es, several);
+    es.publish<int>("One", 5);
+    es.publish<int, std::string>("Two", 2, std::string("two"));
+    es.process();
+    // the second await subscribes from within the dispatch, so it only sees the next event
+    es.publish<>("None");
+    es.process();
+    cout << "next: " << one << ", " << several << endl;
+    if (one != 5 || several != "two2" || es.getSubscribers<int>("One")->getHandlerCount() != 0
+        || es.getSubscribers<>("None")->getHandlerCount() != 0)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // event streams buffer events until they are awaited
+    ES::EventSystem es;
+    int sum = 0;
+    {
+      ES::EventStream<int> stream = es.events<int>("Numbers");
+      es.call<int>("Numbers", 1);
+      es.call<int>("Numbers", 2);
+      sumStream(stream, 4, sum);
+      es.call<int>("Numbers", 3);
+      es.call<int>("Numbers", 4);
+      es.call<int>("Numbers", 5);
+      if (stream.size() != 1)
+      {
+        nErrors++;
+      }
+    }
+    cout << "events: " << sum << endl;
+    if (sum != 10 || es.getSubscribers<int>("Numbers")->getHandlerCount() != 0)
+    {
+      nErrors++;
+    }
+  }
+
+  {
+    // another thread dispatches while the coroutine subscribes
+    ES::EventSystem es;
+    es.registerEvent<int>("Race");
+    const int count = 200;
+    std::atomic<int> received(0);
+    std::atomic<bool> done(false);
+    std::thread dispatcher([&es, &done] {
+      while (!done.load())
+      {
+        es.call<int>("Race", 1);
+      }
+    });
+    awaitRepeatedly(es, count, received);
+    for (int i = 0; i < 5000 && received.load() != count; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    done = true;
+    dispatcher.join();
+    cout << "concurrent next: " << received.load() << endl;
+    if (received.load() != count || es.getSubscribers<int>("Race")->getHandlerCount() != 0)
+    {
+      nErrors++;
+    }
+  }
+
+  cout << endl << "Test revealed " << nErrors << " errors" << endl;
+
+  return nErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,323 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTAWAIT_H
+#define EVENTAWAIT_H
+
+/*
+ * Awaitable events for C++20 coroutines. This header is opt-in, the rest of the library only needs C++11.
+ */
+#if !defined(__cpp_impl_coroutine) || __cplusplus < 202002L
+#error "EventAwait.h requires C++20 coroutine support"
+#endif
+
+#include "EventSystem.h"
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ES {
+
+namespace detail
+{
+
+// result of awaiting an event: nothing, the single argument, or a tuple of all arguments
+template<typename... Args>
+struct AwaitResult
+{
+  typedef std::tuple<Args...> type;
+  static type get(std::tuple<Args...>&& args)
+  {
+    return std::move(args);
+  }
+};
+template<typename Arg>
+struct AwaitResult<Arg>
+{
+  typedef Arg type;
+  static type get(std::tuple<Arg>&& args)
+  {
+    return std::move(std::get<0>(args));
+  }
+};
+template<>
+struct AwaitResult<>
+{
+  typedef void type;
+  static void get(std::tuple<>&&)
+  {
+  }
+};
+
+}  // namespace detail
+
+/**
+ * @brief Awaitable for the next occurrence of an event, see EventSystem::next().
+ *
+ * Awaiting subscribes to the event. When the event is dispatched, the subscription is removed and the
+ * awaiting coroutine is resumed from within the subscriber call, i.e. on the thread running
+ * EventQueue::process() or EventSystem::call(). If another thread dispatches the event while the coroutine is
+ * still subscribing, the coroutine doesn't suspend and continues on it's own thread. The result is the event argument for events with one
+ * argument, a std::tuple of the arguments for events with more, and void for events without arguments.
+ *
+ * The awaitable lives in the coroutine frame, and the subscriber is a bound member function. So
+ * awaiting does not allocate a function object. When the coroutine is destroyed while waiting, the
+ * subscription is removed.
+ *
+ * @tparam Args event argument types
+ */
+template<typename... Args>
+class NextEvent
+{
+private:
+  // handshake between await_suspend() and deliver(), which may run concurrently on different threads
+  enum class State
+  {
+    SUBSCRIBING,
+    WAITING,
+    DELIVERED
+  };
+
+  SubscriberCollection<Args...>* subscribers;
+  ScopedSubscription subscription;
+  std::coroutine_handle<> waiting;
+  std::optional<std::tuple<Args...>> result;
+  std::atomic<State> state;
+
+  void deliver(Args... args)
+  {
+    if (result)
+    {
+      // already delivered during this dispatch
+      return;
+    }
+    result.emplace(std::move(args)...);
+    if (state.exchange(State::DELIVERED, std::memory_order_acq_rel) == State::SUBSCRIBING)
+    {
+      // await_suspend() has not stored the subscription yet. It unsubscribes and resumes the coroutine.
+      return;
+    }
+    subscription.unsubscribe();
+    // the coroutine may finish and destroy this awaitable, so don't touch any member after resuming
+    std::coroutine_handle<> handle = waiting;
+    handle.resume();
+  }
+
+public:
+  /**
+   * @brief Create an awaitable for the given subscriber collection.
+   */
+  explicit NextEvent(SubscriberCollection<Args...>* subscribers) :
+      subscribers(subscribers), state(State::SUBSCRIBING)
+  {
+  }
+
+  // the subscriber refers to this object
+  NextEvent(const NextEvent&) = delete;
+  NextEvent& operator=(const NextEvent&) = delete;
+
+  bool await_ready() const noexcept
+  {
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> handle)
+  {
+    waiting = handle;
+    subscription = subscribers->addSubscriber(&NextEvent::deliver, this);
+    // the event may have been dispatched by another thread while subscribing
+    if (state.exchange(State::WAITING, std::memory_order_acq_rel) == State::DELIVERED)
+    {
+      subscription.unsubscribe();
+      // don't suspend, the result is available
+      return false;
+    }
+    // deliver() may already run and resume the coroutine, so don't touch any member from here on
+    return true;
+  }
+
+  typename detail::AwaitResult<Args...>::type await_resume()
+  {
+    return detail::AwaitResult<Args...>::get(std::move(*result));
+  }
+};
+
+/**
+ * @brief A stream of the occurrences of an event, see EventSystem::events().
+ *
+ * The stream subscribes to the event on construction, and buffers all events until they are awaited
+ * with next(). Awaiting an event that was already buffered completes immediately. Otherwise, the
+ * coroutine is resumed from within the subscriber call, like NextEvent.
+ *
+ * A stream can only be awaited by one coroutine at a time. The buffer is not synchronized, so the
+ * events must be dispatched on the thread the stream is used on. Destroying the stream removes the
+ * subscription.
+ *
+ * @tparam Args event argument types
+ */
+template<typename... Args>
+class EventStream
+{
+private:
+  ScopedSubscription subscription;
+  std::deque<std::tuple<Args...>> buffer;
+  std::coroutine_handle<> waiting;
+
+  void deliver(Args... args)
+  {
+    buffer.emplace_back(std::move(args)...);
+    if (waiting)
+    {
+      std::coroutine_handle<> handle = waiting;
+      waiting = nullptr;
+      handle.resume();
+    }
+  }
+
+public:
+  /**
+   * @brief Awaitable for the next event of a stream.
+   */
+  class Awaiter
+  {
+  private:
+    EventStream* stream;
+
+  public:
+    explicit Awaiter(EventStream* stream) :
+        stream(stream)
+    {
+    }
+
+    bool await_ready() const noexcept
+    {
+      return !stream->buffer.empty();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+      stream->waiting = handle;
+    }
+
+    typename detail::AwaitResult<Args...>::type await_resume()
+    {
+      std::tuple<Args...> args = std::move(stream->buffer.front());
+      stream->buffer.pop_front();
+      return detail::AwaitResult<Args...>::get(std::move(args));
+    }
+  };
+
+  /**
+   * @brief Subscribe to the given subscriber collection.
+   */
+  explicit EventStream(SubscriberCollection<Args...>* subscribers)
+  {
+    subscription = subscribers->addSubscriber(&EventStream::deliver, this);
+  }
+
+  // the subscriber refers to this object
+  EventStream(const EventStream&) = delete;
+  EventStream& operator=(const EventStream&) = delete;
+
+  /**
+   * @brief Await the next event.
+   */
+  Awaiter next()
+  {
+    return Awaiter(this);
+  }
+
+  /**
+   * @brief Get the number of buffered events.
+   */
+  std::size_t size() const
+  {
+    return buffer.size();
+  }
+};
+
+/**
+ * @brief A minimal coroutine type for event driven tasks.
+ *
+ * The task starts running immediately, and it's frame is destroyed when it finishes. It cannot be
+ * awaited, use it for top level tasks that wait for events. An exception thrown by the task is
+ * propagated to the caller resuming it, i.e. usually out of EventQueue::process(). The frame of such a
+ * task is not destroyed.
+ */
+struct EventTask
+{
+  struct promise_type
+  {
+    EventTask get_return_object() noexcept
+    {
+      return EventTask();
+    }
+    std::suspend_never initial_suspend() noexcept
+    {
+      return {};
+    }
+    std::suspend_never final_suspend() noexcept
+    {
+      return {};
+    }
+    void return_void() noexcept
+    {
+    }
+    void unhandled_exception()
+    {
+      throw;
+    }
+  };
+};
+
+// now, we can define the EventSystem methods declared for this header
+template<typename... Args>
+NextEvent<typename std::decay<Args>::type...> EventSystem::next(const EventName& name)
+{
+  return NextEvent<typename std::decay<Args>::type...>(getOrRegister<Args...>(name).get());
+}
+
+template<typename... Args>
+EventStream<typename std::decay<Args>::type...> EventSystem::events(const EventName& name)
+{
+  return EventStream<typename std::decay<Args>::type...>(getOrRegister<Args...>(name).get());
+}
+
+}  // namespace ES
+
+#endif /* EVENTAWAIT_H */
@@ -0,0 +1,576 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTBRIDGE_H
+#define EVENTBRIDGE_H
+
+// The bridge uses POSIX shared memory.
+#if !defined(_WIN32)
+
+#include "EventRegistry.h"
+#include "EventQueue.h"
+#include "EventRecorder.h"
+#include "EventSerialization.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ES {
+
+namespace detail
+{
+
+// the ring indices are shared between processes, so they must not use a lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+    "The event bridge requires lock-free 32 and 64 bit atomics");
+
+static const char eventBridgeMagic[8] = {'E', 'S', 'B', 'R', 'I', 'D', 'G', '1'};
+
+// maximum number of bridged topics, and the space for their names and argument descriptions
+constexpr std::size_t eventBridgeMaxTopics = 256;
+constexpr std::size_t eventBridgeMaxName = 128;
+constexpr std::size_t eventBridgeMaxDescription = 384;
+
+// topic id of the padding record at the end of the ring
+constexpr std::uint16_t eventBridgePadding = 0xFFFF;
+
+struct EventBridgeTopic
+{
+  char name[eventBridgeMaxName];
+  char description[eventBridgeMaxDescription];
+};
+
+/*
+ * Layout of the shared memory segment. The ring data follows the header.
+ *
+ * The sender appends records at writePos, the receiver consumes them at readPos. Both are
+ * ever-increasing byte offsets. Each record starts with an EventBridgeRecord header and is
+ * padded to 8 bytes. A record never wraps around the end of the ring, the rest of the ring is
+ * filled with a padding record instead.
+ */
+struct EventBridgeHeader
+{
+  char magic[8];
+  // set with release once the header is initialized
+  std::atomic<std::uint32_t> ready;
+  std::uint64_t capacity;
+  // published with release after the topic entry is written
+  std::atomic<std::uint32_t> topicCount;
+  EventBridgeTopic topics[eventBridgeMaxTopics];
+
+  alignas(64) std::atomic<std::uint64_t> writePos;
+  std::atomic<std::uint64_t> droppedCount;
+  alignas(64) std::atomic<std::uint64_t> readPos;
+  alignas(64) char data[1];
+};
+
+struct EventBridgeRecord
+{
+  // total size incl. this header and padding
+  std::uint32_t size;
+  std::uint16_t topic;
+  std::uint8_t priority;
+  std::uint8_t reserved;
+};
+
+// size of the shared segment for the given ring capacity
+inline std::size_t eventBridgeSegmentSize(std::uint64_t capacity)
+{
+  return offsetof(EventBridgeHeader, data) + capacity;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Sending side of a shared-memory bridge, which mirrors selected topics into another process.
+ *
+ * The sender creates a named POSIX shared memory segment containing a ring buffer. Attach it to the
+ * local EventQueue with EventQueue::setRecorder(), and select the topics with addTopic(). Every local
+ * publish on a bridged topic then also serializes the event arguments with their BinarySerializer,
+ * and copies the result once into the ring. Local subscribers still receive the event as usual.
+ *
+ * The receiving process reads the ring with an EventBridgeReceiver. There must be at most one receiver.
+ * If the receiver falls behind and the ring is full, events are dropped and counted.
+ *
+ * Publishing does not use system calls. Events of topics that are not bridged only cost a lookup in
+ * an immutable table, and the arguments are serialized by the publishing thread. Only writing to the
+ * ring is serialized by a mutex.
+ *
+ * A queue has a single recorder. To bridge and record the events of one queue, e.g. with an
+ * EventRecorder, attach both using an EventRecorderGroup.
+ * The data uses the native byte order and type sizes, so both processes must use the same architecture
+ * and compiler. Only available on POSIX systems.
+ */
+class EventBridgeSender : public EventRecorderBase
+{
+private:
+  const EventRegistry& registry;
+  std::string name;
+  detail::EventBridgeHeader* header;
+  std::size_t segmentSize;
+  std::uint64_t mask;
+
+  // topic ids of bridged subscriber collections
+  typedef std::unordered_map<const SubscriberCollectionBase*, std::uint16_t> TopicTable;
+  // current topic ids, replaced by addTopic(). Read without lock by the publishers.
+  std::atomic<const TopicTable*> topicIds;
+  // all versions of the topic ids. Replaced versions are kept, since concurrent publishers may
+  // still read them. There are at most eventBridgeMaxTopics of them.
+  std::vector<std::unique_ptr<TopicTable>> topicIdVersions;
+
+  // guards all of the above but topicIds, and writing to the ring
+  std::mutex senderMutex;
+
+  // not copyable
+  EventBridgeSender(const EventBridgeSender&);
+  EventBridgeSender& operator=(const EventBridgeSender&);
+
+  // append a record, or drop it if the ring is full. Called with the mutex held.
+  bool writeRecord(std::uint16_t topic, EventPriority priority, const std::vector<char>& payload)
+  {
+    std::uint64_t capacity = mask + 1;
+    std::uint64_t size = (sizeof(detail::EventBridgeRecord) + payload.size() + 7) & ~std::uint64_t(7);
+    std::uint64_t writePos = header->writePos.load(std::memory_order_relaxed);
+    std::uint64_t readPos = header->readPos.load(std::memory_order_acquire);
+    std::uint64_t offset = writePos & mask;
+    // records do not wrap around, pad the end of the ring if needed
+    std::uint64_t padding = offset + size > capacity ? capacity - offset : 0;
+    if (size > capacity || writePos + padding + size - readPos > capacity)
+    {
+      header->droppedCount.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (padding != 0)
+    {
+      detail::EventBridgeRecord pad = {static_cast<std::uint32_t>(padding), detail::eventBridgePadding, 0, 0};
+      std::memcpy(header->data + offset, &pad, sizeof(pad));
+      writePos += padding;
+      offset = 0;
+    }
+    detail::EventBridgeRecord record = {static_cast<std::uint32_t>(size), topic,
+        static_cast<std::uint8_t>(priority), 0};
+    std::memcpy(header->data + offset, &record, sizeof(record));
+    std::memcpy(header->data + offset + sizeof(record), payload.data(), payload.size());
+    // publish to the receiver
+    header->writePos.store(writePos + size, std::memory_order_release);
+    return true;
+  }
+
+public:
+  /**
+   * @brief Create the shared memory segment, replacing an existing one with the same name.
+   *
+   * @param registry local registry, used to look up the bridged topics. Must outlive the sender.
+   * @param name shared memory name, starting with '/', see shm_open()
+   * @param capacity ring buffer size in bytes, rounded up to a power of two
+   *
+   * @throws std::runtime_error if the segment cannot be created.
+   */
+  EventBridgeSender(const EventRegistry& registry, const std::string& name, std::size_t capacity = 1 << 20) :
+      registry(registry), name(name), header(NULL), segmentSize(0), mask(0), topicIds(NULL)
+  {
+    topicIdVersions.emplace_back(new TopicTable());
+    topicIds.store(topicIdVersions.back().get(), std::memory_order_relaxed);
+
+    std::uint64_t ringSize = 64;
+    while (ringSize < capacity)
+    {
+      ringSize *= 2;
+    }
+    segmentSize = detail::eventBridgeSegmentSize(ringSize);
+
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+      detail::throwSystemError("Cannot create shared memory", name);
+    }
+    if (ftruncate(fd, static_cast<off_t>(segmentSize)) != 0)
+    {
+      ::close(fd);
+      shm_unlink(name.c_str());
+      detail::throwSystemError("Cannot resize shared memory", name);
+    }
+    void* addr = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+      shm_unlink(name.c_str());
+      detail::throwSystemError("Cannot map shared memory", name);
+    }
+
+    // the fresh segment is zero-filled, construct the header in place
+    header = new (addr) detail::EventBridgeHeader;
+    header->ready.store(0, std::memory_order_relaxed);
+    header->capacity = ringSize;
+    header->topicCount.store(0, std::memory_order_relaxed);
+    header->writePos.store(0, std::memory_order_relaxed);
+    header->droppedCount.store(0, std::memory_order_relaxed);
+    header->readPos.store(0, std::memory_order_relaxed);
+    std::memcpy(header->magic, detail::eventBridgeMagic, sizeof(header->magic));
+    mask = ringSize - 1;
+    header->ready.store(1, std::memory_order_release);
+  }
+
+  /**
+   * @brief Unmap and remove the shared memory segment. Must be detached from all queues before.
+   *
+   * A connected receiver keeps it's mapping, but receives no more events.
+   */
+  virtual ~EventBridgeSender()
+  {
+    munmap(header, segmentSize);
+    shm_unlink(name.c_str());
+  }
+
+  /**
+   * @brief Mirror the given registered event to the receiver.
+   *
+   * The receiver checks the name and argument types when it connects, or when it first sees the topic.
+   * Adding a topic twice has no effect.
+   *
+   * @param topic name of a registered event
+   *
+   * @throws std::invalid_argument if the event is not registered, it's arguments cannot be serialized,
+   *   or the maximum number of topics or length of the name or argument description is exceeded.
+   */
+  void addTopic(const EventName& topic)
+  {
+    const SubscriberCollectionBase* subscribers;
+    {
+      std::lock_guard<std::mutex> lock(registry.getRegistryMutex());
+      auto found = registry.getRegisteredEvents().find(topic.str());
+      if (found == registry.getRegisteredEvents().end())
+      {
+        throw std::invalid_argument("Cannot bridge unregistered event " + topic.str());
+      }
+      subscribers = found->second;
+    }
+    if (!subscribers->getSerializer()->canSerialize())
+    {
+      throw std::invalid_argument("Cannot bridge event " + topic.str() + ", it's arguments cannot be serialized");
+    }
+    std::ostringstream description;
+    subscribers->appendEventArgsDescription(description);
+
+    std::lock_guard<std::mutex> lock(senderMutex);
+    const TopicTable* current = topicIds.load(std::memory_order_relaxed);
+    if (current->find(subscribers) != current->end())
+    {
+      return;
+    }
+    std::uint32_t id = header->topicCount.load(std::memory_order_relaxed);
+    if (id >= detail::eventBridgeMaxTopics)
+    {
+      throw std::invalid_argument("Cannot bridge event " + topic.str() + ", too many topics");
+    }
+    if (topic.getLength() >= detail::eventBridgeMaxName
+        || description.str().size() >= detail::eventBridgeMaxDescription)
+    {
+      throw std::invalid_argument("Cannot bridge event " + topic.str() + ", name or arguments too long");
+    }
+    detail::EventBridgeTopic& entry = header->topics[id];
+    std::memcpy(entry.name, topic.getData(), topic.getLength());
+    entry.name[topic.getLength()] = '\0';
+    std::memcpy(entry.description, description.str().c_str(), description.str().size() + 1);
+    header->topicCount.store(id + 1, std::memory_order_release);
+    // publish a copy with the new topic
+    std::unique_ptr<TopicTable> table(new TopicTable(*current));
+    (*table)[subscribers] = static_cast<std::uint16_t>(id);
+    topicIdVersions.push_back(std::move(table));
+    topicIds.store(topicIdVersions.back().get(), std::memory_order_release);
+  }
+
+  /**
+   * @brief Write a locally published event into the ring, if it's topic is bridged.
+   *
+   * Called by the EventQueue, see EventQueue::setRecorder().
+   */
+  virtual void recordEvent(const SubscriberCollectionBase* subscribers, const void* args, EventPriority priority)
+  {
+    // events of other topics don't take the mutex
+    const TopicTable* table = topicIds.load(std::memory_order_acquire);
+    auto found = table->find(subscribers);
+    if (found == table->end())
+    {
+      return;
+    }
+    // serialize into a per-thread buffer outside of the lock, so the ring is written only once
+    static thread_local std::vector<char> payload;
+    payload.clear();
+    BinaryWriter out(payload);
+    subscribers->getSerializer()->writeArgs(out, args);
+    std::lock_guard<std::mutex> lock(senderMutex);
+    writeRecord(found->second, priority, payload);
+  }
+
+  /**
+   * @brief Get the number of events dropped because the ring was full.
+   */
+  unsigned long long getDroppedCount() const
+  {
+    return header->droppedCount.load(std::memory_order_relaxed);
+  }
+};
+
+/**
+ * @brief Receiving side of a shared-memory bridge, see EventBridgeSender.
+ *
+ * Connects to the segment created by the sender and checks every bridged topic against the local
+ * registry. Call poll() regularly to move the received events into a local EventQueue. This only
+ * reads the shared memory, it does not use system calls.
+ */
+class EventBridgeReceiver
+{
+private:
+  EventRegistry& registry;
+  std::string name;
+  const detail::EventBridgeHeader* header;
+  detail::EventBridgeHeader* writableHeader;
+  std::size_t segmentSize;
+  std::uint64_t mask;
+
+  // local subscribers of each topic id, NULL if not registered locally
+  std::vector<SubscriberCollectionBase*> topics;
+  unsigned long long skippedCount;
+
+  // not copyable
+  EventBridgeReceiver(const EventBridgeReceiver&);
+  EventBridgeReceiver& operator=(const EventBridgeReceiver&);
+
+  // resolve topics added by the sender since the last call
+  void resolveTopics()
+  {
+    std::uint32_t count = header->topicCount.load(std::memory_order_acquire);
+    if (count > detail::eventBridgeMaxTopics)
+    {
+      throw std::invalid_argument("Corrupt event bridge '" + name + "': too many topics");
+    }
+    while (topics.size() < count)
+    {
+      const detail::EventBridgeTopic& entry = header->topics[topics.size()];
+      // the strings are written by another process, don't rely on their terminators
+      std::string topicName(entry.name, strnlen(entry.name, detail::eventBridgeMaxName));
+      std::string description(entry.description, strnlen(entry.description, detail::eventBridgeMaxDescription));
+      SubscriberCollectionBase* subscribers = registry.getSubscribers(EventName(topicName));
+      if (subscribers != NULL)
+      {
+        std::ostringstream actual;
+        subscribers->appendEventArgsDescription(actual);
+        if (actual.str() != description)
+        {
+          throw std::invalid_argument("Bridged event '" + topicName + "' has arguments "
+              + description + ", but the registered event has " + actual.str());
+        }
+      }
+      topics.push_back(subscribers);
+    }
+  }
+
+public:
+  /**
+   * @brief Connect to the shared memory segment of an EventBridgeSender.
+   *
+   * @param registry local registry. Received topics are looked up by name, and topics that are not
+   *   registered locally are skipped.
+   * @param name shared memory name passed to the sender
+   *
+   * @throws std::runtime_error if the segment cannot be opened.
+   * @throws std::invalid_argument if the segment is not an event bridge, or a bridged topic is
+   *   registered locally with different argument types.
+   */
+  EventBridgeReceiver(EventRegistry& registry, const std::string& name) :
+      registry(registry), name(name), header(NULL), writableHeader(NULL), segmentSize(0), mask(0),
+      skippedCount(0)
+  {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+      detail::throwSystemError("Cannot open shared memory", name);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      detail::throwSystemError("Cannot open shared memory", name);
+    }
+    segmentSize = static_cast<std::size_t>(info.st_size);
+    if (segmentSize < detail::eventBridgeSegmentSize(0))
+    {
+      ::close(fd);
+      throw std::invalid_argument("Not an event bridge: '" + name + "'");
+    }
+    void* addr = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+      detail::throwSystemError("Cannot map shared memory", name);
+    }
+    writableHeader = static_cast<detail::EventBridgeHeader*>(addr);
+    header = writableHeader;
+    if (header->ready.load(std::memory_order_acquire) != 1
+        || std::memcmp(header->magic, detail::eventBridgeMagic, sizeof(header->magic)) != 0
+        || detail::eventBridgeSegmentSize(header->capacity) != segmentSize)
+    {
+      munmap(addr, segmentSize);
+      throw std::invalid_argument("Not an event bridge: '" + name + "'");
+    }
+    mask = header->capacity - 1;
+    try
+    {
+      resolveTopics();
+    }
+    catch (...)
+    {
+      munmap(addr, segmentSize);
+      throw;
+    }
+  }
+
+  /**
+   * @brief Unmap the shared memory segment.
+   */
+  ~EventBridgeReceiver()
+  {
+    munmap(writableHeader, segmentSize);
+  }
+
+  /**
+   * @brief Enqueue all events received since the last call to the given queue.
+   *
+   * The events keep the priority they were published with. The arguments are deserialized
+   * directly from the shared memory.
+   *
+   * @param queue local event queue
+   * @return number of enqueued events
+   *
+   * @throws std::invalid_argument if a new topic is registered locally with different argument types,
+   *         or if the ring contains a record with an undefined topic or priority, or an invalid size.
+   */
+  std::size_t poll(EventQueue& queue)
+  {
+    std::uint64_t readPos = header->readPos.load(std::memory_order_relaxed);
+    std::uint64_t writePos = header->writePos.load(std::memory_order_acquire);
+    std::size_t received = 0;
+    try
+    {
+      while (readPos != writePos)
+      {
+        std::uint64_t offset = readPos & mask;
+        const char* data = header->data + offset;
+        detail::EventBridgeRecord record;
+        std::memcpy(&record, data, sizeof(record));
+        // the sender writes aligned records that neither wrap nor pass the write position
+        if (record.size < sizeof(record) || record.size % 8 != 0 || offset + record.size > mask + 1
+            || record.size > writePos - readPos)
+        {
+          throw std::invalid_argument("Corrupt event bridge '" + name + "': invalid record size");
+        }
+        std::uint64_t next = readPos + record.size;
+        if (record.topic != detail::eventBridgePadding)
+        {
+          if (record.priority >= eventPriorityCount)
+          {
+            throw std::invalid_argument("Corrupt event bridge '" + name + "': undefined priority");
+          }
+          if (record.topic >= topics.size())
+          {
+            resolveTopics();
+            if (record.topic >= topics.size())
+            {
+              throw std::invalid_argument("Corrupt event bridge '" + name + "': undefined topic");
+            }
+          }
+          SubscriberCollectionBase* subscribers = topics[record.topic];
+          if (subscribers == NULL)
+          {
+            skippedCount++;
+          }
+          else
+          {
+            BinaryReader in(data + sizeof(record), record.size - sizeof(record));
+            // skip the record even if enqueueing fails
+            readPos = next;
+            subscribers->getSerializer()->enqueueEvent(&queue, in, static_cast<EventPriority>(record.priority));
+            received++;
+          }
+        }
+        readPos = next;
+      }
+    }
+    catch (...)
+    {
+      writableHeader->readPos.store(readPos, std::memory_order_release);
+      throw;
+    }
+    // release the space to the sender
+    writableHeader->readPos.store(readPos, std::memory_order_release);
+    return received;
+  }
+
+  /**
+   * @brief Get the number of received events whose topic is not registered locally.
+   */
+  unsigned long long getSkippedCount() const
+  {
+    return skippedCount;
+  }
+
+  /**
+   * @brief Get the number of events the sender dropped because the ring was full.
+   */
+  unsigned long long getDroppedCount() const
+  {
+    return header->droppedCount.load(std::memory_order_relaxed);
+  }
+};
+
+}  // namespace ES
+
+#endif /* !_WIN32 */
+
+#endif /* EVENTBRIDGE_H */
@@ -0,0 +1,435 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+/**
+ * @file EventDelegate.h
+ * @brief A small-buffer, non-allocating replacement for std::function, used to store subscribers.
+ */
+
+#ifndef EVENTDELEGATE_H
+#define EVENTDELEGATE_H
+
+#include "EventSystemUtils.h"
+
+#include <cstddef>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ES {
+
+namespace detail {
+
+// checks if a function object of type F can be called with arguments of type A...
+template<typename F, typename... A>
+struct is_callable
+{
+private:
+  template<typename G>
+  static auto test(int) -> decltype((void) std::declval<G>()(std::declval<A>()...), std::true_type());
+  template<typename G>
+  static std::false_type test(...);
+public:
+  typedef decltype(test<F>(0)) type;
+  static constexpr bool value = type::value;
+};
+
+// a member function bound to it's owner object. Replaces std::bind for subscribers.
+template<typename T, typename MemFn>
+struct bound_member
+{
+  T* obj;
+  MemFn fp;
+
+  bound_member(T* obj, MemFn fp) :
+      obj(obj), fp(fp)
+  {
+  }
+
+  template<typename... A>
+  auto operator()(A&&... args) const
+    -> decltype((std::declval<T*>()->*std::declval<MemFn>())(std::forward<A>(args)...))
+  {
+    return (obj->*fp)(std::forward<A>(args)...);
+  }
+};
+
+// this helper function binds a member function to it's owner object
+template<typename T, typename Return, typename... Args>
+inline bound_member<T, Return (T::*)(Args...)> bind_member(Return (T::*fp)(Args...), type_identity_t<T>* obj)
+{
+  return bound_member<T, Return (T::*)(Args...)>(obj, fp);
+}
+template<typename T, typename Return, typename... Args>
+inline bound_member<const T, Return (T::*)(Args...) const> bind_member(Return (T::*fp)(Args...) const,
+    const type_identity_t<T>* obj)
+{
+  return bound_member<const T, Return (T::*)(Args...) const>(obj, fp);
+}
+
+}  // namespace detail
+
+/**
+ * @brief Type-erased function wrapper for event subscribers.
+ *
+ * Unlike std::function, small function objects are always stored inline. The inline buffer is
+ * large enough for function pointers, bound member functions (see detail::bind_member()) and
+ * lambdas with a few captures. Larger or throwing-move function objects are stored on the heap.
+ * Calling a delegate is a single indirect call to a function that invokes the target directly.
+ *
+ * A delegate can be invoked in two ways:
+ * - invoke() passes the arguments as const lvalues. If the target accepts them, no copy is made.
+ *   Otherwise, for example if the target takes an rvalue reference, the arguments are copied.
+ * - invokeMove() passes the arguments as rvalues, so the target may consume them.
+ *
+ * For move-only argument types, only invokeMove() may be used.
+ *
+ * @tparam Signature function signature, must be of the form void(Args...).
+ */
+template<typename Signature>
+class Delegate;
+
+/**
+ * @brief Delegate implementation for void(Args...). See Delegate.
+ */
+template<typename... Args>
+class Delegate<void(Args...)>
+{
+public:
+  /// @brief Size of the inline buffer in bytes.
+  static constexpr std::size_t inlineSize = 4 * sizeof(void*);
+
+private:
+  typedef typename std::aligned_storage<inlineSize, alignof(std::max_align_t)>::type Storage;
+
+  // true if F is stored in the inline buffer
+  template<typename F>
+  struct fits_inline : std::integral_constant<bool,
+      sizeof(F) <= sizeof(Storage) && alignof(F) <= alignof(Storage) && std::is_nothrow_move_constructible<F>::value>
+  {
+  };
+  // true if F is stored in the inline buffer and can be copied by copying the buffer
+  template<typename F>
+  struct is_trivial_inline : std::integral_constant<bool,
+      fits_inline<F>::value && std::is_trivially_copyable<F>::value && std::is_trivially_destructible<F>::value>
+  {
+  };
+
+  enum class Operation { COPY, MOVE, DESTROY };
+
+  typedef void (*LvalueInvoker)(Storage*, const Args&...);
+  typedef void (*RvalueInvoker)(Storage*, Args&&...);
+  typedef void (*Manager)(Operation, Storage*, Storage*);
+
+  // target storage. Contains the target itself, or a pointer to a heap-allocated target.
+  Storage storage;
+  // invokers, NULL for an empty delegate
+  LvalueInvoker lvalueInvoker;
+  RvalueInvoker rvalueInvoker;
+  // copies, moves and destroys the target. NULL if the storage can be copied bytewise.
+  Manager manager;
+
+  // access the target
+  template<typename F>
+  static F* getTarget(Storage* storage, std::true_type /*inline*/)
+  {
+    return reinterpret_cast<F*>(storage);
+  }
+  template<typename F>
+  static F* getTarget(Storage* storage, std::false_type /*inline*/)
+  {
+    return *reinterpret_cast<F**>(storage);
+  }
+  template<typename F>
+  static F& target(Storage* storage)
+  {
+    return *getTarget<F>(storage, fits_inline<F>());
+  }
+
+  // invokers
+  template<typename F>
+  static void invokeRvalue(Storage* storage, Args&&... args)
+  {
+    target<F>(storage)(std::forward<Args>(args)...);
+  }
+  template<typename F>
+  static void invokeLvalue(Storage* storage, const Args&... args)
+  {
+    target<F>(storage)(args...);
+  }
+  template<typename F>
+  static void invokeLvalueCopy(Storage* storage, const Args&... args)
+  {
+    target<F>(storage)(Args(args)...);
+  }
+
+  // select the lvalue invoker. If the target does not accept const lvalues, we have to copy.
+  template<typename F, typename Copyable>
+  static LvalueInvoker selectLvalueInvoker(std::true_type /*callable*/, Copyable)
+  {
+    return &invokeLvalue<F>;
+  }
+  template<typename F>
+  static LvalueInvoker selectLvalueInvoker(std::false_type /*callable*/, std::true_type /*copyable*/)
+  {
+    return &invokeLvalueCopy<F>;
+  }
+  template<typename F>
+  static LvalueInvoker selectLvalueInvoker(std::false_type /*callable*/, std::false_type /*copyable*/)
+  {
+    // move-only arguments, can only be invoked with rvalues
+    return NULL;
+  }
+
+  // managers
+  template<typename F>
+  static void manageTarget(Operation op, Storage* dst, Storage* src, std::true_type /*inline*/)
+  {
+    switch (op)
+    {
+      case Operation::COPY:
+        new (dst) F(*reinterpret_cast<const F*>(src));
+        break;
+      case Operation::MOVE:
+        new (dst) F(std::move(*reinterpret_cast<F*>(src)));
+        reinterpret_cast<F*>(src)->~F();
+        break;
+      case Operation::DESTROY:
+        reinterpret_cast<F*>(dst)->~F();
+        break;
+    }
+  }
+  template<typename F>
+  static void manageTarget(Operation op, Storage* dst, Storage* src, std::false_type /*inline*/)
+  {
+    switch (op)
+    {
+      case Operation::COPY:
+        *reinterpret_cast<F**>(dst) = new F(**reinterpret_cast<F**>(src));
+        break;
+      case Operation::MOVE:
+        *reinterpret_cast<F**>(dst) = *reinterpret_cast<F**>(src);
+        break;
+      case Operation::DESTROY:
+        delete *reinterpret_cast<F**>(dst);
+        break;
+    }
+  }
+  template<typename F>
+  static void manage(Operation op, Storage* dst, Storage* src)
+  {
+    manageTarget<F>(op, dst, src, fits_inline<F>());
+  }
+
+  // store the target
+  template<typename F>
+  void store(F&& function, std::true_type /*inline*/)
+  {
+    new (&storage) typename std::decay<F>::type(std::forward<F>(function));
+  }
+  template<typename F>
+  void store(F&& function, std::false_type /*inline*/)
+  {
+    *reinterpret_cast<typename std::decay<F>::type**>(&storage) = new typename std::decay<F>::type(std::forward<F>(function));
+  }
+
+  // take the contents of other, leaving it empty. this must be empty.
+  void moveFrom(Delegate& other) noexcept
+  {
+    if (other.manager != NULL)
+    {
+      other.manager(Operation::MOVE, &storage, &other.storage);
+    }
+    else
+    {
+      storage = other.storage;
+    }
+    lvalueInvoker = other.lvalueInvoker;
+    rvalueInvoker = other.rvalueInvoker;
+    manager = other.manager;
+    other.lvalueInvoker = NULL;
+    other.rvalueInvoker = NULL;
+    other.manager = NULL;
+  }
+
+  // destroy the target, turning this into an empty delegate.
+  void reset()
+  {
+    if (manager != NULL)
+    {
+      manager(Operation::DESTROY, &storage, NULL);
+    }
+    lvalueInvoker = NULL;
+    rvalueInvoker = NULL;
+    manager = NULL;
+  }
+
+public:
+  /**
+   * @brief Create an empty delegate.
+   */
+  Delegate() :
+      lvalueInvoker(NULL), rvalueInvoker(NULL), manager(NULL)
+  {
+  }
+
+  /**
+   * @brief Create a delegate calling the given function object.
+   *
+   * @tparam F function object type. Must be copyable and callable with Args.
+   */
+  template<typename F, typename = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, Delegate>::value>::type>
+  Delegate(F&& function)
+  {
+    typedef typename std::decay<F>::type Target;
+    static_assert(std::is_copy_constructible<Target>::value, "Delegate targets must be copyable.");
+
+    store(std::forward<F>(function), fits_inline<Target>());
+    lvalueInvoker = selectLvalueInvoker<Target>(typename detail::is_callable<Target&, const Args&...>::type(),
+        detail::all_copy_constructible<Args...>());
+    rvalueInvoker = &invokeRvalue<Target>;
+    manager = is_trivial_inline<Target>::value ? NULL : static_cast<Manager>(&manage<Target>);
+  }
+
+  /**
+   * @brief Create a delegate calling a member function on the given object.
+   */
+  template<typename T, typename Return, typename... MFArgs>
+  Delegate(Return (T::*fp)(MFArgs...), type_identity_t<T>* obj) :
+      Delegate(detail::bind_member(fp, obj))
+  {
+  }
+
+  /**
+   * @brief Create a delegate calling a const member function on the given object.
+   */
+  template<typename T, typename Return, typename... MFArgs>
+  Delegate(Return (T::*fp)(MFArgs...) const, const type_identity_t<T>* obj) :
+      Delegate(detail::bind_member(fp, obj))
+  {
+  }
+
+  /// @brief Copy the target of other.
+  Delegate(const Delegate& other) :
+      lvalueInvoker(other.lvalueInvoker), rvalueInvoker(other.rvalueInvoker), manager(other.manager)
+  {
+    if (manager != NULL)
+    {
+      manager(Operation::COPY, &storage, const_cast<Storage*>(&other.storage));
+    }
+    else
+    {
+      storage = other.storage;
+    }
+  }
+
+  /// @brief Take the target of other, leaving it empty.
+  Delegate(Delegate&& other) noexcept :
+      lvalueInvoker(NULL), rvalueInvoker(NULL), manager(NULL)
+  {
+    moveFrom(other);
+  }
+
+  /// @brief Replace the target with a copy of or the target of other.
+  Delegate& operator=(Delegate other) noexcept
+  {
+    reset();
+    moveFrom(other);
+    return *this;
+  }
+
+  ~Delegate()
+  {
+    reset();
+  }
+
+  /**
+   * @brief Check if this delegate has a target.
+   */
+  explicit operator bool() const
+  {
+    return rvalueInvoker != NULL;
+  }
+
+  /**
+   * @brief Call the target, passing the arguments as const lvalues.
+   *
+   * Must not be used for empty delegates or move-only argument types.
+   */
+  void invoke(const Args&... args) const
+  {
+    lvalueInvoker(const_cast<Storage*>(&storage), args...);
+  }
+
+  /**
+   * @brief Call the target, passing the arguments as rvalues.
+   *
+   * Must not be used for empty delegates.
+   */
+  void invokeMove(Args&&... args) const
+  {
+    rvalueInvoker(const_cast<Storage*>(&storage), std::forward<Args>(args)...);
+  }
+};
+
+namespace detail
+{
+
+// apply is only available in C++17
+// this is a stripped-down version limited to Delegate
+// for explanation see https://en.cppreference.com/w/cpp/utility/apply
+// lvalue tuples are passed as lvalues, rvalue tuples as rvalues.
+template<class F, class Tuple, std::size_t... I>
+void apply_impl(const Delegate<F>& f, Tuple&& t, index_sequence<I...>, std::true_type /*lvalue*/)
+{
+  f.invoke(std::get<I>(t)...);
+}
+template<class F, class Tuple, std::size_t... I>
+void apply_impl(const Delegate<F>& f, Tuple&& t, index_sequence<I...>, std::false_type /*lvalue*/)
+{
+  f.invokeMove(std::get<I>(std::move(t))...);
+}
+template<class F, class Tuple>
+void apply(const Delegate<F>& f, Tuple&& t)
+{
+  apply_impl(f, std::forward<Tuple>(t),
+             make_index_sequence<std::tuple_size<typename std::remove_reference<Tuple>::type>::value> {},
+             std::is_lvalue_reference<Tuple>());
+}
+
+}  // namespace detail
+
+}  // namespace ES
+
+#endif /* EVENTDELEGATE_H */
@@ -0,0 +1,486 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTINSTRUMENTATION_H
+#define EVENTINSTRUMENTATION_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Set to 0 to compile out the instrumentation.
+ *
+ * When compiled in, the instrumentation is still disabled until setInstrumentationEnabled() is
+ * called. A disabled instrumentation costs one relaxed atomic load per enqueued event and per
+ * dispatch. When compiled out, the snapshots are all zero.
+ */
+#ifndef ES_ENABLE_INSTRUMENTATION
+#define ES_ENABLE_INSTRUMENTATION 1
+#endif
+
+namespace ES {
+
+/**
+ * @brief Summary of a latency distribution, in nanoseconds.
+ *
+ * The distribution is recorded as histogram with power-of-two bucket bounds, so the percentiles
+ * are accurate up to a factor of two.
+ */
+struct LatencyStatistics
+{
+  /// @brief Number of histogram buckets.
+  static constexpr unsigned int bucketCount = 40;
+
+  /// @brief Number of recorded values.
+  std::uint64_t count;
+  /// @brief Sum of all recorded values.
+  std::uint64_t totalNs;
+  /// @brief Largest recorded value.
+  std::uint64_t maxNs;
+  /// @brief Bucket i counts the values in [2^i, 2^(i+1)), bucket 0 includes 0, the last bucket everything above.
+  std::array<std::uint64_t, bucketCount> buckets;
+
+  LatencyStatistics() :
+      count(0), totalNs(0), maxNs(0), buckets()
+  {
+  }
+
+  /// @brief Add the values recorded in another distribution.
+  void merge(const LatencyStatistics& other)
+  {
+    count += other.count;
+    totalNs += other.totalNs;
+    maxNs = std::max(maxNs, other.maxNs);
+    for (unsigned int i = 0; i < bucketCount; ++i)
+    {
+      buckets[i] += other.buckets[i];
+    }
+  }
+
+  /// @brief Get the mean value, or 0 if nothing was recorded.
+  double getMeanNs() const
+  {
+    return count == 0 ? 0.0 : static_cast<double>(totalNs) / count;
+  }
+
+  /**
+   * @brief Get the upper bound of the bucket containing the given percentile.
+   *
+   * @param percentile in [0, 100]
+   */
+  std::uint64_t getPercentileNs(double percentile) const
+  {
+    if (count == 0)
+    {
+      return 0;
+    }
+    double target = percentile / 100.0 * count;
+    std::uint64_t seen = 0;
+    for (unsigned int i = 0; i < bucketCount; ++i)
+    {
+      seen += buckets[i];
+      if (seen >= target && seen > 0)
+      {
+        return i + 1 < bucketCount ? std::min<std::uint64_t>((std::uint64_t(2) << i) - 1, maxNs) : maxNs;
+      }
+    }
+    return maxNs;
+  }
+};
+
+/**
+ * @brief Time spent in one subscriber.
+ */
+struct SubscriberStatistics
+{
+  /// @brief Subscriber id, increasing in subscription order.
+  unsigned int id;
+  /// @brief 0 for the event's own subscribers, k for the k-th queue with pinned subscribers.
+  unsigned int pinnedRoute;
+  /// @brief Number of calls.
+  std::uint64_t calls;
+  /// @brief Total time spent in the subscriber.
+  std::uint64_t totalNs;
+  /// @brief Longest call.
+  std::uint64_t maxNs;
+};
+
+/**
+ * @brief Instrumentation data of one event, see EventRegistry::getInstrumentation().
+ */
+struct EventInstrumentationSnapshot
+{
+  /// @brief Event name, filled in by the registry.
+  std::string name;
+  /// @brief Number of queued events, counted once per queue for events with pinned subscribers.
+  std::uint64_t published;
+  /// @brief Queued events per second, between the first and the last one.
+  double publishRate;
+  /// @brief Number of processed queued events.
+  std::uint64_t fired;
+  /// @brief Time from enqueueing an event until it is passed to the subscribers.
+  LatencyStatistics queueDelay;
+  /// @brief Time from enqueueing an event until all subscribers returned.
+  LatencyStatistics residency;
+  /// @brief Time spent in each active subscriber, for queued and directly called events.
+  std::vector<SubscriberStatistics> subscribers;
+
+  EventInstrumentationSnapshot() :
+      published(0), publishRate(0), fired(0)
+  {
+  }
+};
+
+namespace detail
+{
+
+inline std::atomic<bool>& instrumentationFlag()
+{
+  static std::atomic<bool> flag(false);
+  return flag;
+}
+
+// monotonic clock for the instrumentation, in nanoseconds
+inline std::int64_t instrumentationClock()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace detail
+
+/**
+ * @brief Switch the instrumentation on or off at runtime.
+ *
+ * This affects all events of all registries. Events that were enqueued while the instrumentation was
+ * disabled are not recorded. Has no effect if ES_ENABLE_INSTRUMENTATION is 0.
+ */
+inline void setInstrumentationEnabled(bool enabled)
+{
+#if ES_ENABLE_INSTRUMENTATION
+  detail::instrumentationFlag().store(enabled, std::memory_order_relaxed);
+#else
+  (void) enabled;
+#endif
+}
+
+/**
+ * @brief Check if the instrumentation is recording, see setInstrumentationEnabled().
+ */
+inline bool isInstrumentationEnabled()
+{
+#if ES_ENABLE_INSTRUMENTATION
+  return detail::instrumentationFlag().load(std::memory_order_relaxed);
+#else
+  return false;
+#endif
+}
+
+namespace detail
+{
+
+// lock-free latency histogram. Every field is updated with relaxed atomics.
+class LatencyHistogram
+{
+private:
+  std::atomic<std::uint64_t> count;
+  std::atomic<std::uint64_t> total;
+  std::atomic<std::uint64_t> max;
+  std::atomic<std::uint64_t> buckets[LatencyStatistics::bucketCount];
+
+  static unsigned int bucketIndex(std::uint64_t ns)
+  {
+    if (ns == 0)
+    {
+      return 0;
+    }
+#if defined(__GNUC__)
+    unsigned int index = 63 - __builtin_clzll(ns);
+#else
+    unsigned int index = 0;
+    while (ns >>= 1)
+    {
+      index++;
+    }
+#endif
+    return index < LatencyStatistics::bucketCount ? index : LatencyStatistics::bucketCount - 1;
+  }
+
+public:
+  LatencyHistogram() :
+      count(0), total(0), max(0)
+  {
+    for (auto& bucket : buckets)
+    {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void record(std::int64_t ns)
+  {
+    std::uint64_t value = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+    count.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(value, std::memory_order_relaxed);
+    buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    std::uint64_t previous = max.load(std::memory_order_relaxed);
+    while (value > previous && !max.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  void snapshot(LatencyStatistics& out) const
+  {
+    out.count = count.load(std::memory_order_relaxed);
+    out.totalNs = total.load(std::memory_order_relaxed);
+    out.maxNs = max.load(std::memory_order_relaxed);
+    for (unsigned int i = 0; i < LatencyStatistics::bucketCount; ++i)
+    {
+      out.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+  }
+};
+
+// per-thread slot for counters that are hit by many producers
+inline unsigned int instrumentationShard()
+{
+  static std::atomic<unsigned int> nextShard(0);
+  thread_local unsigned int shard = nextShard.fetch_add(1, std::memory_order_relaxed);
+  return shard;
+}
+
+// instrumentation data of one SubscriberCollection
+class TopicInstrumentation
+{
+private:
+  static constexpr unsigned int shardCount = 4;
+
+  // publish counters, one cache line per shard so that producers on different threads don't
+  // contend for the same line.
+  struct PublishShard
+  {
+    std::atomic<std::uint64_t> published;
+    std::atomic<std::int64_t> lastPublish;
+    char padding[64 - sizeof(std::atomic<std::uint64_t>) - sizeof(std::atomic<std::int64_t>)];
+
+    PublishShard() :
+        published(0), lastPublish(0)
+    {
+    }
+  };
+
+  PublishShard shards[shardCount];
+  std::atomic<std::int64_t> firstPublish;
+  std::atomic<std::uint64_t> fired;
+  LatencyHistogram queueDelay;
+  LatencyHistogram residency;
+
+public:
+  TopicInstrumentation() :
+      firstPublish(0), fired(0)
+  {
+  }
+
+  void recordPublish(std::int64_t now)
+  {
+    PublishShard& shard = shards[instrumentationShard() % shardCount];
+    shard.published.fetch_add(1, std::memory_order_relaxed);
+    shard.lastPublish.store(now, std::memory_order_relaxed);
+    std::int64_t unset = 0;
+    if (firstPublish.load(std::memory_order_relaxed) == 0)
+    {
+      firstPublish.compare_exchange_strong(unset, now, std::memory_order_relaxed);
+    }
+  }
+
+  void recordFire(std::int64_t enqueued, std::int64_t started, std::int64_t finished)
+  {
+    fired.fetch_add(1, std::memory_order_relaxed);
+    queueDelay.record(started - enqueued);
+    residency.record(finished - enqueued);
+  }
+
+  void snapshot(EventInstrumentationSnapshot& out) const
+  {
+    std::int64_t lastPublish = 0;
+    out.published = 0;
+    for (auto& shard : shards)
+    {
+      out.published += shard.published.load(std::memory_order_relaxed);
+      std::int64_t shardLast = shard.lastPublish.load(std::memory_order_relaxed);
+      if (shardLast > lastPublish)
+      {
+        lastPublish = shardLast;
+      }
+    }
+    std::int64_t first = firstPublish.load(std::memory_order_relaxed);
+    out.publishRate = 0;
+    if (out.published > 1 && lastPublish > first)
+    {
+      out.publishRate = (out.published - 1) * 1e9 / (lastPublish - first);
+    }
+    out.fired = fired.load(std::memory_order_relaxed);
+    queueDelay.snapshot(out.queueDelay);
+    residency.snapshot(out.residency);
+  }
+};
+
+#if ES_ENABLE_INSTRUMENTATION
+
+// time spent in one subscriber. Movable, so that it can be stored with the subscriber.
+class SubscriberTiming
+{
+private:
+  mutable std::atomic<std::uint64_t> calls;
+  mutable std::atomic<std::uint64_t> total;
+  mutable std::atomic<std::uint64_t> max;
+
+public:
+  SubscriberTiming() :
+      calls(0), total(0), max(0)
+  {
+  }
+  SubscriberTiming(SubscriberTiming&& other) noexcept :
+      calls(other.calls.load(std::memory_order_relaxed)), total(other.total.load(std::memory_order_relaxed)),
+      max(other.max.load(std::memory_order_relaxed))
+  {
+  }
+  SubscriberTiming& operator=(SubscriberTiming&& other) noexcept
+  {
+    calls.store(other.calls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    total.store(other.total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    max.store(other.max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+  }
+
+  void record(std::int64_t ns) const
+  {
+    std::uint64_t value = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+    calls.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(value, std::memory_order_relaxed);
+    std::uint64_t previous = max.load(std::memory_order_relaxed);
+    while (value > previous && !max.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  void snapshot(SubscriberStatistics& out) const
+  {
+    out.calls = calls.load(std::memory_order_relaxed);
+    out.totalNs = total.load(std::memory_order_relaxed);
+    out.maxNs = max.load(std::memory_order_relaxed);
+  }
+};
+
+// instrumentation data of a SubscriberCollection, allocated when it is first recorded.
+class TopicInstrumentationSlot
+{
+private:
+  mutable std::atomic<TopicInstrumentation*> data;
+
+public:
+  TopicInstrumentationSlot() :
+      data(NULL)
+  {
+  }
+  TopicInstrumentationSlot(const TopicInstrumentationSlot&) = delete;
+  TopicInstrumentationSlot& operator=(const TopicInstrumentationSlot&) = delete;
+  ~TopicInstrumentationSlot()
+  {
+    delete data.load(std::memory_order_relaxed);
+  }
+
+  TopicInstrumentation& get() const
+  {
+    TopicInstrumentation* current = data.load(std::memory_order_acquire);
+    if (current == NULL)
+    {
+      // racing threads may allocate concurrently, the loser deletes it's copy
+      TopicInstrumentation* created = new TopicInstrumentation();
+      if (data.compare_exchange_strong(current, created, std::memory_order_acq_rel))
+      {
+        current = created;
+      }
+      else
+      {
+        delete created;
+      }
+    }
+    return *current;
+  }
+
+  void snapshot(EventInstrumentationSnapshot& out) const
+  {
+    TopicInstrumentation* current = data.load(std::memory_order_acquire);
+    if (current != NULL)
+    {
+      current->snapshot(out);
+    }
+  }
+};
+
+#else
+
+// no-op replacements when the instrumentation is compiled out
+class SubscriberTiming
+{
+public:
+  void record(std::int64_t) const
+  {
+  }
+  void snapshot(SubscriberStatistics& out) const
+  {
+    out.calls = 0;
+    out.totalNs = 0;
+    out.maxNs = 0;
+  }
+};
+
+class TopicInstrumentationSlot
+{
+public:
+  void snapshot(EventInstrumentationSnapshot&) const
+  {
+  }
+};
+
+#endif
+
+}  // namespace detail
+
+}  // namespace ES
+
+#endif /* EVENTINSTRUMENTATION_H */
@@ -41,6 +41,11 @@
 #include <tuple>
 #include <sstream>
 #include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
 
 namespace ES {
 
@@ -68,7 +73,10 @@ enum class ParameterType {
  *
  * Every specialization must define:
  * - A static constexpr field 'valueType' of type ParameterType.
- * - A static method parse, taking a std::string as argument and returning the parsed value.
+ * - A static method parse, taking a StringView or a std::string as argument and returning the parsed value.
+ *
+ * The built-in parsers take a StringView, so they don't allocate memory unless the result does.
+ * Parsers taking a std::string still work, the string is then created from the view.
  *
  * The parse method should throw std::invalid_argument if the string is malformed.
  *
@@ -96,11 +104,51 @@ struct ParameterValueParser {
    * @throws std::invalid_argument if the passed string cannot be parsed to a value of type T.
    * @throws std::logic_error if valueType is UNSUPPORTED, thus the parse can never succeed.
    */
-  static T parse(const std::string& stringValue) {
+  static T parse(StringView) {
     throw std::logic_error("Cannot parse an unsupported parameter type.");
   }
 };
 
+namespace detail
+{
+
+inline bool isWhitespace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// remove leading and trailing whitespace
+inline StringView trimWhitespace(StringView value)
+{
+  const char* first = value.begin();
+  const char* last = value.end();
+  while (first != last && isWhitespace(*first))
+  {
+    ++first;
+  }
+  while (last != first && isWhitespace(*(last - 1)))
+  {
+    --last;
+  }
+  return StringView(first, last - first);
+}
+
+// strtod variants by result type
+inline float parseFloatingPoint(const char* str, char** end, float*)
+{
+  return std::strtof(str, end);
+}
+inline double parseFloatingPoint(const char* str, char** end, double*)
+{
+  return std::strtod(str, end);
+}
+inline long double parseFloatingPoint(const char* str, char** end, long double*)
+{
+  return std::strtold(str, end);
+}
+
+}  // namespace detail
+
 // use template specialization to define parsers for types
 
 /// @brief ParameterValueParser for std::string parameters
@@ -108,8 +156,8 @@ template<>
 struct ParameterValueParser<std::string> {
   static constexpr ParameterType valueType = ParameterType::STRING;
 
-  static std::string parse(const std::string& stringValue) {
-    return stringValue;
+  static std::string parse(StringView stringValue) {
+    return stringValue.str();
   }
 };
 
@@ -120,7 +168,7 @@ struct ParameterValueParser<bool> {
 
 
 
-  static bool parse(const std::string& stringValue) {
+  static bool parse(StringView stringValue) {
     // supports "true" and "false" in arbitrary case
     if (matches(stringValue, "true")) {
       return true;
@@ -133,7 +181,7 @@ struct ParameterValueParser<bool> {
 
 private:
   // a helper for lower-case string comparison.
-  static bool matches(const std::string& value, const char* expected) {
+  static bool matches(StringView value, const char* expected) {
     if (value.size() != strlen(expected))
       return false;
 
@@ -146,36 +194,95 @@ private:
   }
 };
 
-/// @brief ParameterValueParser for integral number parameters
+/**
+ * @brief ParameterValueParser for integral number parameters
+ *
+ * Accepts decimal numbers with an optional sign, surrounded by optional whitespace.
+ * Values that don't fit into T are rejected.
+ */
 template<typename T>
 struct ParameterValueParser<T, typename std::enable_if<std::is_integral<T>::value>::type> {
   static constexpr ParameterType valueType = ParameterType::INT;
 
-  static int parse(const std::string& stringValue) {
-    std::istringstream is(stringValue);
-    int result;
-    if(!(is >> result)) {
-      // invalid input format
+  static T parse(StringView stringValue) {
+    StringView value = detail::trimWhitespace(stringValue);
+    const char* cur = value.begin();
+    const char* end = value.end();
+
+    bool negative = false;
+    if (cur != end && (*cur == '-' || *cur == '+')) {
+      negative = *cur == '-';
+      ++cur;
+    }
+    if (cur == end) {
       throw std::invalid_argument("Illegal integer value");
     }
-    return result;
+
+    // accumulate the magnitude, which may be one larger than max() for negative values
+    std::uintmax_t limit = static_cast<std::uintmax_t>(std::numeric_limits<T>::max());
+    if (negative) {
+      limit = std::numeric_limits<T>::is_signed ? limit + 1 : 0;
+    }
+    std::uintmax_t magnitude = 0;
+    for (; cur != end; ++cur) {
+      if (*cur < '0' || *cur > '9') {
+        // invalid input format
+        throw std::invalid_argument("Illegal integer value");
+      }
+      unsigned int digit = static_cast<unsigned int>(*cur - '0');
+      if (digit > limit || magnitude > (limit - digit) / 10) {
+        throw std::invalid_argument("Integer value out of range");
+      }
+      magnitude = magnitude * 10 + digit;
+    }
+
+    if (!negative || magnitude == 0) {
+      return static_cast<T>(magnitude);
+    }
+    // negate without overflowing for min()
+    return static_cast<T>(-static_cast<std::intmax_t>(magnitude - 1) - 1);
   }
 };
 
-/// @brief ParameterValueParser for floating point number parameters
+/**
+ * @brief ParameterValueParser for floating point number parameters
+ *
+ * Uses the strtod family, so the decimal separator follows the C locale.
+ */
 template<typename T>
 struct ParameterValueParser<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
   static constexpr ParameterType valueType = ParameterType::DOUBLE;
 
-  static double parse(const std::string& stringValue) {
-      std::istringstream is(stringValue);
-      double result;
-      if(!(is >> result)) {
-        // invalid input format
-        throw std::invalid_argument("Illegal integer value");
-      }
-      return result;
+  static T parse(StringView stringValue) {
+    StringView value = detail::trimWhitespace(stringValue);
+    if (value.empty()) {
+      throw std::invalid_argument("Illegal floating point value");
+    }
+
+    // strtod needs a null-terminated string. Short values are copied to the stack.
+    char buffer[64];
+    std::string longValue;
+    const char* str = buffer;
+    if (value.size() < sizeof(buffer)) {
+      std::memcpy(buffer, value.data(), value.size());
+      buffer[value.size()] = '\0';
+    } else {
+      longValue = value.str();
+      str = longValue.c_str();
+    }
+
+    char* parsedEnd = NULL;
+    errno = 0;
+    T result = detail::parseFloatingPoint(str, &parsedEnd, static_cast<T*>(NULL));
+    if (parsedEnd != str + value.size()) {
+      // invalid input format
+      throw std::invalid_argument("Illegal floating point value");
     }
+    if (errno == ERANGE && std::isinf(result)) {
+      throw std::invalid_argument("Floating point value out of range");
+    }
+    return result;
+  }
 };
 
 // forward define event queue and handler collection, they are required for the forward-declared call methods.
@@ -238,6 +345,113 @@ public:
    * @throws std::logic_error if canParseArgs() returns false.
    */
   virtual void enqueueEvent(EventQueue* queue, const std::vector<std::string>& parameterStrings) const = 0;
+
+  /**
+   * @brief Call the event immediately, using the given string views as arguments.
+   *
+   * Unlike the std::vector overload, this does not require owned strings.
+   *
+   * @param parameters argument string values
+   * @param count number of entries in parameters. Must match getParameterCount().
+   *
+   * @throws std::invalid_argument if the parameter count is wrong, or if a parameter string is malformed.
+   * @throws std::logic_error if canParseArgs() returns false.
+   */
+  virtual void callEvent(const StringView* parameters, std::size_t count) const = 0;
+
+  /**
+   * @brief Enqueue the event, using the given string views as arguments.
+   *
+   * @param queue queue to put the event on.
+   * @param parameters argument string values
+   * @param count number of entries in parameters. Must match getParameterCount().
+   *
+   * @throws std::invalid_argument if the parameter count is wrong, or if a parameter string is malformed.
+   * @throws std::logic_error if canParseArgs() returns false.
+   */
+  virtual void enqueueEvent(EventQueue* queue, const StringView* parameters, std::size_t count) const = 0;
+
+  /**
+   * @brief Call the event immediately, splitting the arguments from a single string.
+   *
+   * See tokenize() for the format. The arguments are parsed in place, without allocating memory
+   * for the tokens.
+   *
+   * @param arguments whitespace-separated argument values
+   *
+   * @throws std::invalid_argument if the argument count is wrong, or if an argument is malformed.
+   * @throws std::logic_error if canParseArgs() returns false.
+   */
+  virtual void callEventLine(StringView arguments) const = 0;
+
+  /**
+   * @brief Enqueue the event, splitting the arguments from a single string.
+   *
+   * See tokenize() for the format.
+   *
+   * @param queue queue to put the event on.
+   * @param arguments whitespace-separated argument values
+   *
+   * @throws std::invalid_argument if the argument count is wrong, or if an argument is malformed.
+   * @throws std::logic_error if canParseArgs() returns false.
+   */
+  virtual void enqueueEventLine(EventQueue* queue, StringView arguments) const = 0;
+
+  /**
+   * @brief Split a string into whitespace-separated tokens.
+   *
+   * A token enclosed in double quotes may contain whitespace. The quotes are not part of the token,
+   * and there are no escape sequences.
+   *
+   * @param line string to split
+   * @param tokens receives the first maxTokens tokens
+   * @param maxTokens capacity of tokens
+   * @return the number of tokens in line, which may be larger than maxTokens.
+   *
+   * @throws std::invalid_argument if a quoted token is not terminated.
+   */
+  static std::size_t tokenize(StringView line, StringView* tokens, std::size_t maxTokens) {
+    std::size_t count = 0;
+    const char* cur = line.begin();
+    const char* end = line.end();
+    while (true) {
+      while (cur != end && detail::isWhitespace(*cur)) {
+        ++cur;
+      }
+      if (cur == end) {
+        return count;
+      }
+      const char* first = cur;
+      const char* last;
+      if (*cur == '"') {
+        first = ++cur;
+        while (cur != end && *cur != '"') {
+          ++cur;
+        }
+        if (cur == end) {
+          throw std::invalid_argument("Unterminated quoted argument");
+        }
+        last = cur++;
+      } else {
+        while (cur != end && !detail::isWhitespace(*cur)) {
+          ++cur;
+        }
+        last = cur;
+      }
+      if (count < maxTokens) {
+        tokens[count] = StringView(first, last - first);
+      }
+      count++;
+    }
+  }
+
+protected:
+  // throw the error for a wrong number of arguments
+  static void throwParameterCountMismatch(std::size_t expected, std::size_t count) {
+    std::ostringstream os;
+    os << "Wrong number event arguments, expected " << expected << " but got " << count;
+    throw std::invalid_argument(os.str());
+  }
 };
 
 
@@ -254,19 +468,30 @@ private:
   std::tuple<Args...> parseArgs(const std::vector<std::string>& parameterStrings) const {
     // check vector length
     if (parameterStrings.size() != paramCount) {
-      std::ostringstream os;
-      os << "Wrong number event arguments, expected " << paramCount << " but got " << parameterStrings.size();
-      throw std::invalid_argument(os.str());
+      throwParameterCountMismatch(paramCount, parameterStrings.size());
     }
-    return parseArgsImpl(parameterStrings, detail::make_index_sequence<paramCount> {});
+    return parseArgsImpl(parameterStrings.data(), detail::make_index_sequence<paramCount> {});
+  }
+  // parse the event arguments from string views into a tuple
+  std::tuple<Args...> parseArgs(const StringView* parameters, std::size_t count) const {
+    if (count != paramCount) {
+      throwParameterCountMismatch(paramCount, count);
+    }
+    return parseArgsImpl(parameters, detail::make_index_sequence<paramCount> {});
+  }
+  // split and parse the event arguments into a tuple
+  std::tuple<Args...> parseArgs(StringView arguments) const {
+    // one more slot to detect excess arguments
+    std::array<StringView, paramCount + 1> tokens;
+    return parseArgs(tokens.data(), tokenize(arguments, tokens.data(), tokens.size()));
   }
   // helper, includes the required index sequence
-  template<std::size_t... I>
-  std::tuple<Args...> parseArgsImpl(
-      const std::vector<std::string>& parameterStrings, detail::index_sequence<I...>
-  ) const {
+  template<typename String, std::size_t... I>
+  std::tuple<Args...> parseArgsImpl(const String* parameters, detail::index_sequence<I...>) const {
+    // unused for events without arguments
+    (void) parameters;
     return std::make_tuple(
-        ParameterValueParser<Args>::parse(parameterStrings.at(I))...);
+        ParameterValueParser<Args>::parse(parameters[I])...);
   }
 
   // handler collection this parser was created for
@@ -295,6 +520,10 @@ public:
   // the call operators are defined later, since they depend on the SubscriberCollection/EventQueue implementation.
   virtual void callEvent(const std::vector<std::string>& parameterStrings) const;
   virtual void enqueueEvent(EventQueue* queue, const std::vector<std::string>& parameterStrings) const;
+  virtual void callEvent(const StringView* parameters, std::size_t count) const;
+  virtual void enqueueEvent(EventQueue* queue, const StringView* parameters, std::size_t count) const;
+  virtual void callEventLine(StringView arguments) const;
+  virtual void enqueueEventLine(EventQueue* queue, StringView arguments) const;
 
 };
 
@@ -34,14 +34,210 @@
 #define EVENTQUEUE_H
 
 #include "EventSubscriberCollection.h"
+#include "EventQueuePool.h"
+#include "EventWorkerPool.h"
+#include "EventTimerWheel.h"
 
+#include <algorithm>
+#include <memory>
 #include <queue>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <stdexcept>
 
 namespace ES {
 
+/**
+ * @brief Selects the synchronization strategy of an EventQueue.
+ */
+enum class EventQueueMode {
+  /// @brief Producers and the consumer share one mutex. This is the default.
+  LOCKING,
+  /**
+   * @brief Producers push events using a lock-free intrusive list.
+   *
+   * Enqueuing never blocks. The processing methods are still serialized by a mutex, but that
+   * mutex is only shared between consumers, never with producers. This mode is intended for
+   * many producer threads feeding a single consumer.
+   */
+  LOCK_FREE
+};
+
+/**
+ * @brief Selects what happens when an event is enqueued into a full EventQueue.
+ *
+ * See EventQueue::setCapacity() and EventQueue::setTopicCapacity().
+ */
+enum class OverflowPolicy {
+  /// @brief Block the producer until there is space, or until the block timeout expires.
+  BLOCK,
+  /// @brief Reject the new event.
+  DROP_NEWEST,
+  /// @brief Discard the oldest queued event to make room for the new one.
+  DROP_OLDEST,
+  /**
+   * @brief Overwrite the arguments of the newest queued event for the same subscribers with the new ones.
+   *
+   * If there is no such event, or if the argument types can be neither move assigned nor moved without
+   * exceptions, the new event is rejected. If the new event has a higher priority, the queued one is
+   * moved to the end of the higher priority lane.
+   */
+  CONFLATE
+};
+
+/**
+ * @brief Outcome of enqueuing or publishing an event.
+ */
+enum class PublishStatus {
+  /// @brief The event was queued.
+  QUEUED,
+  /// @brief The event was queued, but the oldest queued event was discarded to make room for it.
+  QUEUED_DROPPING_OLDEST,
+  /// @brief The arguments of an already queued event for the same subscribers were replaced.
+  CONFLATED,
+  /// @brief The event was rejected because the queue was full.
+  DROPPED,
+  /// @brief The queue stayed full until the block timeout expired, the event was rejected.
+  TIMED_OUT,
+  /// @brief The event is not registered, or the handle is empty.
+  NOT_REGISTERED
+};
+
+/**
+ * @brief Result of enqueuing or publishing an event.
+ *
+ * Converts to `true` if the event's arguments will be passed to the subscribers, i.e. the event
+ * was queued or conflated. This keeps code working that treats the result as a bool.
+ */
+class PublishResult
+{
+private:
+  PublishStatus status;
+
+public:
+  PublishResult(PublishStatus status) :
+      status(status)
+  {
+  }
+
+  /**
+   * @brief Get the detailed outcome.
+   */
+  PublishStatus getStatus() const
+  {
+    return status;
+  }
+
+  /**
+   * @brief Check whether the event's arguments will be passed to the subscribers.
+   */
+  bool isAccepted() const
+  {
+    return status == PublishStatus::QUEUED || status == PublishStatus::QUEUED_DROPPING_OLDEST
+        || status == PublishStatus::CONFLATED;
+  }
+
+  operator bool() const
+  {
+    return isAccepted();
+  }
+
+  bool operator==(PublishStatus other) const
+  {
+    return status == other;
+  }
+
+  bool operator!=(PublishStatus other) const
+  {
+    return status != other;
+  }
+};
+
+/**
+ * @brief Snapshot of the event counters of an EventQueue.
+ *
+ * See EventQueue::getStatistics().
+ */
+struct EventQueueStatistics
+{
+  /// @brief number of events waiting to be processed
+  std::size_t depth;
+  /// @brief maximum depth since construction or the last resetHighWaterMark() call
+  std::size_t highWaterMark;
+  /// @brief total number of enqueued events
+  unsigned long long enqueued;
+  /// @brief total number of events passed to their subscribers
+  unsigned long long processed;
+  /// @brief total number of events removed without being processed, e.g. by clear() or OverflowPolicy::DROP_OLDEST
+  unsigned long long discarded;
+  /// @brief total number of events rejected because the queue was full
+  unsigned long long rejected;
+  /// @brief total number of events whose arguments were merged into an already queued event
+  unsigned long long conflated;
+};
+
+/**
+ * @brief Identifies a timed event scheduled on an EventQueue, see EventQueue::enqueueAt().
+ *
+ * Can be used to cancel the timer using EventQueue::cancelTimer(). A default-constructed handle
+ * does not refer to any timer.
+ */
+class TimerHandle
+{
+private:
+  unsigned long long id;
+
+public:
+  /**
+   * @brief Create an empty handle.
+   */
+  TimerHandle() :
+      id(0)
+  {
+  }
+
+  /**
+   * @brief Create a handle for the given timer id.
+   */
+  explicit TimerHandle(unsigned long long id) :
+      id(id)
+  {
+  }
+
+  /**
+   * @brief Get the timer id, unique across all EventQueues.
+   */
+  unsigned long long getId() const
+  {
+    return id;
+  }
+
+  /**
+   * @brief Check if this handle refers to a timer. The timer may have expired since.
+   */
+  bool isValid() const
+  {
+    return id != 0;
+  }
+
+  bool operator==(const TimerHandle& other) const
+  {
+    return id == other.id;
+  }
+
+  bool operator!=(const TimerHandle& other) const
+  {
+    return id != other.id;
+  }
+};
+
 /**
  * @brief Allows to asynchronously queue events to be fired at a later point in time.
  *
@@ -49,9 +245,30 @@ namespace ES {
  * their handlers when the process() method is called. This happens in the same order
  * in which the events were queued.
  *
+ * Each event has an EventPriority, taken from its subscriber collection or given when enqueuing.
+ * The queue keeps one FIFO lane per priority. By default, lanes are serviced strictly, i.e. events
+ * of a lower priority are only processed after all queued events of higher priorities. This can be
+ * changed to weighted round robin using setPriorityWeights().
+ *
  * This class is thread-safe. Events can be enqueued asynchronously without problems.
  * It is also possible to enqueue events while the queued events are being processed.
  * However, the newly queued events will only be handled with the next call to process().
+ *
+ * The synchronization strategy is selected on construction, see EventQueueMode. Both modes
+ * provide the same ordering guarantees.
+ *
+ * A consumer thread can sleep until events arrive using wait(), waitAndProcess() or processFor().
+ *
+ * By default, the queue is unbounded. A capacity and an OverflowPolicy can be set for the whole
+ * queue using setCapacity(), and for single topics using setTopicCapacity().
+ *
+ * Many events for the same subscribers can be enqueued at once using a BatchPublisher.
+ *
+ * Events can be scheduled for a point in time, or periodically, using enqueueAt(), enqueueAfter() and
+ * enqueuePeriodic(). They are kept in a timer wheel and are enqueued once they are due, see processTimers().
+ *
+ * Events can also be processed on multiple threads using processParallel(). In that case, events
+ * are only ordered relative to other events of the same subscriber collection.
  */
 class EventQueue
 {
@@ -71,9 +288,24 @@ private:
   public:
     // next event in queue, not owned!
     QueuedEventBase* next;
+    // previous event in queue, not owned!
+    QueuedEventBase* prev;
+    // next event in queue for the same subscribers, not owned!
+    QueuedEventBase* topicNext;
+    // previous event in queue for the same subscribers, not owned!
+    QueuedEventBase* topicPrev;
+    // priority lane, an EventPriority value
+    unsigned int priority;
+#if ES_ENABLE_INSTRUMENTATION
+    // instrumentation clock value when the event was enqueued, or 0 if it is not recorded
+    std::int64_t enqueueTime;
+#endif
 
     QueuedEventBase() :
-        next(NULL)
+        next(NULL), prev(NULL), topicNext(NULL), topicPrev(NULL), priority(0)
+#if ES_ENABLE_INSTRUMENTATION
+        , enqueueTime(0)
+#endif
     {
     }
 
@@ -100,29 +332,75 @@ private:
 
   public:
     QueuedEvent(const SubscriberCollection<Args...>* handlerRef,
-        std::tuple<Args...> args) :
-        handlerRef(handlerRef), args(args)
+        std::tuple<Args...>&& args) :
+        handlerRef(handlerRef), args(std::move(args))
     {
     }
     virtual ~QueuedEvent() = default;
 
     virtual void fire()
     {
-      // call event handlers
-      handlerRef->call_tuple(args);
+#if ES_ENABLE_INSTRUMENTATION
+      if (enqueueTime != 0)
+      {
+        std::int64_t started = detail::instrumentationClock();
+        handlerRef->call_tuple(std::move(args));
+        handlerRef->instrumentation.get().recordFire(enqueueTime, started, detail::instrumentationClock());
+        return;
+      }
+#endif
+      // call event handlers. The event is fired only once, so the last handler may consume the arguments.
+      handlerRef->call_tuple(std::move(args));
     }
 
     virtual const SubscriberCollectionBase* getSubscribers() const
     {
       return handlerRef;
     }
+
+    // access the event arguments
+    std::tuple<Args...>& getArgs()
+    {
+      return args;
+    }
+
+    // overwrite the event arguments. Returns false if the argument types allow neither
+    // move assignment nor non-throwing move construction.
+    bool replaceArgs(std::tuple<Args...>& newArgs)
+    {
+      return replaceArgs(newArgs,
+          std::integral_constant<bool, std::is_move_assignable<std::tuple<Args...>>::value>(),
+          std::integral_constant<bool, std::is_nothrow_move_constructible<std::tuple<Args...>>::value>());
+    }
+
+  private:
+    template<bool nothrowConstructible>
+    bool replaceArgs(std::tuple<Args...>& newArgs, std::true_type, std::integral_constant<bool, nothrowConstructible>)
+    {
+      args = std::move(newArgs);
+      return true;
+    }
+
+    bool replaceArgs(std::tuple<Args...>& newArgs, std::false_type, std::true_type)
+    {
+      // can't fail halfway, the argument types can't throw on move
+      args.~tuple();
+      new (&args) std::tuple<Args...>(std::move(newArgs));
+      return true;
+    }
+
+    bool replaceArgs(std::tuple<Args...>&, std::false_type, std::false_type)
+    {
+      return false;
+    }
   };
 
   /*
-   * Uses a single-linked list to store the events.
+   * Uses a double-linked list per priority lane to store the events.
    *
    * This allows for fast insertions at the queue tail as well for
    * an efficient get-and-clear operation during the process method.
+   * The prev links allow to remove events for a single topic from the middle.
    *
    * For every event added to the queue, we need to allocate memory
    * for the queue node. In case of the event queue, we need to do
@@ -130,168 +408,1667 @@ private:
    * Thus, this approach is more efficient than a std container,
    * which would only be able to store pointers to queued event objects.
    *
+   * The node memory is taken from a pool, which can be pre-filled
+   * using reserve(). Nodes must be created with createEvent() and
+   * destroyed with destroyEvent().
+   *
    */
-  // head
-  QueuedEventBase* eventQueueHead;
-  // tail
-  QueuedEventBase* eventQueueTail;
+  // head per lane, indexed by EventPriority
+  QueuedEventBase* eventQueueHead[eventPriorityCount];
+  // tail per lane
+  QueuedEventBase* eventQueueTail[eventPriorityCount];
 
-  // mutex guarding the event queue
-  // TODO maybe use a timed mutex here
-  mutable std::recursive_mutex queueMutex;
-
-public:
-  /// @brief Create an empty event queue.
-  EventQueue() :
-      eventQueueHead(NULL), eventQueueTail(NULL)
+  /*
+   * Lane scheduling. Without weights, the highest non-empty lane is serviced. With weights,
+   * lanes are visited round robin, taking up to weight events from each lane per visit.
+   */
+  struct LaneSchedule
   {
-  }
+    // current lane
+    unsigned int lane;
+    // events left to take from the current lane
+    unsigned int credit;
+  };
+  // events per visit for each lane, all zero for strict priorities
+  unsigned int laneWeights[eventPriorityCount];
+  // schedule state of processOne()
+  LaneSchedule processOneSchedule;
 
-  /**
-   * @brief Destroy the event queue.
-   *
-   * Any unprocessed events are discarded.
-   */
-  ~EventQueue()
+  // select the lane to take the next event from, or eventPriorityCount if all are empty.
+  unsigned int selectLane(QueuedEventBase* const* heads, LaneSchedule& schedule) const
   {
-    // destroy unhandled events if any
-    if (eventQueueHead != NULL)
+    if (laneWeights[0] == 0)
     {
-      printf("Warning: destroying EventQueue while some events are still "
-          "queued. Unhandled events will be discarded.\n");
-
-      QueuedEventBase* cur = eventQueueHead;
-      while (cur != NULL)
+      // strict
+      for (unsigned int lane = 0; lane < eventPriorityCount; ++lane)
       {
-        QueuedEventBase* next = cur->next;
-        delete cur;
-        cur = next;
+        if (heads[lane] != NULL)
+        {
+          return lane;
+        }
+      }
+      return eventPriorityCount;
+    }
+    // weighted round robin. Visit every lane at most once, plus the current lane again.
+    for (unsigned int i = 0; i <= eventPriorityCount; ++i)
+    {
+      if (schedule.credit > 0 && heads[schedule.lane] != NULL)
+      {
+        schedule.credit--;
+        return schedule.lane;
       }
+      schedule.lane = (schedule.lane + 1) % eventPriorityCount;
+      schedule.credit = laneWeights[schedule.lane];
     }
+    return eventPriorityCount;
   }
 
-  /**
-   * @brief Enqueue an event using the specified arguments.
-   *
-   * The event is added to the tail of the queue.
-   *
-   * @tparam Args event argument types
+  /*
+   * Per-topic index, used by processForSubscribers() to find the events for one subscriber
+   * collection without scanning the whole queue. Each topic has a double-linked chain through
+   * QueuedEventBase::topicNext, in the order the events were queued, regardless of their lanes.
    *
-   * @param handlerRef event handler collection
-   * @param args event argument values
+   * Entries are never removed. Instead, detaching the whole queue increments topicGeneration,
+   * which invalidates all chains at once. The topic limit is kept across generations.
    */
-  template<typename ...Args>
-  void enqueue(const SubscriberCollection<typename std::decay<Args>::type...>* handlerRef, Args ... args)
+  struct TopicQueue
   {
-    enqueue_tuple(handlerRef, std::make_tuple(args...));
+    QueuedEventBase* head;
+    QueuedEventBase* tail;
+    // number of events in the chain
+    std::size_t count;
+    unsigned long generation;
+    // topic limit, zero means unbounded
+    std::size_t capacity;
+    OverflowPolicy policy;
+  };
+  std::unordered_map<const SubscriberCollectionBase*, TopicQueue> topicQueues;
+  unsigned long topicGeneration;
+  // last looked up topic, since consecutive events often share it. Map elements have stable addresses.
+  const SubscriberCollectionBase* lastTopicKey;
+  TopicQueue* lastTopic;
+
+  // mutex guarding the event queue and the topic index
+  // TODO maybe use a timed mutex here
+  mutable std::recursive_mutex queueMutex;
+
+  // get the event chain for the given subscribers. queueMutex must be held.
+  TopicQueue& getTopicQueue(const SubscriberCollectionBase* subscribers)
+  {
+    if (lastTopic == NULL || lastTopicKey != subscribers)
+    {
+      lastTopic = &topicQueues[subscribers];
+      lastTopicKey = subscribers;
+    }
+    if (lastTopic->generation != topicGeneration)
+    {
+      // stale entry
+      lastTopic->head = NULL;
+      lastTopic->tail = NULL;
+      lastTopic->count = 0;
+      lastTopic->generation = topicGeneration;
+    }
+    return *lastTopic;
   }
 
-  /**
-   * @brief Enqueue an event, extracting event arguments from the given tuple.
-   *
-   * The event is added to the tail of the queue.
-   *
-   * @tparam Args event argument types
-   *
-   * @param handlerRef event handler collection
-   * @param args event argument values
-   */
-  template<typename ...Args>
-  void enqueue_tuple(const SubscriberCollection<Args...>* handlerRef,
-      std::tuple<Args...> args)
+  // append an event to the queue and the index. queueMutex must be held.
+  void linkEvent(QueuedEventBase* event, const SubscriberCollectionBase* subscribers)
   {
-    // create queued event object
-    auto* event = new QueuedEvent<Args...>(handlerRef, args);
+    // may allocate, so do this before modifying anything
+    TopicQueue& topic = getTopicQueue(subscribers);
 
-    // aquire mutex, freed automatically on return
-    std::lock_guard<std::recursive_mutex> guard(queueMutex);
+    unsigned int lane = event->priority;
+    event->next = NULL;
+    event->prev = eventQueueTail[lane];
+    if (eventQueueHead[lane] == NULL)
+    {
+      eventQueueHead[lane] = event;
+    }
+    else
+    {
+      eventQueueTail[lane]->next = event;
+    }
+    eventQueueTail[lane] = event;
 
-    // push on queue
-    if (eventQueueHead == NULL)
+    event->topicNext = NULL;
+    event->topicPrev = topic.tail;
+    if (topic.head == NULL)
     {
-      eventQueueHead = event;
+      topic.head = event;
     }
     else
     {
-      eventQueueTail->next = event;
+      topic.tail->topicNext = event;
     }
-    eventQueueTail = event;
+    topic.tail = event;
+    topic.count++;
   }
 
-  /**
-   * @brief Process all events in the queue.
-   *
-   * Will ignore events that get queued during processing.
-   *
-   * @return false if the queue was empty.
-   */
-  bool process()
+  // remove an event from its lane, but not from the index. queueMutex must be held.
+  void unlinkFromLane(QueuedEventBase* event)
   {
-    // unique_lock makes sure exceptions are handled
-    std::unique_lock<std::recursive_mutex> guard(queueMutex, std::defer_lock);
-    // aquire mutex
-    // TODO maybe a timed try-lock, to ensure the main loop isn't blocked forever.
-    guard.lock();
-    // grab queue
-    QueuedEventBase* cur = eventQueueHead;
-    if (cur == NULL)
+    unsigned int lane = event->priority;
+    if (event->prev != NULL)
     {
-      // queue is empty
-      return false;
+      event->prev->next = event->next;
     }
-
-    // and clear head/tail references, thus the queue is empty now
-    eventQueueHead = NULL;
-    eventQueueTail = NULL;
-
-    // now the queue is detached from this, so we can unlock.
-    guard.unlock();
-
-    // loop through event queue
-    while (cur != NULL)
+    else
     {
-      // fire event to handlers
-      cur->fire();
-      // delete event object
-      QueuedEventBase* next = cur->next;
-
-      delete cur;
-      cur = next;
+      eventQueueHead[lane] = event->next;
+    }
+    if (event->next != NULL)
+    {
+      event->next->prev = event->prev;
+    }
+    else
+    {
+      eventQueueTail[lane] = event->prev;
     }
-    return true;
   }
 
-  /**
-   * @brief Process all events in the queue. If more events are queued during processing, they are picked up as well.
-   */
-  int processUntilEmpty(int maxProcessCalls=-1)
+  // move an event to the tail of a higher priority lane, e.g. when a merged publish had a higher
+  // priority. The index order is kept. queueMutex must be held.
+  void raisePriority(QueuedEventBase* event, EventPriority priority)
   {
-    int nProcessCalls = 0;
-    bool entriesInQueue = true;
-
-    // simply call process until the queue is empty.
-    while (entriesInQueue)
+    unsigned int lane = static_cast<unsigned int>(priority);
+    if (lane >= event->priority)
     {
-      if ((maxProcessCalls!=-1) && (nProcessCalls == maxProcessCalls))
-      {
-        break;
-      }
-
-      entriesInQueue = process();
+      return;
+    }
+    unlinkFromLane(event);
+    event->priority = lane;
+    event->next = NULL;
+    event->prev = eventQueueTail[lane];
+    if (eventQueueHead[lane] == NULL)
+    {
+      eventQueueHead[lane] = event;
+    }
+    else
+    {
+      eventQueueTail[lane]->next = event;
+    }
+    eventQueueTail[lane] = event;
+  }
 
-      if (!entriesInQueue)
-      {
-        break;
-      }
+  // remove an event from the queue and the index. queueMutex must be held.
+  void unlinkEvent(QueuedEventBase* event)
+  {
+    unlinkFromLane(event);
 
-      nProcessCalls++;
+    TopicQueue& topic = getTopicQueue(event->getSubscribers());
+    if (event->topicPrev != NULL)
+    {
+      event->topicPrev->topicNext = event->topicNext;
     }
-
-    return nProcessCalls;
+    else
+    {
+      topic.head = event->topicNext;
+    }
+    if (event->topicNext != NULL)
+    {
+      event->topicNext->topicPrev = event->topicPrev;
+    }
+    else
+    {
+      topic.tail = event->topicPrev;
+    }
+    topic.count--;
   }
 
-  /**
-   * @brief Process the first queued event, if any.
+  // remove all events from the queue and store the first one of each lane in heads.
+  // returns false if the queue was empty. queueMutex must be held.
+  bool detachAll(QueuedEventBase** heads)
+  {
+    bool found = false;
+    for (unsigned int lane = 0; lane < eventPriorityCount; ++lane)
+    {
+      heads[lane] = eventQueueHead[lane];
+      found = found || heads[lane] != NULL;
+      eventQueueHead[lane] = NULL;
+      eventQueueTail[lane] = NULL;
+    }
+    // invalidate the index
+    topicGeneration++;
+    return found;
+  }
+
+  // destroy all events in the given lanes without firing them
+  void discardAll(QueuedEventBase** heads)
+  {
+    for (unsigned int lane = 0; lane < eventPriorityCount; ++lane)
+    {
+      discardChain(heads[lane]);
+    }
+  }
+
+  // destroy the events of a detached chain linked through next, without firing them
+  void discardChain(QueuedEventBase* cur)
+  {
+    while (cur != NULL)
+    {
+      countDiscarded();
+      QueuedEventBase* next = cur->next;
+      destroyEvent(cur);
+      cur = next;
+    }
+  }
+
+  // synchronization strategy
+  const EventQueueMode mode;
+
+  // memory for queued event nodes
+  detail::QueuedEventPool pool;
+
+  // allocate and construct a queued event node
+  template<typename ...Args>
+  QueuedEvent<Args...>* createEvent(const SubscriberCollection<Args...>* handlerRef, std::tuple<Args...>&& args,
+      EventPriority priority)
+  {
+    void* mem = pool.allocate(sizeof(QueuedEvent<Args...>));
+    try
+    {
+      auto* event = new (mem) QueuedEvent<Args...>(handlerRef, std::move(args));
+      event->priority = static_cast<unsigned int>(priority);
+#if ES_ENABLE_INSTRUMENTATION
+      if (isInstrumentationEnabled())
+      {
+        event->enqueueTime = detail::instrumentationClock();
+        handlerRef->instrumentation.get().recordPublish(event->enqueueTime);
+      }
+#endif
+      return event;
+    }
+    catch (...)
+    {
+      pool.release(mem);
+      throw;
+    }
+  }
+
+  // destruct and free a queued event node.
+  // QueuedEventBase is the only base of every node, so it's address is the node address.
+  void destroyEvent(QueuedEventBase* event)
+  {
+    event->~QueuedEventBase();
+    pool.release(event);
+  }
+
+  /*
+   * In LOCK_FREE mode, producers don't touch the lanes. Instead, they push onto
+   * this intrusive stack with a CAS loop. The consumer side detaches the whole stack with
+   * a single exchange and appends it to the lanes in reverse, thus restoring the
+   * FIFO order. In LOCKING mode, the stack is always empty.
+   */
+  std::atomic<QueuedEventBase*> pendingStack;
+
+  // move all events from the pending stack to the tail of the queue. queueMutex must be held.
+  void takePending()
+  {
+    QueuedEventBase* cur = pendingStack.exchange(NULL, std::memory_order_acquire);
+    if (cur == NULL)
+    {
+      return;
+    }
+    // reverse the stack, so that the oldest event comes first
+    QueuedEventBase* first = NULL;
+    while (cur != NULL)
+    {
+      QueuedEventBase* next = cur->next;
+      cur->next = first;
+      first = cur;
+      cur = next;
+    }
+    // append to queue
+    while (first != NULL)
+    {
+      QueuedEventBase* next = first->next;
+      linkEvent(first, first->getSubscribers());
+      first = next;
+    }
+  }
+
+  /*
+   * Event counters. They are only updated with relaxed atomic operations, thus reading them
+   * never blocks producers or consumers. The depth is incremented before an event is linked
+   * into the queue and decremented before it is fired, so it can't underflow.
+   */
+  // number of queued events
+  std::atomic<std::size_t> queueDepth;
+  // maximum of queueDepth
+  std::atomic<std::size_t> maxQueueDepth;
+  // total counts
+  std::atomic<unsigned long long> enqueuedCount;
+  std::atomic<unsigned long long> processedCount;
+  std::atomic<unsigned long long> discardedCount;
+  std::atomic<unsigned long long> rejectedCount;
+  std::atomic<unsigned long long> conflatedCount;
+
+  // update counters for events about to be added
+  void countEnqueued(std::size_t count = 1)
+  {
+    std::size_t depth = queueDepth.fetch_add(count, std::memory_order_relaxed) + count;
+    enqueuedCount.fetch_add(count, std::memory_order_relaxed);
+    std::size_t maxDepth = maxQueueDepth.load(std::memory_order_relaxed);
+    while (depth > maxDepth
+        && !maxQueueDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed));
+  }
+
+  // update counters for an event about to be fired
+  void countProcessed()
+  {
+    queueDepth.fetch_sub(1);
+    processedCount.fetch_add(1, std::memory_order_relaxed);
+    notifySpace();
+  }
+
+  // update counters for an event that is dropped
+  void countDiscarded()
+  {
+    queueDepth.fetch_sub(1);
+    discardedCount.fetch_add(1, std::memory_order_relaxed);
+    notifySpace();
+  }
+
+  /*
+   * Capacity limits. They are configured before the queue is used concurrently, so they
+   * are not synchronized. If any limit is set, enqueuing always takes queueMutex.
+   */
+  // queue-wide limit on queueDepth, zero means unbounded
+  std::size_t capacity;
+  OverflowPolicy overflowPolicy;
+  // maximum time to block in OverflowPolicy::BLOCK, negative means forever
+  std::chrono::milliseconds blockTimeout;
+  // number of topics with a limit
+  std::size_t limitedTopics;
+
+  /*
+   * Producers blocked by OverflowPolicy::BLOCK sleep on spaceCondition. Consumers only touch
+   * spaceMutex if a producer is blocked. Producers never hold spaceMutex and queueMutex at once.
+   */
+  std::mutex spaceMutex;
+  std::condition_variable spaceCondition;
+  // number of blocked producers
+  std::atomic<unsigned int> blockedProducers;
+  // incremented whenever an event leaves the queue while producers are blocked
+  std::atomic<unsigned long> spaceCounter;
+
+  // wake blocked producers after an event was removed
+  void notifySpace()
+  {
+    // sequentially consistent, pairs with the fetch_add in enqueueLimited()
+    if (blockedProducers.load() != 0)
+    {
+      spaceCounter.fetch_add(1);
+      std::lock_guard<std::mutex> lock(spaceMutex);
+      spaceCondition.notify_all();
+    }
+  }
+
+  // decide how an event is added under capacity limits or conflation, merging or dropping as needed.
+  // Returns TIMED_OUT if the event has to wait for space. An unlinked event to destroy is stored in
+  // dropped. queueMutex must be held, and the pending events must be taken.
+  template<typename ...Args>
+  PublishStatus admitLimited(const SubscriberCollection<Args...>* handlerRef, std::tuple<Args...>& args,
+      EventPriority priority, QueuedEventBase*& dropped)
+  {
+    TopicQueue& topic = getTopicQueue(handlerRef);
+    bool topicFull = topic.capacity != 0 && topic.count >= topic.capacity;
+    bool queueFull = capacity != 0 && queueDepth.load() >= capacity;
+    OverflowPolicy policy = topicFull ? topic.policy : overflowPolicy;
+
+    if (topic.tail != NULL && handlerRef->isConflating()
+        && static_cast<QueuedEvent<Args...>*>(topic.tail)->replaceArgs(args))
+    {
+      // latest-value event, merge into the queued one. Doesn't need any space.
+      raisePriority(topic.tail, priority);
+      return PublishStatus::CONFLATED;
+    }
+    if (!topicFull && !queueFull)
+    {
+      return PublishStatus::QUEUED;
+    }
+    if (policy == OverflowPolicy::DROP_NEWEST)
+    {
+      return PublishStatus::DROPPED;
+    }
+    if (policy == OverflowPolicy::DROP_OLDEST)
+    {
+      // the oldest event of the topic, or the oldest one of the lowest non-empty lane
+      if (topicFull)
+      {
+        dropped = topic.head;
+      }
+      for (unsigned int lane = eventPriorityCount; dropped == NULL && lane > 0; --lane)
+      {
+        dropped = eventQueueHead[lane - 1];
+      }
+      if (dropped == NULL)
+      {
+        // all events are currently being processed
+        return PublishStatus::DROPPED;
+      }
+      unlinkEvent(dropped);
+      return PublishStatus::QUEUED_DROPPING_OLDEST;
+    }
+    if (policy == OverflowPolicy::CONFLATE)
+    {
+      // events for the same subscribers have the same type
+      if (topic.tail != NULL && static_cast<QueuedEvent<Args...>*>(topic.tail)->replaceArgs(args))
+      {
+        raisePriority(topic.tail, priority);
+        return PublishStatus::CONFLATED;
+      }
+      // nothing to merge into
+      return PublishStatus::DROPPED;
+    }
+    return PublishStatus::TIMED_OUT;
+  }
+
+  // wait until an event leaves the queue, or until the block timeout from startTime expires. Returns
+  // false on timeout.
+  bool waitForSpace(unsigned long seenSpace, std::chrono::steady_clock::time_point startTime)
+  {
+    std::unique_lock<std::mutex> lock(spaceMutex);
+    auto hasSpace = [&] { return spaceCounter.load() != seenSpace; };
+    if (blockTimeout.count() < 0)
+    {
+      spaceCondition.wait(lock, hasSpace);
+      return true;
+    }
+    return spaceCondition.wait_until(lock, startTime + blockTimeout, hasSpace);
+  }
+
+  // count the outcome of a limited enqueue, except for the enqueued events
+  void countLimited(PublishStatus status)
+  {
+    switch (status)
+    {
+    case PublishStatus::QUEUED:
+    case PublishStatus::QUEUED_DROPPING_OLDEST:
+      break;
+    case PublishStatus::CONFLATED:
+      conflatedCount.fetch_add(1, std::memory_order_relaxed);
+      break;
+    default:
+      rejectedCount.fetch_add(1, std::memory_order_relaxed);
+      break;
+    }
+  }
+
+  // enqueue an event with capacity limits or conflation.
+  template<typename ...Args>
+  PublishResult enqueueLimited(const SubscriberCollection<Args...>* handlerRef, std::tuple<Args...>& args,
+      EventPriority priority)
+  {
+    QueuedEventBase* dropped = NULL;
+    bool announced = false;
+    auto startTime = std::chrono::steady_clock::now();
+    PublishStatus status = PublishStatus::TIMED_OUT;
+    while (true)
+    {
+      unsigned long seenSpace = spaceCounter.load();
+      {
+        std::lock_guard<std::recursive_mutex> guard(queueMutex);
+        takePending();
+
+        status = admitLimited(handlerRef, args, priority, dropped);
+        if (status == PublishStatus::TIMED_OUT && !announced)
+        {
+          // register as blocked, then check again. This way, a consumer either sees us or we see the space.
+          announced = true;
+          blockedProducers.fetch_add(1);
+          continue;
+        }
+
+        if (status == PublishStatus::QUEUED || status == PublishStatus::QUEUED_DROPPING_OLDEST)
+        {
+          QueuedEventBase* event = createEvent(handlerRef, std::move(args), priority);
+          try
+          {
+            linkEvent(event, handlerRef);
+          }
+          catch (...)
+          {
+            destroyEvent(event);
+            throw;
+          }
+          countEnqueued();
+        }
+      }
+
+      if (status != PublishStatus::TIMED_OUT || !waitForSpace(seenSpace, startTime))
+      {
+        break;
+      }
+    }
+
+    if (announced)
+    {
+      blockedProducers.fetch_sub(1);
+    }
+    if (dropped != NULL)
+    {
+      destroyEvent(dropped);
+      countDiscarded();
+    }
+
+    countLimited(status);
+    if (status == PublishStatus::QUEUED || status == PublishStatus::QUEUED_DROPPING_OLDEST)
+    {
+      notifyWaiters();
+    }
+    return status;
+  }
+
+  // enqueue a chain of already created events linked through next, like enqueueLimited() does for
+  // each of them, but taking the lock only once unless a producer has to block. The events are
+  // linked into the queue or destroyed, also if an exception is thrown. Returns the number of
+  // accepted events.
+  template<typename ...Args>
+  std::size_t enqueueChainLimited(const SubscriberCollection<Args...>* handlerRef, QueuedEventBase* cur,
+      EventPriority priority)
+  {
+    std::size_t accepted = 0;
+    std::size_t enqueued = 0;
+    // events that were merged, rejected or dropped, destroyed after unlocking
+    QueuedEventBase* spent = NULL;
+    QueuedEventBase* dropped = NULL;
+    bool announced = false;
+    auto startTime = std::chrono::steady_clock::now();
+    try
+    {
+      while (cur != NULL)
+      {
+        unsigned long seenSpace = spaceCounter.load();
+        bool blocked = false;
+        {
+          std::lock_guard<std::recursive_mutex> guard(queueMutex);
+          takePending();
+          while (cur != NULL)
+          {
+            QueuedEventBase* evicted = NULL;
+            PublishStatus status = admitLimited(handlerRef, static_cast<QueuedEvent<Args...>*>(cur)->getArgs(),
+                priority, evicted);
+            if (evicted != NULL)
+            {
+              evicted->next = dropped;
+              dropped = evicted;
+            }
+            if (status == PublishStatus::TIMED_OUT)
+            {
+              if (!announced)
+              {
+                // check again after registering as blocked, see enqueueLimited()
+                announced = true;
+                blockedProducers.fetch_add(1);
+                continue;
+              }
+              blocked = true;
+              break;
+            }
+
+            QueuedEventBase* next = cur->next;
+            if (status == PublishStatus::QUEUED || status == PublishStatus::QUEUED_DROPPING_OLDEST)
+            {
+              linkEvent(cur, handlerRef);
+              countEnqueued();
+              enqueued++;
+            }
+            else
+            {
+              countLimited(status);
+              cur->next = spent;
+              spent = cur;
+            }
+            if (status != PublishStatus::DROPPED)
+            {
+              accepted++;
+            }
+            cur = next;
+          }
+        }
+
+        if (blocked && !waitForSpace(seenSpace, startTime))
+        {
+          // this event timed out, the next one may wait again
+          countLimited(PublishStatus::TIMED_OUT);
+          QueuedEventBase* next = cur->next;
+          cur->next = spent;
+          spent = cur;
+          cur = next;
+          startTime = std::chrono::steady_clock::now();
+        }
+      }
+    }
+    catch (...)
+    {
+      // the events from cur on are neither linked nor counted
+      destroyChain(cur);
+      if (announced)
+      {
+        blockedProducers.fetch_sub(1);
+      }
+      destroyChain(spent);
+      discardChain(dropped);
+      if (enqueued != 0)
+      {
+        notifyWaiters();
+      }
+      throw;
+    }
+
+    if (announced)
+    {
+      blockedProducers.fetch_sub(1);
+    }
+    destroyChain(spent);
+    discardChain(dropped);
+    if (enqueued != 0)
+    {
+      notifyWaiters();
+    }
+    return accepted;
+  }
+
+  // destroy a chain of events linked through next, which were accounted for already
+  void destroyChain(QueuedEventBase* cur)
+  {
+    while (cur != NULL)
+    {
+      QueuedEventBase* next = cur->next;
+      destroyEvent(cur);
+      cur = next;
+    }
+  }
+
+  /*
+   * Blocking wait support. Producers only touch waitMutex if a consumer is actually waiting,
+   * so enqueuing stays cheap (and lock-free in LOCK_FREE mode) otherwise.
+   */
+  // guards waitCondition
+  std::mutex waitMutex;
+  // notified on enqueue while waitingThreads is non-zero
+  std::condition_variable waitCondition;
+  // number of threads blocked in wait()
+  std::atomic<unsigned int> waitingThreads;
+  // incremented by wakeUp() to release waiting threads
+  unsigned long wakeUpCounter;
+
+  // wake waiting threads after an event was added
+  void notifyWaiters()
+  {
+    // sequentially consistent, pairs with the fetch_add in wait()
+    if (waitingThreads.load() != 0)
+    {
+      // taking the mutex makes sure a waiter is either not yet checking or already sleeping
+      std::lock_guard<std::mutex> lock(waitMutex);
+      waitCondition.notify_all();
+    }
+  }
+
+  /*
+   * Scratch space for processParallel(). The detached queue is split into one chain
+   * per subscriber collection. The containers are kept to reuse their memory.
+   */
+  // first and last event of each chain
+  std::vector<std::pair<QueuedEventBase*, QueuedEventBase*>> parallelChains;
+  // chain index for each subscriber collection
+  std::unordered_map<const SubscriberCollectionBase*, std::size_t> parallelChainIndex;
+  // guards the scratch space, serializes processParallel() calls
+  std::mutex parallelMutex;
+
+  // receives every published event, see setRecorder(). Not owned.
+  std::atomic<EventRecorderBase*> recorder;
+
+  // pass a published event to the recorder, if any
+  template<typename ...Args>
+  void recordEvent(const SubscriberCollection<Args...>* handlerRef, const std::tuple<Args...>& args,
+      EventPriority priority)
+  {
+    EventRecorderBase* rec = recorder.load(std::memory_order_acquire);
+    if (rec != NULL)
+    {
+      rec->recordEvent(handlerRef, &args, priority);
+    }
+  }
+
+  /*
+   * Timed events. They are kept in a hierarchical timer wheel with a resolution of timerResolution,
+   * and moved into the queue by processTimers(), which process() and wait() call.
+   */
+  typedef std::chrono::milliseconds TimerResolution;
+
+  // a scheduled event
+  struct TimerBase : public detail::TimerWheelEntry
+  {
+    TimerBase() :
+        id(0), period(0)
+    {
+    }
+    unsigned long long id;
+    // period in ticks, or 0 for a single event
+    std::uint64_t period;
+
+    // enqueue the event, moving the arguments out if this is the last time
+    virtual void release(EventQueue& queue, bool last) = 0;
+  };
+
+  template<typename ...Args>
+  struct Timer : public TimerBase
+  {
+    Timer(const SubscriberCollection<Args...>* handlerRef, std::tuple<Args...>&& args, EventPriority priority) :
+        handlerRef(handlerRef), args(std::move(args)), priority(priority)
+    {
+    }
+    const SubscriberCollection<Args...>* handlerRef;
+    std::tuple<Args...> args;
+    EventPriority priority;
+
+    virtual void release(EventQueue& queue, bool last)
+    {
+      if (last)
+      {
+        queue.enqueueTimed(handlerRef, std::move(args), priority);
+      }
+      else
+      {
+        releaseCopy(queue, std::integral_constant<bool, detail::all_copy_constructible<Args...>::value>());
+      }
+    }
+
+  private:
+    void releaseCopy(EventQueue& queue, std::true_type)
+    {
+      queue.enqueueTimed(handlerRef, std::tuple<Args...>(args), priority);
+    }
+    void releaseCopy(EventQueue&, std::false_type)
+    {
+      // enqueuePeriodic() rejects move-only arguments at compile time
+      throw std::logic_error("Periodic events need copyable arguments");
+    }
+  };
+
+  // guards the fields below
+  std::mutex timerMutex;
+  // pending timers
+  detail::TimerWheel timerWheel;
+  // all timers by id, owned
+  std::unordered_map<unsigned long long, TimerBase*> timersById;
+  // time point of tick 0
+  const std::chrono::steady_clock::time_point timerOrigin;
+  // number of timers, read without the lock to skip processTimers() quickly
+  std::atomic<std::size_t> timerCount;
+  // incremented when a timer is scheduled, so waiting threads recompute their deadline
+  std::atomic<unsigned long> timerGeneration;
+
+  // first tick at or after the given time
+  std::uint64_t timerTick(std::chrono::steady_clock::time_point time) const
+  {
+    if (time <= timerOrigin)
+    {
+      return 0;
+    }
+    auto ticks = std::chrono::duration_cast<TimerResolution>(time - timerOrigin);
+    if (timerOrigin + ticks < time)
+    {
+      ticks += TimerResolution(1);
+    }
+    return static_cast<std::uint64_t>(ticks.count());
+  }
+
+  // create a timer id. The ids are unique across all queues, so that the queue holding a timer can
+  // be found by trying them all.
+  static unsigned long long nextTimerId()
+  {
+    static std::atomic<unsigned long long> lastTimerId(0);
+    return ++lastTimerId;
+  }
+
+  // add a timer to the wheel and take ownership
+  TimerHandle scheduleTimer(TimerBase* timer, std::chrono::steady_clock::time_point deadline)
+  {
+    TimerHandle handle;
+    {
+      std::lock_guard<std::mutex> lock(timerMutex);
+      try
+      {
+        handle = TimerHandle(nextTimerId());
+        timer->id = handle.getId();
+        timer->tick = timerTick(deadline);
+        timersById[timer->id] = timer;
+      }
+      catch (...)
+      {
+        delete timer;
+        throw;
+      }
+      timerWheel.insert(timer);
+      timerCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    // let waiting threads sleep until the new deadline, if it is earlier
+    timerGeneration.fetch_add(1);
+    notifyWaiters();
+    return handle;
+  }
+
+  // enqueue a due timed event, to the queues with pinned subscribers as well. Capacity limits and
+  // conflation don't apply, since this runs on the consumer side
+  template<typename ...Args>
+  void enqueueTimed(const SubscriberCollection<Args...>* handlerRef, std::tuple<Args...>&& args,
+      EventPriority priority)
+  {
+    recordEvent(handlerRef, args, priority);
+    enqueueToRoutes(handlerRef, std::move(args), priority, false);
+  }
+
+  // fire and destroy all events of a parallel chain
+  void processChain(std::size_t chainIdx)
+  {
+    QueuedEventBase* cur = parallelChains[chainIdx].first;
+    try
+    {
+      while (cur != NULL)
+      {
+        countProcessed();
+        cur->fire();
+        QueuedEventBase* next = cur->next;
+        destroyEvent(cur);
+        cur = next;
+      }
+    }
+    catch (...)
+    {
+      // drop the rest of the chain, later events of this topic must not overtake the failed one
+      QueuedEventBase* next = cur->next;
+      destroyEvent(cur);
+      discardChain(next);
+      throw;
+    }
+  }
+
+public:
+  /**
+   * @brief Create an empty event queue.
+   *
+   * @param mode synchronization strategy of the queue.
+   */
+  explicit EventQueue(EventQueueMode mode = EventQueueMode::LOCKING) :
+      topicGeneration(0), lastTopicKey(NULL),
+      lastTopic(NULL), mode(mode), pendingStack(NULL), queueDepth(0), maxQueueDepth(0),
+      enqueuedCount(0), processedCount(0), discardedCount(0), rejectedCount(0), conflatedCount(0), capacity(0),
+      overflowPolicy(OverflowPolicy::BLOCK), blockTimeout(-1), limitedTopics(0), blockedProducers(0),
+      spaceCounter(0), waitingThreads(0), wakeUpCounter(0), recorder(NULL),
+      timerOrigin(std::chrono::steady_clock::now()), timerCount(0), timerGeneration(0)
+  {
+    for (unsigned int lane = 0; lane < eventPriorityCount; ++lane)
+    {
+      eventQueueHead[lane] = NULL;
+      eventQueueTail[lane] = NULL;
+      laneWeights[lane] = 0;
+    }
+    processOneSchedule.lane = 0;
+    processOneSchedule.credit = 0;
+  }
+
+  /**
+   * @brief Get the synchronization strategy selected on construction.
+   */
+  EventQueueMode getMode() const
+  {
+    return mode;
+  }
+
+  /**
+   * @brief Destroy the event queue.
+   *
+   * Any unprocessed events are discarded.
+   */
+  ~EventQueue()
+  {
+    takePending();
+    // destroy unhandled events if any
+    QueuedEventBase* heads[eventPriorityCount];
+    if (detachAll(heads))
+    {
+      printf("Warning: destroying EventQueue while some events are still "
+          "queued. Unhandled events will be discarded.\n");
+
+      discardAll(heads);
+    }
+    for (auto& timer : timersById)
+    {
+      delete timer.second;
+    }
+  }
+
+  /**
+   * @brief Pre-allocate memory for queued events with the given argument types.
+   *
+   * Queued event nodes are allocated from a pool owned by this queue. Blocks that are not
+   * reserved upfront are allocated from the heap and freed again after processing. Thus, if enough
+   * blocks are reserved at startup, enqueuing and processing events does not allocate memory.
+   *
+   * Node memory is shared between events whose nodes are of similar size, so it is sufficient
+   * to reserve for one of them.
+   *
+   * @tparam Args event argument types
+   * @param count number of event nodes to reserve
+   */
+  template<typename ...Args>
+  void reserve(std::size_t count)
+  {
+    pool.reserve(sizeof(QueuedEvent<typename std::decay<Args>::type...>), count);
+  }
+
+  /**
+   * @brief Get the number of queued events whose memory could not be taken from the reserved pool.
+   *
+   * This can be used to check whether the reserved amount is sufficient.
+   */
+  std::size_t getHeapAllocationCount() const
+  {
+    return pool.getHeapAllocationCount();
+  }
+
+  /**
+   * @brief Limit the number of events in the queue.
+   *
+   * Events that are taken from the queue by process() count until they have been fired, so
+   * this bounds the memory used by queued events.
+   *
+   * Setting any limit makes enqueuing take the queue mutex, even in EventQueueMode::LOCK_FREE.
+   * The same applies to conflating events, see SubscriberCollectionBase::setConflating().
+   * The limits must be configured before events are enqueued concurrently.
+   *
+   * @param maxEvents maximum number of queued events, zero means unbounded.
+   * @param policy what to do if an event is enqueued while the queue is full.
+   */
+  void setCapacity(std::size_t maxEvents, OverflowPolicy policy = OverflowPolicy::BLOCK)
+  {
+    std::lock_guard<std::recursive_mutex> guard(queueMutex);
+    capacity = maxEvents;
+    overflowPolicy = policy;
+  }
+
+  /**
+   * @brief Limit the number of queued events for a single topic.
+   *
+   * Unlike the queue-wide limit, only events that are still waiting in the queue count.
+   * If both limits are reached, the policy of the topic is used.
+   *
+   * See setCapacity() for the threading restrictions.
+   *
+   * @param subscribers subscriber collection of the topic
+   * @param maxEvents maximum number of queued events for the topic, zero means unbounded.
+   * @param policy what to do if an event is enqueued while the topic is full.
+   */
+  void setTopicCapacity(const SubscriberCollectionBase* subscribers, std::size_t maxEvents,
+      OverflowPolicy policy = OverflowPolicy::BLOCK)
+  {
+    std::lock_guard<std::recursive_mutex> guard(queueMutex);
+    TopicQueue& topic = getTopicQueue(subscribers);
+    if (topic.capacity == 0 && maxEvents != 0)
+    {
+      limitedTopics++;
+    }
+    else if (topic.capacity != 0 && maxEvents == 0)
+    {
+      limitedTopics--;
+    }
+    topic.capacity = maxEvents;
+    topic.policy = policy;
+  }
+
+  /**
+   * @brief Set the maximum time a producer blocks with OverflowPolicy::BLOCK.
+   *
+   * By default, producers block until there is space. Note that this deadlocks if a subscriber
+   * of the queue itself publishes to a full queue, so consider a timeout in that case.
+   *
+   * @param timeout maximum time to block, negative to block forever.
+   */
+  void setBlockTimeout(std::chrono::milliseconds timeout)
+  {
+    std::lock_guard<std::recursive_mutex> guard(queueMutex);
+    blockTimeout = timeout;
+  }
+
+  /**
+   * @brief Get the queue-wide limit set by setCapacity(), zero if unbounded.
+   */
+  std::size_t getCapacity() const
+  {
+    return capacity;
+  }
+
+  /**
+   * @brief Service the priority lanes by weighted round robin.
+   *
+   * process() and processOne() visit the lanes in priority order, taking up to the given number
+   * of events from each lane per visit. This bounds the latency of lower priorities while
+   * higher priorities are busy. Within each lane, events are still processed in FIFO order.
+   *
+   * @throws std::invalid_argument if any weight is zero.
+   */
+  void setPriorityWeights(unsigned int critical, unsigned int high, unsigned int normal, unsigned int low)
+  {
+    if (critical == 0 || high == 0 || normal == 0 || low == 0)
+    {
+      throw std::invalid_argument("Priority weights must be positive");
+    }
+    std::lock_guard<std::recursive_mutex> guard(queueMutex);
+    laneWeights[static_cast<unsigned int>(EventPriority::CRITICAL)] = critical;
+    laneWeights[static_cast<unsigned int>(EventPriority::HIGH)] = high;
+    laneWeights[static_cast<unsigned int>(EventPriority::NORMAL)] = normal;
+    laneWeights[static_cast<unsigned int>(EventPriority::LOW)] = low;
+    processOneSchedule.lane = 0;
+    processOneSchedule.credit = critical;
+  }
+
+  /**
+   * @brief Service the priority lanes strictly, which is the default.
+   *
+   * Events of a lower priority are only processed once there are no events of higher priorities.
+   */
+  void setStrictPriorities()
+  {
+    std::lock_guard<std::recursive_mutex> guard(queueMutex);
+    for (unsigned int lane = 0; lane < eventPriorityCount; ++lane)
+    {
+      laneWeights[lane] = 0;
+    }
+  }
+
+  /**
+   * @brief Enqueue an event using the specified arguments.
+   *
+   * The event is added to the tail of the queue lane for the default priority of the subscriber collection.
+   * The argument values are moved into the queue, so passing rvalues avoids copying them.
+   *
+   * @tparam Args event argument types
+   *
+   * @param handlerRef event handler collection
+   * @param args event argument values
+   * @return whether the event was queued, see PublishStatus.
+   */
+  template<typename ...Args>
+  PublishResult enqueue(const SubscriberCollection<typename std::decay<Args>::type...>* handlerRef, Args ... args)
+  {
+    return enqueue_tuple(handlerRef, std::tuple<typename std::decay<Args>::type...>(std::move(args)...),
+        handlerRef->getPriority());
+  }
+
+  /**
+   * @brief Enqueue an event, extracting event arguments from the given tuple.
+   *
+   * The event is added to the tail of the queue lane for the default priority of the subscriber collection.
+   * The tuple is moved into the queue.
+   *
+   * @tparam Args event argument types
+   *
+   * @param handlerRef event handler collection
+   * @param args event argument values
+   * @return whether the event was queued, see PublishStatus.
+   */
+  template<typename ...Args>
+  PublishResult enqueue_tuple(const SubscriberCollection<Args...>* handlerRef,
+      std::tuple<Args...> args)
+  {
+    return enqueue_tuple(handlerRef, std::move(args), handlerRef->getPriority());
+  }
+
+  /**
+   * @brief Enqueue an event with the given priority, extracting event arguments from the given tuple.
+   *
+   * The event is added to the tail of the queue lane for the priority. The tuple is moved into the queue.
+   *
+   * If the queue or the topic is full, the configured OverflowPolicy is applied.
+   *
+   * @tparam Args event argument types
+   *
+   * @param handlerRef event handler collection
+   * @param args event argument values
+   * @param priority event priority
+   * @return whether the event was queued, see PublishStatus.
+   */
+  template<typename ...Args>
+  PublishResult enqueue_tuple(const SubscriberCollection<Args...>* handlerRef,
+      std::tuple<Args...> args, EventPriority priority)
+  {
+    recordEvent(handlerRef, args, priority);
+    return enqueueUnrecorded(handlerRef, std::move(args), priority);
+  }
+
+  /**
+   * @brief Enqueue an event to this queue and to the queues with pinned subscribers.
+   *
+   * Events with subscribers pinned to other queues, see EventSystem::subscribeOn(), are added to
+   * every such queue that has pinned subscribers. They are only added to this queue if the event has
+   * subscribers of it's own, or if no pinned subscriber receives them. Without pinned subscribers,
+   * this is the same as enqueue_tuple().
+   *
+   * @tparam Args event argument types
+   *
+   * @param handlerRef event handler collection
+   * @param args event argument values
+   * @param priority event priority
+   * @return whether the event was queued, see PublishStatus. If the event was added to several
+   *         queues, the event counts as queued if any queue accepted it.
+   */
+  template<typename ...Args>
+  PublishResult enqueueRouted(const SubscriberCollection<Args...>* handlerRef,
+      std::tuple<Args...> args, EventPriority priority)
+  {
+    recordEvent(handlerRef, args, priority);
+    return enqueueToRoutes(handlerRef, std::move(args), priority, true);
+  }
+
+private:
+  // enqueue without recording, applying the capacity limits
+  template<typename ...Args>
+  PublishResult enqueueUnrecorded(const SubscriberCollection<Args...>* handlerRef,
+      std::tuple<Args...>&& args, EventPriority priority)
+  {
+    if (capacity != 0 || limitedTopics != 0 || handlerRef->isConflating())
+    {
+      return enqueueLimited(handlerRef, args, priority);
+    }
+    return enqueueUnlimited(handlerRef, std::move(args), priority);
+  }
+
+  // copy event arguments for another queue. Events with pinned subscribers are always copyable.
+  template<typename ...Args>
+  static std::tuple<Args...> copyArgs(const std::tuple<Args...>& args, std::true_type)
+  {
+    return args;
+  }
+  template<typename ...Args>
+  static std::tuple<Args...> copyArgs(const std::tuple<Args...>&, std::false_type)
+  {
+    throw std::logic_error("An event with move-only argument types cannot have subscribers on several queues.");
+  }
+
+  // add an event to this queue and to the queues with pinned subscribers, see enqueueRouted().
+  // Does not record the event. The capacity limits only apply if limited is true.
+  template<typename ...Args>
+  PublishResult enqueueToRoutes(const SubscriberCollection<Args...>* handlerRef,
+      std::tuple<Args...>&& args, EventPriority priority, bool limited)
+  {
+    auto routes = handlerRef->getQueueRoutes();
+    if (routes == NULL || routes->pinned.empty())
+    {
+      return limited ? enqueueUnrecorded(handlerRef, std::move(args), priority)
+          : enqueueUnlimited(handlerRef, std::move(args), priority);
+    }
+
+    std::integral_constant<bool, detail::all_copy_constructible<Args...>::value> copyable;
+    PublishResult result = PublishStatus::NOT_REGISTERED;
+    bool delivered = false;
+    for (auto& route : routes->pinned)
+    {
+      if (route.second->getLocalHandlerCount() == 0)
+      {
+        continue;
+      }
+      PublishResult routeResult = limited
+          ? route.first->enqueueUnrecorded(route.second, copyArgs(args, copyable), priority)
+          : route.first->enqueueUnlimited(route.second, copyArgs(args, copyable), priority);
+      if (!delivered || (!result.isAccepted() && routeResult.isAccepted()))
+      {
+        result = routeResult;
+      }
+      delivered = true;
+    }
+    if (delivered && handlerRef->getLocalHandlerCount() == 0)
+    {
+      // only pinned subscribers
+      return result;
+    }
+
+    PublishResult ownResult = limited ? enqueueUnrecorded(handlerRef, std::move(args), priority)
+        : enqueueUnlimited(handlerRef, std::move(args), priority);
+    return !delivered || (!result.isAccepted() && ownResult.isAccepted()) ? ownResult : result;
+  }
+
+  // enqueue ignoring the capacity limits
+  template<typename ...Args>
+  PublishResult enqueueUnlimited(const SubscriberCollection<Args...>* handlerRef,
+      std::tuple<Args...>&& args, EventPriority priority)
+  {
+    // create queued event object
+    auto* event = createEvent(handlerRef, std::move(args), priority);
+    countEnqueued();
+
+    if (mode == EventQueueMode::LOCK_FREE)
+    {
+      // push on pending stack, the consumer will restore the order
+      QueuedEventBase* top = pendingStack.load(std::memory_order_relaxed);
+      do
+      {
+        event->next = top;
+      }
+      // sequentially consistent, so that notifyWaiters() can't miss a thread that just started waiting
+      while (!pendingStack.compare_exchange_weak(top, event, std::memory_order_seq_cst,
+          std::memory_order_relaxed));
+      notifyWaiters();
+      return PublishStatus::QUEUED;
+    }
+
+    {
+      // aquire mutex, freed automatically at end of scope
+      std::lock_guard<std::recursive_mutex> guard(queueMutex);
+
+      // push on queue
+      try
+      {
+        linkEvent(event, handlerRef);
+      }
+      catch (...)
+      {
+        countDiscarded();
+        destroyEvent(event);
+        throw;
+      }
+    }
+    notifyWaiters();
+    return PublishStatus::QUEUED;
+  }
+
+public:
+  /**
+   * @brief Schedule an event to be enqueued at the given point in time.
+   *
+   * The event is kept in a timer wheel with millisecond resolution, and is enqueued by the first
+   * processTimers() call after the deadline. process() and wait() do so automatically, and wait() sleeps
+   * at most until the next deadline. Thus, the event is never processed before the deadline, but may be
+   * processed later, depending on how often the queue is processed.
+   *
+   * When the event is due, it is enqueued with the given priority, and it is recorded if a recorder is set.
+   * Since this happens on the consumer side, capacity limits and conflation don't apply.
+   *
+   * @tparam Args event argument types
+   *
+   * @param handlerRef event handler collection
+   * @param deadline time at which the event becomes due
+   * @param args event argument values
+   * @param priority event priority
+   * @return a handle, which can be used to cancel the event.
+   */
+  template<typename ...Args>
+  TimerHandle enqueueAt(const SubscriberCollection<Args...>* handlerRef,
+      std::chrono::steady_clock::time_point deadline, std::tuple<Args...> args, EventPriority priority)
+  {
+    return scheduleTimer(new Timer<Args...>(handlerRef, std::move(args), priority), deadline);
+  }
+
+  /**
+   * @brief Schedule an event to be enqueued after the given delay, see enqueueAt().
+   *
+   * @tparam Args event argument types
+   *
+   * @param handlerRef event handler collection
+   * @param delay time until the event becomes due
+   * @param args event argument values
+   * @param priority event priority
+   * @return a handle, which can be used to cancel the event.
+   */
+  template<typename ...Args, typename Rep, typename Period>
+  TimerHandle enqueueAfter(const SubscriberCollection<Args...>* handlerRef,
+      const std::chrono::duration<Rep, Period>& delay, std::tuple<Args...> args, EventPriority priority)
+  {
+    return enqueueAt(handlerRef, std::chrono::steady_clock::now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay), std::move(args), priority);
+  }
+
+  /**
+   * @brief Schedule an event to be enqueued periodically, until it is cancelled.
+   *
+   * The event becomes due first at the given time, then once per period. Deadlines follow a
+   * fixed schedule, so delays in processing don't accumulate. If processing is late by more than a
+   * period, the missed events are skipped. See enqueueAt() for details.
+   *
+   * @tparam Args event argument types, must be copyable
+   *
+   * @param handlerRef event handler collection
+   * @param first time at which the event becomes due first
+   * @param period time between the events, at least one millisecond
+   * @param args event argument values, copied for each event
+   * @param priority event priority
+   * @return a handle, which can be used to cancel the events.
+   *
+   * @throws std::invalid_argument if the period is less than one millisecond.
+   */
+  template<typename ...Args, typename Rep, typename Period>
+  TimerHandle enqueuePeriodic(const SubscriberCollection<Args...>* handlerRef,
+      std::chrono::steady_clock::time_point first, const std::chrono::duration<Rep, Period>& period,
+      std::tuple<Args...> args, EventPriority priority)
+  {
+    static_assert(detail::all_copy_constructible<Args...>::value, "Periodic events need copyable arguments");
+    auto ticks = std::chrono::duration_cast<TimerResolution>(period).count();
+    if (ticks < 1)
+    {
+      throw std::invalid_argument("Timer period must be at least one millisecond");
+    }
+    Timer<Args...>* timer = new Timer<Args...>(handlerRef, std::move(args), priority);
+    timer->period = static_cast<std::uint64_t>(ticks);
+    return scheduleTimer(timer, first);
+  }
+
+  /**
+   * @brief Cancel a timed event scheduled with enqueueAt(), enqueueAfter() or enqueuePeriodic().
+   *
+   * Events that were already enqueued are not removed.
+   *
+   * @param timer handle returned when scheduling
+   * @return false if the timer already expired, or was cancelled before.
+   */
+  bool cancelTimer(TimerHandle timer)
+  {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    auto found = timersById.find(timer.getId());
+    if (found == timersById.end())
+    {
+      return false;
+    }
+    timerWheel.remove(found->second);
+    delete found->second;
+    timersById.erase(found);
+    timerCount.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief Get the number of scheduled timers, including periodic ones.
+   */
+  std::size_t getTimerCount() const
+  {
+    return timerCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Get the next point in time at which processTimers() may enqueue events.
+   *
+   * This is exact for deadlines in the next 64 milliseconds. Later deadlines are reported as
+   * the point where the timer wheel redistributes them.
+   *
+   * @param next set to the next time
+   * @return false if no timers are scheduled.
+   */
+  bool getNextTimerDeadline(std::chrono::steady_clock::time_point& next)
+  {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    std::uint64_t tick;
+    if (!timerWheel.getNextTick(tick))
+    {
+      return false;
+    }
+    next = timerOrigin + TimerResolution(tick);
+    return true;
+  }
+
+  /**
+   * @brief Enqueue all timed events that are due.
+   *
+   * Called by process(), processParallel() and wait(), so this is only needed for custom processing loops.
+   *
+   * @return number of enqueued events
+   */
+  std::size_t processTimers()
+  {
+    if (timerCount.load(std::memory_order_relaxed) == 0)
+    {
+      return 0;
+    }
+    std::lock_guard<std::mutex> lock(timerMutex);
+    auto elapsed = std::chrono::steady_clock::now() - timerOrigin;
+    std::uint64_t now = static_cast<std::uint64_t>(std::chrono::duration_cast<TimerResolution>(elapsed).count());
+    detail::TimerWheelEntry* due = timerWheel.advance(now);
+    std::size_t released = 0;
+    while (due != NULL)
+    {
+      TimerBase* timer = static_cast<TimerBase*>(due);
+      try
+      {
+        timer->release(*this, timer->period == 0);
+      }
+      catch (...)
+      {
+        // keep the failed and remaining timers, they are retried by the next call
+        while (due != NULL)
+        {
+          detail::TimerWheelEntry* next = due->next;
+          timerWheel.insert(due);
+          due = next;
+        }
+        throw;
+      }
+      due = due->next;
+      released++;
+      if (timer->period == 0)
+      {
+        timersById.erase(timer->id);
+        delete timer;
+        timerCount.fetch_sub(1, std::memory_order_relaxed);
+      }
+      else
+      {
+        // next deadline on the fixed schedule, skipping the missed ones
+        timer->tick += timer->period * ((now - timer->tick) / timer->period + 1);
+        timerWheel.insert(timer);
+      }
+    }
+    return released;
+  }
+
+  /**
+   * @brief Process all events in the queue.
+   *
+   * Will ignore events that get queued during processing.
+   *
+   * @return false if the queue was empty.
+   */
+  bool process()
+  {
+    processTimers();
+
+    // unique_lock makes sure exceptions are handled
+    std::unique_lock<std::recursive_mutex> guard(queueMutex, std::defer_lock);
+    // aquire mutex
+    // TODO maybe a timed try-lock, to ensure the main loop isn't blocked forever.
+    guard.lock();
+    takePending();
+    // grab queue, thus the queue is empty now
+    QueuedEventBase* heads[eventPriorityCount];
+    if (!detachAll(heads))
+    {
+      // queue is empty
+      return false;
+    }
+    LaneSchedule schedule = { 0, laneWeights[0] };
+
+    // now the queue is detached from this, so we can unlock.
+    guard.unlock();
+
+    // loop through event lanes
+    unsigned int lane;
+    while ((lane = selectLane(heads, schedule)) != eventPriorityCount)
+    {
+      QueuedEventBase* cur = heads[lane];
+      heads[lane] = cur->next;
+      // fire event to handlers
+      countProcessed();
+      try
+      {
+        cur->fire();
+      }
+      catch (...)
+      {
+        destroyEvent(cur);
+        discardAll(heads);
+        throw;
+      }
+      // delete event object
+      destroyEvent(cur);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Process all events in the queue. If more events are queued during processing, they are picked up as well.
+   */
+  int processUntilEmpty(int maxProcessCalls=-1)
+  {
+    int nProcessCalls = 0;
+    bool entriesInQueue = true;
+
+    // simply call process until the queue is empty.
+    while (entriesInQueue)
+    {
+      if ((maxProcessCalls!=-1) && (nProcessCalls == maxProcessCalls))
+      {
+        break;
+      }
+
+      entriesInQueue = process();
+
+      if (!entriesInQueue)
+      {
+        break;
+      }
+
+      nProcessCalls++;
+    }
+
+    return nProcessCalls;
+  }
+
+  /**
+   * @brief Process all events in the queue using the threads of the given worker pool.
+   *
+   * The queued events are grouped by subscriber collection. Events for different subscriber
+   * collections may be processed concurrently, while events for the same subscriber collection
+   * are processed one after another in the order they were queued. Thus, subscribers of one event
+   * are never called concurrently with each other, but subscribers of different events may be.
+   *
+   * Returns after all events have been processed. Like process(), events that get queued during
+   * processing are ignored. Chains are handed to the worker threads in priority order of their
+   * first event, but lower priority chains may run concurrently with higher priority ones.
+   *
+   * Must not be called from within a subscriber. If a subscriber throws, the remaining events for
+   * the same subscriber collection are discarded, all other events are still processed, and the
+   * first exception is rethrown afterwards.
+   *
+   * @param workers worker pool to use
+   * @return false if the queue was empty.
+   */
+  bool processParallel(EventWorkerPool& workers)
+  {
+    processTimers();
+
+    // unique_lock makes sure exceptions are handled
+    std::unique_lock<std::recursive_mutex> guard(queueMutex);
+    takePending();
+    // grab queue, thus the queue is empty now
+    QueuedEventBase* heads[eventPriorityCount];
+    if (!detachAll(heads))
+    {
+      // queue is empty
+      return false;
+    }
+
+    // now the queue is detached from this, so we can unlock.
+    guard.unlock();
+
+    std::lock_guard<std::mutex> parallelGuard(parallelMutex);
+
+    // concatenate the lanes, so that chains are created and started in priority order
+    QueuedEventBase* cur = NULL;
+    QueuedEventBase* last = NULL;
+    for (unsigned int lane = 0; lane < eventPriorityCount; ++lane)
+    {
+      if (heads[lane] == NULL)
+      {
+        continue;
+      }
+      if (last == NULL)
+      {
+        cur = heads[lane];
+      }
+      else
+      {
+        last->next = heads[lane];
+      }
+      last = heads[lane];
+      while (last->next != NULL)
+      {
+        last = last->next;
+      }
+    }
+
+    // split into chains, keeping the order
+    parallelChains.clear();
+    parallelChainIndex.clear();
+    // consecutive events often belong to the same collection, avoid the map lookup then
+    const SubscriberCollectionBase* lastSubscribers = NULL;
+    std::size_t lastChain = 0;
+    while (cur != NULL)
+    {
+      QueuedEventBase* next = cur->next;
+      cur->next = NULL;
+
+      const SubscriberCollectionBase* subscribers = cur->getSubscribers();
+      if (subscribers != lastSubscribers || parallelChains.empty())
+      {
+        auto inserted = parallelChainIndex.insert(std::make_pair(subscribers, parallelChains.size()));
+        lastSubscribers = subscribers;
+        lastChain = inserted.first->second;
+        if (inserted.second)
+        {
+          // new chain
+          parallelChains.push_back(std::make_pair(cur, cur));
+          cur = next;
+          continue;
+        }
+      }
+      // append to existing chain
+      parallelChains[lastChain].second->next = cur;
+      parallelChains[lastChain].second = cur;
+
+      cur = next;
+    }
+
+    // process chains, returns after all are done
+    workers.run(parallelChains.size(), EventWorkerPool::Task(&EventQueue::processChain, this));
+
+    return true;
+  }
+
+  /**
+   * @brief Process all events in the queue using the threads of the given worker pool. If more
+   * events are queued during processing, they are picked up as well.
+   *
+   * See processParallel() for the ordering guarantees.
+   */
+  int processUntilEmpty(EventWorkerPool& workers, int maxProcessCalls=-1)
+  {
+    int nProcessCalls = 0;
+
+    // simply call processParallel until the queue is empty.
+    while ((maxProcessCalls == -1) || (nProcessCalls < maxProcessCalls))
+    {
+      if (!processParallel(workers))
+      {
+        break;
+      }
+
+      nProcessCalls++;
+    }
+
+    return nProcessCalls;
+  }
+
+  /**
+   * @brief Process the first queued event of the lane to service, if any.
    *
    * @return true if an event was processed.
    */
@@ -301,29 +2078,37 @@ public:
     // aquire mutex
     // TODO maybe a timed try-lock, to ensure the main loop isn't blocked forever.
     guard.lock();
+    // pending events may have a higher priority
+    takePending();
 
-    // obtain head queued event
-    QueuedEventBase* toProcess = eventQueueHead;
-    if (toProcess == NULL) {
+    // obtain head queued event of the lane to service
+    unsigned int lane = selectLane(eventQueueHead, processOneSchedule);
+    if (lane == eventPriorityCount) {
       // queue is empty
       return false;
     }
+    QueuedEventBase* toProcess = eventQueueHead[lane];
 
-    // remove from head
-    eventQueueHead = toProcess->next;
-    // reset tail if empty
-    if (toProcess == eventQueueTail) {
-      eventQueueTail = NULL;
-    }
+    // remove from queue and index
+    unlinkEvent(toProcess);
 
     // can unlock now
     guard.unlock();
 
     // finally, process the event
-    toProcess->fire();
+    countProcessed();
+    try
+    {
+      toProcess->fire();
+    }
+    catch (...)
+    {
+      destroyEvent(toProcess);
+      throw;
+    }
 
     // delete queued event object
-    delete toProcess;
+    destroyEvent(toProcess);
 
     return true;
   }
@@ -331,6 +2116,13 @@ public:
   /**
    * @brief Process all events for the given subscribers.
    *
+   * The events are found using a per-topic index, so the cost only depends on the number of
+   * queued events for these subscribers, not on the total queue size. Events for other
+   * subscribers stay queued in their original order.
+   *
+   * If a subscriber throws, the remaining events for these subscribers are discarded and the
+   * exception is rethrown.
+   *
    * @param[in] subscribers subscriber collection to process events for.
    */
   void processForSubscribers(const SubscriberCollectionBase* subscribers)
@@ -340,59 +2132,26 @@ public:
     // aquire mutex
     // TODO maybe a timed try-lock, to ensure the main loop isn't blocked forever.
     guard.lock();
+    takePending();
 
-    // obtain head queued event
-    QueuedEventBase* cur = eventQueueHead;
-    if (cur == NULL) {
-      // queue is empty
+    // obtain the events for the subscribers from the index
+    TopicQueue& topic = getTopicQueue(subscribers);
+    QueuedEventBase* fireQueueHead = topic.head;
+    if (fireQueueHead == NULL) {
+      // no events for these subscribers
       return;
     }
+    topic.head = NULL;
+    topic.tail = NULL;
+    topic.count = 0;
 
-
-    // loop through events, moving those with the right subscribers into a separate queue.
-    QueuedEventBase* fireQueueHead = NULL;
-    QueuedEventBase* fireQueueTail = NULL;
-    // need to track last item for removals
-    QueuedEventBase* last = NULL;
+    // unlink them from the lanes. The fire queue is linked through next, in topic order.
+    QueuedEventBase* cur = fireQueueHead;
     while (cur != NULL)
     {
-      if (cur->getSubscribers() == subscribers)
-      {
-        // found one.
-        // remove it from the queue.
-        QueuedEventBase* toFire = cur;
-        cur = toFire->next;
-        toFire->next = NULL;
-        if (last != NULL)
-        {
-          last->next = cur;
-        }
-        else if (toFire == eventQueueHead)
-        {
-          eventQueueHead = cur;
-        }
-        if (toFire == eventQueueTail)
-        {
-          eventQueueTail = last;
-        }
-
-        // put it into the fire queue
-        if (fireQueueHead == NULL)
-        {
-          fireQueueHead = toFire;
-        }
-        else
-        {
-          fireQueueTail->next = toFire;
-        }
-        fireQueueTail = toFire;
-      }
-      else
-      {
-        // move ahead
-        last = cur;
-        cur = cur->next;
-      }
+      unlinkFromLane(cur);
+      cur->next = cur->topicNext;
+      cur = cur->topicNext;
     }
 
     // now the queue is detached from this, so we can unlock.
@@ -403,43 +2162,85 @@ public:
     while (cur != NULL)
     {
       // fire event to handlers
-      cur->fire();
-      // delete event object
+      countProcessed();
       QueuedEventBase* next = cur->next;
+      try
+      {
+        cur->fire();
+      }
+      catch (...)
+      {
+        destroyEvent(cur);
+        discardChain(next);
+        throw;
+      }
+      // delete event object
 
-      delete cur;
+      destroyEvent(cur);
       cur = next;
     }
   }
 
   /**
-   * @brief Compute the number of events waiting to be processed.
+   * @brief Get the number of events waiting to be processed.
+   *
+   * This reads an atomic counter, so it does not block producers. Events that were already
+   * taken from the queue by a concurrent process() call, but are not fired yet, are still counted.
    */
   size_t size() const
   {
-    // unique_lock makes sure exceptions are handled
-    std::unique_lock<std::recursive_mutex> guard(queueMutex, std::defer_lock);
+    return queueDepth.load(std::memory_order_relaxed);
+  }
 
-    size_t eCount = 0;
-    // aquire mutex
-    // it's ok to block the mutex during the entire loop, since the enqueuing will happen asynchronously.
-    // TODO maybe a timed try-lock, to ensure the main loop isn't blocked forever.
-    guard.lock();
-    // grab queue
-    QueuedEventBase* cur = eventQueueHead;
+  /**
+   * @brief Pass every event published to this queue to the given recorder, e.g. an EventRecorder.
+   *
+   * The recorder is called by the publishing thread, before capacity limits or conflation are
+   * applied, so rejected events are recorded as well. Set to NULL to stop recording.
+   *
+   * The recorder is not owned, it must stay alive until it was reset, and no publish call
+   * is in progress. There is one recorder per queue, use an EventRecorderGroup to attach several.
+   *
+   * @param eventRecorder recorder, or NULL
+   */
+  void setRecorder(EventRecorderBase* eventRecorder)
+  {
+    recorder.store(eventRecorder, std::memory_order_release);
+  }
 
-    // loop through event queue
-    while (cur != NULL)
-    {
-      eCount++;
-      QueuedEventBase* next = cur->next;
-      cur = next;
-    }
+  /**
+   * @brief Get the recorder set with setRecorder(), or NULL.
+   */
+  EventRecorderBase* getRecorder() const
+  {
+    return recorder.load(std::memory_order_acquire);
+  }
 
-    // can unlock now
-    guard.unlock();
+  /**
+   * @brief Get a snapshot of the event counters.
+   *
+   * The counters are read without locking. While events are enqueued or processed concurrently,
+   * the individual values may be slightly out of sync with each other.
+   */
+  EventQueueStatistics getStatistics() const
+  {
+    EventQueueStatistics stats;
+    stats.depth = queueDepth.load(std::memory_order_relaxed);
+    stats.highWaterMark = maxQueueDepth.load(std::memory_order_relaxed);
+    stats.enqueued = enqueuedCount.load(std::memory_order_relaxed);
+    stats.processed = processedCount.load(std::memory_order_relaxed);
+    stats.discarded = discardedCount.load(std::memory_order_relaxed);
+    stats.rejected = rejectedCount.load(std::memory_order_relaxed);
+    stats.conflated = conflatedCount.load(std::memory_order_relaxed);
+    return stats;
+  }
 
-    return eCount;
+  /**
+   * @brief Reset the high-water mark to the current depth.
+   */
+  void resetHighWaterMark()
+  {
+    maxQueueDepth.store(queueDepth.load(std::memory_order_relaxed), std::memory_order_relaxed);
   }
 
   /**
@@ -454,8 +2255,132 @@ public:
     // the constructor also aquires the lock directly
     std::unique_lock<std::recursive_mutex> guard(queueMutex);
 
-    // the queue is empty if the head element is NULL.
-    return eventQueueHead == NULL;
+    // the queue is empty if all head elements are NULL.
+    for (unsigned int lane = 0; lane < eventPriorityCount; ++lane)
+    {
+      if (eventQueueHead[lane] != NULL)
+      {
+        return false;
+      }
+    }
+    // the pending stack load is sequentially consistent since wait() relies on it.
+    return pendingStack.load() == NULL;
+  }
+
+  /**
+   * @brief Block until the queue is not empty, the timeout expires or wakeUp() is called.
+   *
+   * Returns immediately if there are queued events already. Enqueuing an event wakes up all waiting threads.
+   *
+   * Timed events that become due while waiting are enqueued, so a thread waiting on a queue with
+   * timers sleeps until the next deadline.
+   *
+   * @param timeout maximum time to wait
+   * @return true if there are queued events.
+   */
+  template<typename Rep, typename Period>
+  bool wait(const std::chrono::duration<Rep, Period>& timeout)
+  {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    std::unique_lock<std::mutex> lock(waitMutex);
+    unsigned long startWakeUpCounter = wakeUpCounter;
+    lock.unlock();
+    while (true)
+    {
+      // enqueue due timers without holding waitMutex, since enqueueing notifies the waiters
+      processTimers();
+      unsigned long startTimerGeneration = timerGeneration.load();
+      auto wakeTime = deadline;
+      std::chrono::steady_clock::time_point nextTimer;
+      bool timerWake = timerCount.load(std::memory_order_relaxed) != 0 && getNextTimerDeadline(nextTimer)
+          && nextTimer < deadline;
+      if (timerWake)
+      {
+        wakeTime = nextTimer;
+      }
+
+      lock.lock();
+      // announce ourselves first, then check. This way, producers either see us or we see their event.
+      waitingThreads.fetch_add(1);
+      bool woken = waitCondition.wait_until(lock, wakeTime, [&] {
+        return !isEmpty() || wakeUpCounter != startWakeUpCounter || timerGeneration.load() != startTimerGeneration;
+      });
+      bool done = !isEmpty() || wakeUpCounter != startWakeUpCounter;
+      waitingThreads.fetch_sub(1);
+      lock.unlock();
+
+      if (done || (!woken && !timerWake))
+      {
+        break;
+      }
+      // a timer is due, or a new one was scheduled
+      if (std::chrono::steady_clock::now() >= deadline)
+      {
+        processTimers();
+        break;
+      }
+    }
+
+    return !isEmpty();
+  }
+
+  /**
+   * @brief Wake up all threads currently blocked in wait(), waitAndProcess() or processFor().
+   *
+   * This can be used to stop a consumer thread. Note that processFor() continues waiting afterwards,
+   * until its duration ends.
+   */
+  void wakeUp()
+  {
+    std::lock_guard<std::mutex> lock(waitMutex);
+    wakeUpCounter++;
+    waitCondition.notify_all();
+  }
+
+  /**
+   * @brief Wait for events using wait(), then process all queued events.
+   *
+   * @param timeout maximum time to wait for the first event
+   * @return true if any events were processed.
+   */
+  template<typename Rep, typename Period>
+  bool waitAndProcess(const std::chrono::duration<Rep, Period>& timeout)
+  {
+    if (!wait(timeout))
+    {
+      return false;
+    }
+    return process();
+  }
+
+  /**
+   * @brief Process events as they arrive for the given duration.
+   *
+   * Sleeps while the queue is empty, so this can be used as main loop of a consumer thread
+   * without busy polling.
+   *
+   * @param duration time to spend processing.
+   * @return the number of process() calls that processed events.
+   */
+  template<typename Rep, typename Period>
+  int processFor(const std::chrono::duration<Rep, Period>& duration)
+  {
+    auto deadline = std::chrono::steady_clock::now() + duration;
+    int nProcessCalls = 0;
+    while (true)
+    {
+      auto now = std::chrono::steady_clock::now();
+      if (now >= deadline)
+      {
+        break;
+      }
+      if (waitAndProcess(deadline - now))
+      {
+        nProcessCalls++;
+      }
+    }
+    return nProcessCalls;
   }
 
   /**
@@ -469,26 +2394,347 @@ public:
     // it's ok to block the mutex during the entire loop, since the enqueuing will happen asynchronously.
     // TODO maybe a timed try-lock, to ensure the main loop isn't blocked forever.
     guard.lock();
-    // grab queue
-    QueuedEventBase* cur = eventQueueHead;
-    // and clear head/tail references, thus the queue is empty now
-    eventQueueHead = NULL;
-    eventQueueTail = NULL;
+    takePending();
+    // grab queue, thus the queue is empty now
+    QueuedEventBase* heads[eventPriorityCount];
+    detachAll(heads);
 
     // can unlock now
     guard.unlock();
 
-    // loop through event queue
-    while (cur != NULL)
+    // delete event objects
+    discardAll(heads);
+  }
+
+  /**
+   * @brief Enqueues many events for the same subscribers at once.
+   *
+   * The event nodes are created without locking the queue, and are added to the queue in one
+   * step by flush(), which is also called on destruction. This is considerably cheaper than
+   * enqueuing the events one by one. The events of a batch are queued in the order they were added,
+   * and only become visible to process() when the batch is flushed.
+   *
+   * If the queue has capacity limits, or the event is conflating, flush() applies them to every
+   * event of the batch, like enqueue() would. Events with subscribers pinned to other queues are
+   * batched for these queues as well, like enqueueRouted() does.
+   *
+   * A BatchPublisher must not be used by multiple threads at once.
+   *
+   * @tparam Args event argument types
+   */
+  template<typename ...Args>
+  class BatchPublisher
+  {
+  private:
+    EventQueue* queue;
+    const SubscriberCollection<Args...>* subscribers;
+    EventPriority priority;
+    // unflushed events, linked through next
+    QueuedEventBase* head;
+    QueuedEventBase* tail;
+    std::size_t count;
+    // batches for the queues with pinned subscribers, see QueueRoutes
+    std::vector<std::unique_ptr<BatchPublisher>> pinned;
+
+    // create the batches for the pinned subscribers
+    void createPinned()
     {
-      // delete event object
-      QueuedEventBase* next = cur->next;
-      delete cur;
-      cur = next;
+      auto routes = subscribers->getQueueRoutes();
+      if (routes != NULL)
+      {
+        for (auto& route : routes->pinned)
+        {
+          pinned.emplace_back(new BatchPublisher(*route.first, route.second, priority));
+        }
+      }
     }
 
-  }
+    // add an event node to the batch
+    void append(QueuedEventBase* event)
+    {
+      event->next = NULL;
+      if (head == NULL)
+      {
+        head = event;
+      }
+      else
+      {
+        tail->next = event;
+      }
+      tail = event;
+      count++;
+    }
+
+    // element dispatch for publishRange
+    void publishElement(const std::tuple<Args...>& args, std::true_type)
+    {
+      publishTuple(args);
+    }
+    void publishElement(std::tuple<Args...>&& args, std::true_type)
+    {
+      publishTuple(std::move(args));
+    }
+    template<typename T>
+    void publishElement(T&& value, std::false_type)
+    {
+      static_assert(sizeof...(Args) == 1, "Batch elements must be tuples for events with multiple arguments");
+      publish(std::forward<T>(value));
+    }
+
+  public:
+    /**
+     * @brief Create an empty batch for the given subscribers, using their default priority.
+     */
+    BatchPublisher(EventQueue& queue, const SubscriberCollection<Args...>* subscribers) :
+        queue(&queue), subscribers(subscribers), priority(subscribers->getPriority()),
+        head(NULL), tail(NULL), count(0)
+    {
+      createPinned();
+    }
+
+    /**
+     * @brief Create an empty batch for the given subscribers, using an explicit priority.
+     */
+    BatchPublisher(EventQueue& queue, const SubscriberCollection<Args...>* subscribers, EventPriority priority) :
+        queue(&queue), subscribers(subscribers), priority(priority), head(NULL), tail(NULL), count(0)
+    {
+      createPinned();
+    }
+
+    BatchPublisher(BatchPublisher&& other) :
+        queue(other.queue), subscribers(other.subscribers), priority(other.priority),
+        head(other.head), tail(other.tail), count(other.count), pinned(std::move(other.pinned))
+    {
+      other.head = NULL;
+      other.tail = NULL;
+      other.count = 0;
+    }
+
+    // not copyable
+    BatchPublisher(const BatchPublisher&) = delete;
+    BatchPublisher& operator=(const BatchPublisher&) = delete;
+
+    /**
+     * @brief Flush the batch. Events are discarded if that fails.
+     */
+    ~BatchPublisher()
+    {
+      try
+      {
+        flush();
+      }
+      catch (...)
+      {
+        discard();
+      }
+    }
+
+    /**
+     * @brief Add an event to the batch.
+     *
+     * @param args event argument values
+     */
+    void publish(type_identity_t<Args>... args)
+    {
+      publishTuple(std::tuple<Args...>(std::move(args)...));
+    }
+
+    /**
+     * @brief Add an event to the batch, extracting event arguments from the given tuple.
+     *
+     * @param args event argument values
+     */
+    void publishTuple(std::tuple<Args...> args)
+    {
+      queue->recordEvent(subscribers, args, priority);
+      std::integral_constant<bool, detail::all_copy_constructible<Args...>::value> copyable;
+      for (auto& batch : pinned)
+      {
+        if (batch->subscribers->getLocalHandlerCount() == 0)
+        {
+          continue;
+        }
+        batch->append(batch->queue->createEvent(batch->subscribers, copyArgs(args, copyable), priority));
+      }
+      append(queue->createEvent(subscribers, std::move(args), priority));
+    }
+
+    /**
+     * @brief Add an event for every element of the given range.
+     *
+     * The elements are either argument tuples, or the argument values for events with one argument.
+     * Rvalue ranges are moved from.
+     *
+     * @param values range of event arguments
+     */
+    template<typename Range>
+    void publishRange(Range&& values)
+    {
+      for (auto&& value : values)
+      {
+        publishElement(std::forward<decltype(value)>(value),
+            std::is_same<typename std::decay<decltype(value)>::type, std::tuple<Args...>>());
+      }
+    }
+
+    /**
+     * @brief Get the number of events that were not flushed yet.
+     */
+    std::size_t size() const
+    {
+      return count;
+    }
+
+    /**
+     * @brief Add all events of the batch to the queue.
+     *
+     * The events are added to the queues with pinned subscribers as well. They are only added to
+     * this queue if the event has subscribers of it's own, or if no pinned subscriber receives them.
+     *
+     * @return the number of events that were accepted by the queue. For events with pinned
+     *         subscribers, the largest number accepted by any of the queues.
+     */
+    std::size_t flush()
+    {
+      std::size_t accepted = 0;
+      bool delivered = false;
+      for (std::size_t i = 0; i < pinned.size(); ++i)
+      {
+        if (pinned[i]->subscribers->getLocalHandlerCount() == 0)
+        {
+          pinned[i]->discardOwn();
+          continue;
+        }
+        try
+        {
+          accepted = std::max(accepted, pinned[i]->flushOwn());
+        }
+        catch (...)
+        {
+          for (std::size_t j = i + 1; j < pinned.size(); ++j)
+          {
+            pinned[j]->discardOwn();
+          }
+          discardOwn();
+          throw;
+        }
+        delivered = true;
+      }
+      if (delivered && subscribers->getLocalHandlerCount() == 0)
+      {
+        // only pinned subscribers
+        discardOwn();
+        return accepted;
+      }
+      return std::max(accepted, flushOwn());
+    }
+
+    /**
+     * @brief Destroy all events that were not flushed yet.
+     */
+    void discard()
+    {
+      for (auto& batch : pinned)
+      {
+        batch->discardOwn();
+      }
+      discardOwn();
+    }
+
+  private:
+    // add the events of this batch to it's queue, ignoring the pinned batches
+    std::size_t flushOwn()
+    {
+      if (head == NULL)
+      {
+        return 0;
+      }
+      QueuedEventBase* first = head;
+      std::size_t n = count;
+      head = NULL;
+      tail = NULL;
+      count = 0;
+
+      if (queue->capacity != 0 || queue->limitedTopics != 0 || subscribers->isConflating())
+      {
+        // apply the limits to the existing nodes
+        return queue->enqueueChainLimited(subscribers, first, priority);
+      }
+
+      queue->countEnqueued(n);
+      if (queue->mode == EventQueueMode::LOCK_FREE)
+      {
+        // reverse into stack order and push all at once
+        QueuedEventBase* top = NULL;
+        QueuedEventBase* bottom = first;
+        while (first != NULL)
+        {
+          QueuedEventBase* next = first->next;
+          first->next = top;
+          top = first;
+          first = next;
+        }
+        QueuedEventBase* oldTop = queue->pendingStack.load(std::memory_order_relaxed);
+        do
+        {
+          bottom->next = oldTop;
+        }
+        while (!queue->pendingStack.compare_exchange_weak(oldTop, top, std::memory_order_seq_cst,
+            std::memory_order_relaxed));
+      }
+      else
+      {
+        std::lock_guard<std::recursive_mutex> guard(queue->queueMutex);
+        while (first != NULL)
+        {
+          QueuedEventBase* next = first->next;
+          try
+          {
+            queue->linkEvent(first, subscribers);
+          }
+          catch (...)
+          {
+            // the events from first on are not linked
+            head = first;
+            for (QueuedEventBase* cur = first; cur != NULL; cur = cur->next)
+            {
+              queue->countDiscarded();
+            }
+            discardOwn();
+            throw;
+          }
+          first = next;
+        }
+      }
+      queue->notifyWaiters();
+      return n;
+    }
+
+    // destroy all events of this batch, ignoring the pinned batches
+    void discardOwn()
+    {
+      while (head != NULL)
+      {
+        QueuedEventBase* next = head->next;
+        queue->destroyEvent(head);
+        head = next;
+      }
+      tail = NULL;
+      count = 0;
+    }
+  };
 
+  /**
+   * @brief Create a BatchPublisher for the given subscribers.
+   *
+   * @tparam Args event argument types
+   * @param handlerRef event handler collection
+   */
+  template<typename ...Args>
+  BatchPublisher<Args...> batch(const SubscriberCollection<Args...>* handlerRef)
+  {
+    return BatchPublisher<Args...>(*this, handlerRef);
+  }
 };
 
 // now, we can define the implementation of EventParametersParser::enqueueEvent
@@ -499,6 +2745,27 @@ inline void EventParametersParser<Args...>::enqueueEvent(EventQueue* queue,
   queue->enqueue_tuple(subscriberCollection, parseArgs(parameterStrings));
 }
 
+template<typename ... Args>
+inline void EventParametersParser<Args...>::enqueueEvent(EventQueue* queue,
+    const StringView* parameters, std::size_t count) const
+{
+  queue->enqueue_tuple(subscriberCollection, parseArgs(parameters, count));
+}
+
+template<typename ... Args>
+inline void EventParametersParser<Args...>::enqueueEventLine(EventQueue* queue, StringView arguments) const
+{
+  queue->enqueue_tuple(subscriberCollection, parseArgs(arguments));
+}
+
+// now, we can define the implementation of EventSerializer::enqueueEvent
+template<typename ... Args>
+inline void EventSerializer<Args...>::enqueueEvent(EventQueue* queue, BinaryReader& in,
+    EventPriority priority) const
+{
+  queue->enqueue_tuple(subscriberCollection, readArgs(in), priority);
+}
+
 }  // namespace ES
 
 #endif /* EVENTQUEUE_H */
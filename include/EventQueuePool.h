@@ -0,0 +1,327 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTQUEUEPOOL_H
+#define EVENTQUEUEPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace ES {
+
+namespace detail {
+
+/**
+ * @brief Free-list allocator for queued event nodes.
+ *
+ * Memory is handed out in fixed-size blocks from a few size classes. Blocks are carved from
+ * slabs allocated by reserve(), and returned to a per-class free list when released. When the
+ * free list of a size class is exhausted, or a node is too large for any size class, the pool
+ * falls back to the heap. Thus, after reserving enough blocks at startup, the steady state does
+ * not allocate at all.
+ *
+ * allocate() and release() are lock-free and may be called from any thread. The free lists are
+ * stacks of block indices, tagged with a version counter to avoid the ABA problem. Slabs are
+ * only freed on destruction.
+ */
+class QueuedEventPool
+{
+public:
+  /// @brief Number of size classes.
+  static constexpr std::size_t classCount = 4;
+  /// @brief Block size of the smallest size class, including the block header.
+  static constexpr std::size_t minBlockSize = 64;
+
+private:
+  // marks a block that was allocated from the heap
+  static constexpr std::uint32_t heapClass = 0xFFFFFFFF;
+
+  // bits of a block index used for the offset within a slab
+  static constexpr unsigned int slabOffsetBits = 20;
+  // maximum number of blocks per slab
+  static constexpr std::size_t maxSlabBlocks = std::size_t(1) << slabOffsetBits;
+  // maximum number of slabs per size class
+  static constexpr std::size_t maxSlabs = 64;
+
+  // header in front of every block. Padded to keep the node maximally aligned.
+  struct alignas(std::max_align_t) BlockHeader
+  {
+    // size class, or heapClass
+    std::uint32_t sizeClass;
+    // 1-based index of this block within its size class
+    std::uint32_t index;
+    // 1-based index of the next free block, 0 for the end of the list.
+    // atomic since it might be read by an allocate() that loses the race for this block.
+    std::atomic<std::uint32_t> nextFree;
+  };
+
+  struct SizeClass
+  {
+    // top of free list, low 32 bits are the block index, high 32 bits a version tag
+    std::atomic<std::uint64_t> freeTop;
+    // slab memory. Entries are written before the slab's blocks are published to the free list.
+    char* slabs[maxSlabs];
+    // number of used entries in slabs
+    std::size_t slabCount;
+    // total number of reserved blocks
+    std::size_t blockCount;
+
+    SizeClass() :
+        freeTop(0), slabCount(0), blockCount(0)
+    {
+    }
+  };
+
+  SizeClass classes[classCount];
+
+  // guards slab allocation in reserve()
+  std::mutex reserveMutex;
+
+  // number of allocations that were served by the heap
+  std::atomic<std::size_t> heapAllocations;
+
+  // block size of a size class
+  static constexpr std::size_t blockSize(std::size_t sizeClass)
+  {
+    return minBlockSize << sizeClass;
+  }
+
+  // locate a block by it's 1-based index
+  BlockHeader* getBlock(std::size_t sizeClass, std::uint32_t index) const
+  {
+    std::uint32_t i = index - 1;
+    char* slab = classes[sizeClass].slabs[i >> slabOffsetBits];
+    return reinterpret_cast<BlockHeader*>(slab + (i & (maxSlabBlocks - 1)) * blockSize(sizeClass));
+  }
+
+  // push a chain of blocks from first to last onto the free list
+  void pushChain(std::size_t sizeClass, BlockHeader* first, BlockHeader* last)
+  {
+    std::atomic<std::uint64_t>& top = classes[sizeClass].freeTop;
+    std::uint64_t cur = top.load(std::memory_order_relaxed);
+    std::uint64_t next;
+    do
+    {
+      last->nextFree.store(static_cast<std::uint32_t>(cur), std::memory_order_relaxed);
+      next = (((cur >> 32) + 1) << 32) | first->index;
+    }
+    while (!top.compare_exchange_weak(cur, next, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  // pop a block from the free list, or return NULL if it is empty
+  BlockHeader* pop(std::size_t sizeClass)
+  {
+    std::atomic<std::uint64_t>& top = classes[sizeClass].freeTop;
+    std::uint64_t cur = top.load(std::memory_order_acquire);
+    while (true)
+    {
+      std::uint32_t index = static_cast<std::uint32_t>(cur);
+      if (index == 0)
+      {
+        // exhausted
+        return NULL;
+      }
+      BlockHeader* block = getBlock(sizeClass, index);
+      // the version tag makes the CAS fail if the block was popped and pushed again meanwhile
+      std::uint64_t next = (((cur >> 32) + 1) << 32) | block->nextFree.load(std::memory_order_relaxed);
+      if (top.compare_exchange_weak(cur, next, std::memory_order_acquire, std::memory_order_acquire))
+      {
+        return block;
+      }
+    }
+  }
+
+public:
+  /**
+   * @brief Get the size class for a node size, or classCount if no size class is large enough.
+   */
+  static constexpr std::size_t sizeClassFor(std::size_t nodeSize, std::size_t sizeClass = 0)
+  {
+    return sizeClass == classCount ? classCount :
+        (nodeSize + sizeof(BlockHeader) <= blockSize(sizeClass) ? sizeClass : sizeClassFor(nodeSize, sizeClass + 1));
+  }
+
+  /// @brief Create an empty pool. All allocations will be served by the heap until reserve() is called.
+  QueuedEventPool() :
+      heapAllocations(0)
+  {
+  }
+
+  // not copyable
+  QueuedEventPool(const QueuedEventPool&) = delete;
+  QueuedEventPool& operator=(const QueuedEventPool&) = delete;
+
+  /**
+   * @brief Free all slabs. All blocks must have been released before.
+   */
+  ~QueuedEventPool()
+  {
+    for (auto& sc : classes)
+    {
+      for (std::size_t i = 0; i < sc.slabCount; ++i)
+      {
+        ::operator delete(sc.slabs[i]);
+      }
+    }
+  }
+
+  /**
+   * @brief Add blocks for nodes of the given size to the pool.
+   *
+   * Does nothing if the node size is too large for the pool.
+   *
+   * @param nodeSize node size in bytes
+   * @param count number of blocks to add
+   *
+   * @throws std::length_error if the maximum number of slabs is exceeded.
+   */
+  void reserve(std::size_t nodeSize, std::size_t count)
+  {
+    std::size_t sizeClass = sizeClassFor(nodeSize);
+    if (sizeClass == classCount || count == 0)
+    {
+      return;
+    }
+    SizeClass& sc = classes[sizeClass];
+    std::size_t bsize = blockSize(sizeClass);
+
+    std::lock_guard<std::mutex> lock(reserveMutex);
+    while (count > 0)
+    {
+      if (sc.slabCount == maxSlabs)
+      {
+        throw std::length_error("Too many event queue pool slabs");
+      }
+      std::size_t slabBlocks = count < maxSlabBlocks ? count : maxSlabBlocks;
+      count -= slabBlocks;
+
+      // allocate slab and format it's blocks as a chain
+      char* slab = static_cast<char*>(::operator new(slabBlocks * bsize));
+      std::uint32_t firstIndex = static_cast<std::uint32_t>((sc.slabCount << slabOffsetBits) + 1);
+      sc.slabs[sc.slabCount++] = slab;
+      sc.blockCount += slabBlocks;
+
+      BlockHeader* first = NULL;
+      BlockHeader* prev = NULL;
+      for (std::size_t i = 0; i < slabBlocks; ++i)
+      {
+        BlockHeader* block = new (slab + i * bsize) BlockHeader;
+        block->sizeClass = static_cast<std::uint32_t>(sizeClass);
+        block->index = firstIndex + static_cast<std::uint32_t>(i);
+        block->nextFree.store(0, std::memory_order_relaxed);
+        if (prev != NULL)
+        {
+          prev->nextFree.store(block->index, std::memory_order_relaxed);
+        }
+        else
+        {
+          first = block;
+        }
+        prev = block;
+      }
+      // publish the whole slab at once
+      pushChain(sizeClass, first, prev);
+    }
+  }
+
+  /**
+   * @brief Get the number of blocks reserved for nodes of the given size.
+   */
+  std::size_t getReservedCount(std::size_t nodeSize) const
+  {
+    std::size_t sizeClass = sizeClassFor(nodeSize);
+    return sizeClass == classCount ? 0 : classes[sizeClass].blockCount;
+  }
+
+  /**
+   * @brief Get the number of allocations that could not be served from the pool.
+   */
+  std::size_t getHeapAllocationCount() const
+  {
+    return heapAllocations.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Allocate memory for a node of the given size.
+   *
+   * @param nodeSize node size in bytes
+   * @return node memory, suitably aligned
+   */
+  void* allocate(std::size_t nodeSize)
+  {
+    std::size_t sizeClass = sizeClassFor(nodeSize);
+    BlockHeader* block = NULL;
+    if (sizeClass != classCount)
+    {
+      block = pop(sizeClass);
+    }
+    if (block == NULL)
+    {
+      // fallback to heap
+      heapAllocations.fetch_add(1, std::memory_order_relaxed);
+      block = new (::operator new(sizeof(BlockHeader) + nodeSize)) BlockHeader;
+      block->sizeClass = heapClass;
+      block->index = 0;
+    }
+    return block + 1;
+  }
+
+  /**
+   * @brief Release memory obtained from allocate().
+   *
+   * The node must already be destroyed.
+   *
+   * @param node node memory
+   */
+  void release(void* node)
+  {
+    BlockHeader* block = static_cast<BlockHeader*>(node) - 1;
+    if (block->sizeClass == heapClass)
+    {
+      block->~BlockHeader();
+      ::operator delete(block);
+      return;
+    }
+    pushChain(block->sizeClass, block, block);
+  }
+};
+
+}  // namespace detail
+
+}  // namespace ES
+
+#endif /* EVENTQUEUEPOOL_H */
@@ -0,0 +1,616 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTRECORDER_H
+#define EVENTRECORDER_H
+
+// The recorder maps the log file into memory, which is only implemented for POSIX systems.
+#if !defined(_WIN32)
+
+#include "EventRegistry.h"
+#include "EventQueue.h"
+#include "EventSerialization.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ES {
+
+namespace detail
+{
+
+/*
+ * Event log file layout, all values in native byte order:
+ *
+ * magic "ESLOG001"
+ * records, each [u32 body length][u8 record type][body]
+ *
+ * definition body: [u32 event id][string name][string argument description]
+ * event body: [u32 event id][i64 timestamp ns][u8 priority][serialized arguments]
+ *
+ * Every event id is defined before it's first event record.
+ *
+ * The recorder grows the file in steps and truncates it to the used size when it is closed. A log
+ * that was not closed, e.g. because the process crashed, ends with zero bytes instead. Record type
+ * 0 is not used, so a zero record header marks the end of the log.
+ */
+static const char eventLogMagic[8] = {'E', 'S', 'L', 'O', 'G', '0', '0', '1'};
+
+enum class EventLogRecord : std::uint8_t {
+  DEFINITION = 1,
+  EVENT = 2
+};
+
+// size of the record header, length and type
+constexpr std::size_t eventLogRecordHeader = sizeof(std::uint32_t) + sizeof(std::uint8_t);
+// size of the event record fields before the arguments
+constexpr std::size_t eventLogEventHeader = eventLogRecordHeader + sizeof(std::uint32_t) + sizeof(std::int64_t)
+    + sizeof(std::uint8_t);
+
+// throw a std::runtime_error including the errno description
+inline void throwSystemError(const std::string& what, const std::string& path)
+{
+  throw std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+}
+
+}  // namespace detail
+
+/**
+ * @brief Records published events into an append-only log file, which can be replayed by an EventReplayer.
+ *
+ * Attach the recorder to an EventQueue using EventQueue::setRecorder(). Every published event
+ * is then serialized with the BinarySerializer of it's argument types and appended to the file,
+ * together with the event name, priority and a timestamp. Events whose arguments cannot be serialized,
+ * and events that are not registered in the registry, are skipped and counted.
+ *
+ * The file is memory-mapped and grows by doubling. The arguments are serialized by the publishing
+ * thread, only the append is done under a mutex.
+ *
+ * A queue has a single recorder. To record a queue that is also bridged with an EventBridgeSender,
+ * attach both using an EventRecorderGroup.
+ *
+ * The log uses the native byte order and type sizes, so it can only be replayed on a machine of
+ * the same architecture. Only available on POSIX systems.
+ */
+class EventRecorder : public EventRecorderBase
+{
+private:
+  // used to resolve event names
+  const EventRegistry& registry;
+  std::string path;
+
+  int fd;
+  char* mapping;
+  std::size_t mappedSize;
+  std::size_t usedSize;
+
+  // event ids by subscriber collection
+  std::unordered_map<const SubscriberCollectionBase*, std::uint32_t> eventIds;
+  // subscriber collections known not to be recordable
+  std::unordered_map<const SubscriberCollectionBase*, bool> skippedEvents;
+
+  // guards all of the above
+  std::mutex recorderMutex;
+
+  std::chrono::steady_clock::time_point startTime;
+
+  std::atomic<unsigned long long> recordedCount;
+  std::atomic<unsigned long long> skippedCount;
+
+  // not copyable
+  EventRecorder(const EventRecorder&);
+  EventRecorder& operator=(const EventRecorder&);
+
+  // make sure that size more bytes fit into the mapping. Called with the mutex held.
+  void reserveSpace(std::size_t size)
+  {
+    if (usedSize + size <= mappedSize)
+    {
+      return;
+    }
+    std::size_t newSize = mappedSize * 2;
+    while (newSize < usedSize + size)
+    {
+      newSize *= 2;
+    }
+    // map the grown file first, so the current mapping stays usable if that fails
+    char* newMapping = mapFile(newSize);
+    char* oldMapping = mapping;
+    std::size_t oldSize = mappedSize;
+    mapping = newMapping;
+    mappedSize = newSize;
+    if (munmap(oldMapping, oldSize) != 0)
+    {
+      detail::throwSystemError("Cannot unmap event log", path);
+    }
+  }
+
+  // grow the file to the given size and map all of it. Doesn't change the current mapping.
+  char* mapFile(std::size_t size)
+  {
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+      detail::throwSystemError("Cannot resize event log", path);
+    }
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+      detail::throwSystemError("Cannot map event log", path);
+    }
+    return static_cast<char*>(addr);
+  }
+
+  // append a complete record. Called with the mutex held.
+  void append(const char* data, std::size_t size)
+  {
+    reserveSpace(size);
+    std::memcpy(mapping + usedSize, data, size);
+    usedSize += size;
+  }
+
+  // fill in the record header of a buffer starting with eventLogRecordHeader bytes
+  static void finishRecord(std::vector<char>& buffer, detail::EventLogRecord type)
+  {
+    std::uint32_t length = static_cast<std::uint32_t>(buffer.size() - detail::eventLogRecordHeader);
+    std::uint8_t typeValue = static_cast<std::uint8_t>(type);
+    std::memcpy(buffer.data(), &length, sizeof(length));
+    std::memcpy(buffer.data() + sizeof(length), &typeValue, sizeof(typeValue));
+  }
+
+  // find the name of a subscriber collection in the registry. Returns false if not registered.
+  bool findEventName(const SubscriberCollectionBase* subscribers, std::string& name) const
+  {
+    std::lock_guard<std::mutex> lock(registry.getRegistryMutex());
+    for (auto& entry : registry.getRegisteredEvents())
+    {
+      if (entry.second == subscribers)
+      {
+        name = entry.first;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // get the id of the event, writing the definition record if needed. Returns false if the event is skipped.
+  bool getEventId(const SubscriberCollectionBase* subscribers, std::unique_lock<std::mutex>& lock,
+      std::uint32_t& id)
+  {
+    auto existing = eventIds.find(subscribers);
+    if (existing != eventIds.end())
+    {
+      id = existing->second;
+      return true;
+    }
+    if (skippedEvents.find(subscribers) != skippedEvents.end())
+    {
+      return false;
+    }
+
+    // resolve the name without holding our mutex, so we don't nest it inside the registry mutex
+    lock.unlock();
+    std::string name;
+    bool found = findEventName(subscribers, name);
+    lock.lock();
+
+    // another thread may have defined it in the meantime
+    existing = eventIds.find(subscribers);
+    if (existing != eventIds.end())
+    {
+      id = existing->second;
+      return true;
+    }
+    if (!found)
+    {
+      skippedEvents[subscribers] = true;
+      return false;
+    }
+
+    std::ostringstream description;
+    subscribers->appendEventArgsDescription(description);
+
+    std::vector<char> record(detail::eventLogRecordHeader);
+    BinaryWriter out(record);
+    id = static_cast<std::uint32_t>(eventIds.size());
+    out.writeValue(id);
+    BinarySerializer<std::string>::write(out, name);
+    BinarySerializer<std::string>::write(out, description.str());
+    finishRecord(record, detail::EventLogRecord::DEFINITION);
+    append(record.data(), record.size());
+
+    eventIds[subscribers] = id;
+    return true;
+  }
+
+  // unmap and truncate the file to the used size, ignoring errors
+  void release()
+  {
+    if (mapping != NULL)
+    {
+      munmap(mapping, mappedSize);
+      mapping = NULL;
+    }
+    if (fd >= 0)
+    {
+      int result = ftruncate(fd, static_cast<off_t>(usedSize));
+      (void) result;
+      ::close(fd);
+      fd = -1;
+    }
+  }
+
+public:
+  /**
+   * @brief Create a new event log file, replacing an existing one.
+   *
+   * @param registry registry used to look up event names. Must outlive the recorder.
+   * @param path log file path
+   * @param initialSize initial size of the file mapping in bytes
+   *
+   * @throws std::runtime_error if the file cannot be created.
+   */
+  EventRecorder(const EventRegistry& registry, const std::string& path, std::size_t initialSize = 1 << 20) :
+      registry(registry), path(path), fd(-1), mapping(NULL), mappedSize(0), usedSize(0),
+      startTime(std::chrono::steady_clock::now()), recordedCount(0), skippedCount(0)
+  {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+      detail::throwSystemError("Cannot create event log", path);
+    }
+    try
+    {
+      std::size_t size = initialSize < sizeof(detail::eventLogMagic) ? sizeof(detail::eventLogMagic) : initialSize;
+      mapping = mapFile(size);
+      mappedSize = size;
+    }
+    catch (...)
+    {
+      release();
+      throw;
+    }
+    append(detail::eventLogMagic, sizeof(detail::eventLogMagic));
+  }
+
+  /**
+   * @brief Close the log file. The recorder must be detached from all queues before.
+   */
+  virtual ~EventRecorder()
+  {
+    release();
+  }
+
+  /**
+   * @brief Finish the log file, further events are skipped.
+   *
+   * The file is truncated to the recorded size. The recorder must be detached from all queues before,
+   * or at least no event may be published concurrently.
+   *
+   * @throws std::runtime_error if the file cannot be truncated.
+   */
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(recorderMutex);
+    if (fd < 0)
+    {
+      return;
+    }
+    munmap(mapping, mappedSize);
+    mapping = NULL;
+    if (ftruncate(fd, static_cast<off_t>(usedSize)) != 0)
+    {
+      ::close(fd);
+      fd = -1;
+      detail::throwSystemError("Cannot truncate event log", path);
+    }
+    ::close(fd);
+    fd = -1;
+  }
+
+  /**
+   * @brief Serialize and append a published event, see EventRecorderBase::recordEvent().
+   *
+   * @throws std::runtime_error if the file cannot be grown.
+   */
+  virtual void recordEvent(const SubscriberCollectionBase* subscribers, const void* args, EventPriority priority)
+  {
+    const EventSerializerBase* serializer = subscribers->getSerializer();
+    if (!serializer->canSerialize())
+    {
+      skippedCount.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    // serialize outside of the lock, into a per-thread buffer to avoid allocations
+    static thread_local std::vector<char> record;
+    record.resize(detail::eventLogEventHeader);
+    BinaryWriter out(record);
+    serializer->writeArgs(out, args);
+
+    std::unique_lock<std::mutex> lock(recorderMutex);
+    std::uint32_t id;
+    if (fd < 0 || !getEventId(subscribers, lock, id))
+    {
+      skippedCount.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    // take the timestamp under the lock, so the timestamps in the file are ordered
+    std::int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - startTime).count();
+    std::uint8_t priorityValue = static_cast<std::uint8_t>(priority);
+    char* fields = record.data() + detail::eventLogRecordHeader;
+    std::memcpy(fields, &id, sizeof(id));
+    std::memcpy(fields + sizeof(id), &timestamp, sizeof(timestamp));
+    std::memcpy(fields + sizeof(id) + sizeof(timestamp), &priorityValue, sizeof(priorityValue));
+    finishRecord(record, detail::EventLogRecord::EVENT);
+    append(record.data(), record.size());
+    recordedCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Get the number of recorded events.
+   */
+  unsigned long long getRecordedCount() const
+  {
+    return recordedCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Get the number of events that were not recorded, because they are not registered,
+   * or their arguments cannot be serialized.
+   */
+  unsigned long long getSkippedCount() const
+  {
+    return skippedCount.load(std::memory_order_relaxed);
+  }
+};
+
+/**
+ * @brief Replays an event log written by an EventRecorder.
+ *
+ * The log file is memory-mapped read-only, and the event arguments are deserialized directly
+ * from the mapping.
+ *
+ * Events are matched to the registry by name. Events that are not registered in the target
+ * registry are skipped, events registered with different argument types are an error.
+ */
+class EventReplayer
+{
+private:
+  std::string path;
+  const char* mapping;
+  std::size_t mappedSize;
+
+  unsigned long long skippedCount;
+
+  // not copyable
+  EventReplayer(const EventReplayer&);
+  EventReplayer& operator=(const EventReplayer&);
+
+  // the subscribers of an event id, or NULL if the event is skipped
+  typedef std::vector<SubscriberCollectionBase*> EventTable;
+
+  // resolve an event definition in the target registry
+  void defineEvent(EventRegistry& registry, BinaryReader& in, EventTable& events) const
+  {
+    std::uint32_t id = in.readValue<std::uint32_t>();
+    std::size_t nameSize = in.readSize();
+    const char* name = in.readBytes(nameSize);
+    std::string description = BinarySerializer<std::string>::read(in);
+
+    if (id != events.size())
+    {
+      throw std::invalid_argument("Corrupt event log '" + path + "': unexpected event id");
+    }
+    SubscriberCollectionBase* subscribers = registry.getSubscribers(EventName(name, nameSize));
+    if (subscribers != NULL)
+    {
+      std::ostringstream actual;
+      subscribers->appendEventArgsDescription(actual);
+      if (actual.str() != description)
+      {
+        throw std::invalid_argument("Recorded event '" + std::string(name, nameSize) + "' has arguments "
+            + description + ", but the registered event has " + actual.str());
+      }
+    }
+    events.push_back(subscribers);
+  }
+
+public:
+  /**
+   * @brief Open an event log file.
+   *
+   * @param path log file path
+   *
+   * @throws std::runtime_error if the file cannot be opened.
+   * @throws std::invalid_argument if the file is not an event log.
+   */
+  explicit EventReplayer(const std::string& path) :
+      path(path), mapping(NULL), mappedSize(0), skippedCount(0)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      detail::throwSystemError("Cannot open event log", path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      detail::throwSystemError("Cannot open event log", path);
+    }
+    mappedSize = static_cast<std::size_t>(info.st_size);
+    if (mappedSize < sizeof(detail::eventLogMagic))
+    {
+      ::close(fd);
+      throw std::invalid_argument("Not an event log: '" + path + "'");
+    }
+    void* addr = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+      detail::throwSystemError("Cannot map event log", path);
+    }
+    mapping = static_cast<const char*>(addr);
+    if (std::memcmp(mapping, detail::eventLogMagic, sizeof(detail::eventLogMagic)) != 0)
+    {
+      munmap(const_cast<char*>(mapping), mappedSize);
+      throw std::invalid_argument("Not an event log: '" + path + "'");
+    }
+  }
+
+  ~EventReplayer()
+  {
+    munmap(const_cast<char*>(mapping), mappedSize);
+  }
+
+  /**
+   * @brief Enqueue all recorded events to the given queue, using their recorded priority.
+   *
+   * With a positive speed, the replay keeps the recorded time between the events, divided by
+   * the speed. So 1 replays in the original timing, 2 twice as fast. With speed 0, the events are
+   * enqueued as fast as possible.
+   *
+   * The events are only enqueued, processing them is up to the queue's consumer.
+   *
+   * Logs that were not closed, e.g. because the recording process crashed, are replayed up to the
+   * last complete record.
+   *
+   * @param registry registry to look up the recorded events in
+   * @param queue queue to enqueue to
+   * @param speed replay speed factor, or 0 to replay without delays
+   * @return number of enqueued events
+   *
+   * @throws std::invalid_argument if the log is corrupt, or a recorded event is registered with
+   *   different argument types.
+   */
+  std::size_t replay(EventRegistry& registry, EventQueue& queue, double speed = 0)
+  {
+    EventTable events;
+    std::size_t replayed = 0;
+    skippedCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    // delays are relative to the first event
+    std::int64_t firstTimestamp = -1;
+
+    BinaryReader file(mapping + sizeof(detail::eventLogMagic), mappedSize - sizeof(detail::eventLogMagic));
+    while (file.remaining() != 0)
+    {
+      if (file.remaining() < detail::eventLogRecordHeader)
+      {
+        // the zero filled end of a log that was not closed, too short for a record header
+        std::size_t size = file.remaining();
+        const char* rest = file.readBytes(size);
+        if (std::count(rest, rest + size, '\0') != static_cast<std::ptrdiff_t>(size))
+        {
+          throw std::invalid_argument("Corrupt event log '" + path + "': truncated record");
+        }
+        break;
+      }
+      std::size_t length = file.readValue<std::uint32_t>();
+      std::uint8_t typeValue = file.readValue<std::uint8_t>();
+      if (length == 0 && typeValue == 0)
+      {
+        // the zero filled end of a log that was not closed
+        break;
+      }
+      detail::EventLogRecord type = static_cast<detail::EventLogRecord>(typeValue);
+      BinaryReader in(file.readBytes(length), length);
+
+      if (type == detail::EventLogRecord::DEFINITION)
+      {
+        defineEvent(registry, in, events);
+        continue;
+      }
+      if (type != detail::EventLogRecord::EVENT)
+      {
+        throw std::invalid_argument("Corrupt event log '" + path + "': unknown record type");
+      }
+
+      std::uint32_t id = in.readValue<std::uint32_t>();
+      std::int64_t timestamp = in.readValue<std::int64_t>();
+      std::uint8_t priority = in.readValue<std::uint8_t>();
+      if (id >= events.size() || priority >= eventPriorityCount)
+      {
+        throw std::invalid_argument("Corrupt event log '" + path + "': undefined event");
+      }
+      if (events[id] == NULL)
+      {
+        skippedCount++;
+        continue;
+      }
+      if (firstTimestamp < 0)
+      {
+        firstTimestamp = timestamp;
+      }
+      if (speed > 0)
+      {
+        std::this_thread::sleep_until(start
+            + std::chrono::nanoseconds(static_cast<long long>((timestamp - firstTimestamp) / speed)));
+      }
+      events[id]->getSerializer()->enqueueEvent(&queue, in, static_cast<EventPriority>(priority));
+      replayed++;
+    }
+    return replayed;
+  }
+
+  /**
+   * @brief Get the number of events skipped by the last replay() call, because they were not registered.
+   */
+  unsigned long long getSkippedCount() const
+  {
+    return skippedCount;
+  }
+};
+
+}  // namespace ES
+
+#endif /* !_WIN32 */
+
+#endif /* EVENTRECORDER_H */
@@ -35,10 +35,17 @@
 
 #include "EventSubscriberCollection.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <map>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <sstream>
+#include <stdexcept>
 #include <mutex>
+#include <vector>
 
 namespace ES
 {
@@ -54,6 +61,174 @@ namespace ES
 template<typename... Args>
 using SubscriberCollectionDecay = SubscriberCollection<typename std::decay<Args>::type...>;
 
+/**
+ * @brief A pre-resolved, typed reference to a registered event.
+ *
+ * Looking up an event by name requires a registry lookup and a type check on every call.
+ * An EventHandle is obtained once from registerEvent() or getOrRegister() and can be stored
+ * by the client. Publishing or calling through the handle accesses the subscriber collection
+ * directly, without any string comparison, locking or dynamic type check. Since the argument
+ * types are part of the handle type, they are checked by the compiler.
+ *
+ * The handle does not own the subscriber collection. It stays valid as long as the registry
+ * it was obtained from exists.
+ *
+ * For compatibility, the handle converts implicitly to a pointer to the subscriber collection,
+ * and the collection members can be accessed using the arrow operator.
+ *
+ * @tparam Args event argument types, already decayed.
+ */
+template<typename... Args>
+class EventHandle
+{
+private:
+  // referenced subscriber collection, not owned. May be NULL for an empty handle.
+  SubscriberCollection<Args...>* subscribers;
+
+public:
+  /**
+   * @brief Create an empty handle, which does not reference any event.
+   */
+  EventHandle() :
+      subscribers(NULL)
+  {
+  }
+
+  /**
+   * @brief Create a handle referencing the given subscriber collection.
+   */
+  EventHandle(SubscriberCollection<Args...>* subscribers) :
+      subscribers(subscribers)
+  {
+  }
+
+  /**
+   * @brief Get the referenced subscriber collection, or NULL for an empty handle.
+   */
+  SubscriberCollection<Args...>* get() const
+  {
+    return subscribers;
+  }
+
+  /**
+   * @brief Access the referenced subscriber collection.
+   */
+  SubscriberCollection<Args...>* operator->() const
+  {
+    return subscribers;
+  }
+
+  /**
+   * @brief Convert to the referenced subscriber collection, or NULL for an empty handle.
+   */
+  operator SubscriberCollection<Args...>*() const
+  {
+    return subscribers;
+  }
+};
+
+/**
+ * @brief EventHandle for the decayed argument types, see SubscriberCollectionDecay.
+ */
+template<typename... Args>
+using EventHandleDecay = EventHandle<typename std::decay<Args>::type...>;
+
+/**
+ * @brief Non-owning reference to an event name, used to look up events in the registry.
+ *
+ * An EventName is implicitly created from a string literal, a C string or a std::string, without
+ * allocating memory. The hash of the name is computed once on construction.
+ *
+ * The referenced characters are not copied, so they must outlive the EventName. This is always
+ * the case when passing a temporary EventName as method argument.
+ */
+class EventName
+{
+private:
+  const char* data;
+  std::size_t length;
+  std::size_t hash;
+
+public:
+  /**
+   * @brief Reference a null-terminated C string.
+   */
+  EventName(const char* name) :
+      data(name), length(std::strlen(name)), hash(computeHash(name, length))
+  {
+  }
+
+  /**
+   * @brief Reference the characters of a std::string.
+   */
+  EventName(const std::string& name) :
+      data(name.data()), length(name.size()), hash(computeHash(data, length))
+  {
+  }
+
+  /**
+   * @brief Reference a character range, which does not need to be null-terminated.
+   */
+  EventName(const char* name, std::size_t length) :
+      data(name), length(length), hash(computeHash(name, length))
+  {
+  }
+
+  /// @brief Get the referenced characters. They are not necessarily null-terminated.
+  const char* getData() const
+  {
+    return data;
+  }
+
+  /// @brief Get the number of characters.
+  std::size_t getLength() const
+  {
+    return length;
+  }
+
+  /// @brief Get the precomputed hash.
+  std::size_t getHash() const
+  {
+    return hash;
+  }
+
+  /// @brief Copy the name to a std::string.
+  std::string str() const
+  {
+    return std::string(data, length);
+  }
+
+  /// @brief Compare with a std::string.
+  bool operator==(const std::string& other) const
+  {
+    return length == other.size() && std::memcmp(data, other.data(), length) == 0;
+  }
+
+  /**
+   * @brief Compute the hash used by the registry, 64 or 32 bit FNV-1a depending on the size of std::size_t.
+   */
+  static std::size_t computeHash(const char* name, std::size_t length)
+  {
+    const bool wide = sizeof(std::size_t) > 4;
+    std::size_t result = wide ? static_cast<std::size_t>(14695981039346656037ULL) : 2166136261U;
+    const std::size_t prime = wide ? static_cast<std::size_t>(1099511628211ULL) : 16777619U;
+    for (std::size_t i = 0; i < length; ++i)
+    {
+      result ^= static_cast<unsigned char>(name[i]);
+      result *= prime;
+    }
+    return result;
+  }
+};
+
+/**
+ * @brief Print an event name.
+ */
+inline std::ostream& operator<<(std::ostream& os, const EventName& name)
+{
+  return os.write(name.getData(), name.getLength());
+}
+
 
 /**
  * @brief Stores subscriber collections for named events.
@@ -74,35 +249,259 @@ using SubscriberCollectionDecay = SubscriberCollection<typename std::decay<Args>
  * pointers are left untouched, so `std::string*` and `const std::string*` are not compatible,
  * even though there is an implicit conversion from the first to the second.
  *
- * The registry operations are guarded by the @link getRegistryMutex() registry mutex@endlink,
- * so the registry object is thread safe. The child subscriber collections are not guarded by
- * that mutex, so care must be taken when using them.
+ * The registry object is thread safe. Events are found through an open-addressing hash table
+ * whose entries are never removed, so lookups don't acquire any lock. Registering an event is
+ * guarded by the @link getRegistryMutex() registry mutex@endlink. Since the event graph is usually
+ * built at startup, this makes the registry effectively read-only afterwards. The child
+ * subscriber collections are not guarded by that mutex, they synchronize subscription changes
+ * on their own.
+ *
+ * Many events can be registered at once using reserve() and registerEvents(). Once all events are
+ * known, freeze() makes the registry immutable: further events are rejected, and lookups use a
+ * compact table that is built once and never changes.
  */
 class EventRegistry
 {
 private:
-  // subscriber collections for named events
+  // a registered event. Immutable once it is published in the lookup table.
+  struct Entry
+  {
+    std::string name;
+    std::size_t hash;
+    SubscriberCollectionBase* subscribers;
+    // type tag of the concrete subscriber collection type
+    const void* type;
+    // false for static events, which own their subscriber collection
+    bool owned;
+  };
+
+  // compact lookup table built by freeze(). The entries are copied into one array, and every slot
+  // holds the hash, so most mismatching slots are skipped without touching the entry.
+  struct FrozenTable
+  {
+    struct Slot
+    {
+      std::size_t hash;
+      const Entry* entry;
+    };
+
+    std::size_t mask;
+    std::vector<Slot> slots;
+    std::vector<Entry> entries;
+
+    const Entry* find(const EventName& name) const
+    {
+      for (std::size_t i = name.getHash() & mask;; i = (i + 1) & mask)
+      {
+        const Slot& slot = slots[i];
+        if (slot.entry == NULL)
+        {
+          return NULL;
+        }
+        if (slot.hash == name.getHash() && name == slot.entry->name)
+        {
+          return slot.entry;
+        }
+      }
+    }
+  };
+
+  // open-addressing hash table with linear probing. The capacity is a power of two.
+  // Slots are only ever filled, never cleared, so readers can probe without holding a lock.
+  struct LookupTable
+  {
+    explicit LookupTable(std::size_t capacity) :
+        mask(capacity - 1), slots(capacity)
+    {
+      for (auto& slot : slots)
+      {
+        slot.store(NULL, std::memory_order_relaxed);
+      }
+    }
+
+    std::size_t mask;
+    std::vector<std::atomic<const Entry*>> slots;
+  };
+
+  // registered events, in registration order. owns the entries.
+  std::vector<std::unique_ptr<Entry>> entries;
+  // all lookup tables created so far, the last one is current. Replaced tables are kept, since
+  // concurrent readers may still be probing them. Their sizes grow geometrically, so this
+  // at most doubles the memory used.
+  std::vector<std::unique_ptr<LookupTable>> lookupTables;
+  // the current lookup table
+  std::atomic<LookupTable*> lookupTable;
+  // the frozen lookup table, NULL until freeze() is called
+  std::unique_ptr<FrozenTable> frozen;
+  std::atomic<const FrozenTable*> frozenTable;
+  // ordered view of the registered events, for introspection and print()
   // the subscriber collection objects are owned by the event system.
   std::map<std::string, SubscriberCollectionBase*> subscribersByEventName;
-  // mutex for registry map
+  // mutex for registration
   mutable std::mutex registryMutex;
+
+  // find a registered event. Does not require the registry mutex.
+  const Entry* findEntry(const EventName& name) const
+  {
+    const FrozenTable* frozenEntries = frozenTable.load(std::memory_order_acquire);
+    if (frozenEntries != NULL)
+    {
+      return frozenEntries->find(name);
+    }
+    const LookupTable* table = lookupTable.load(std::memory_order_acquire);
+    for (std::size_t i = name.getHash() & table->mask;; i = (i + 1) & table->mask)
+    {
+      const Entry* entry = table->slots[i].load(std::memory_order_acquire);
+      if (entry == NULL)
+      {
+        return NULL;
+      }
+      if (entry->hash == name.getHash() && name == entry->name)
+      {
+        return entry;
+      }
+    }
+  }
+
+  // put an entry into the first free slot of it's probe sequence.
+  static void insertEntry(LookupTable& table, const Entry* entry)
+  {
+    std::size_t i = entry->hash & table.mask;
+    while (table.slots[i].load(std::memory_order_relaxed) != NULL)
+    {
+      i = (i + 1) & table.mask;
+    }
+    // release: publish the entry contents to readers
+    table.slots[i].store(entry, std::memory_order_release);
+  }
+
+  // make room for the given total number of events. The registry mutex must be held.
+  void reserveEntries(std::size_t count)
+  {
+    LookupTable* table = lookupTable.load(std::memory_order_relaxed);
+    if (count * 2 > table->slots.size())
+    {
+      // keep the load factor below 1/2. Fill a larger table before publishing it.
+      std::size_t capacity = table->slots.size() * 2;
+      while (count * 2 > capacity)
+      {
+        capacity *= 2;
+      }
+      std::unique_ptr<LookupTable> grown(new LookupTable(capacity));
+      for (auto& existing : entries)
+      {
+        insertEntry(*grown, existing.get());
+      }
+      lookupTables.push_back(std::move(grown));
+      lookupTable.store(lookupTables.back().get(), std::memory_order_release);
+    }
+    if (count > entries.capacity())
+    {
+      entries.reserve(std::max(count, entries.capacity() * 2));
+    }
+  }
+
+  // throw if no new events may be registered. The registry mutex must be held.
+  void checkNotFrozen(const EventName& name) const
+  {
+    if (frozen)
+    {
+      std::ostringstream os;
+      os << "Cannot register the event named '" << name << "', the event registry is frozen!";
+      throw std::logic_error(os.str());
+    }
+  }
+
+  // add a new event. The registry mutex must be held, the registry must not be frozen, and the
+  // event must not be registered yet.
+  template<typename Collection>
+  void addEntry(const EventName& name, Collection* subscribers, bool owned)
+  {
+    std::unique_ptr<Entry> entry(new Entry {name.str(), name.getHash(), subscribers,
+        detail::getTypeTag<Collection>(), owned});
+
+    reserveEntries(entries.size() + 1);
+    subscribersByEventName.emplace(entry->name, subscribers);
+    entries.push_back(std::move(entry));
+    insertEntry(*lookupTable.load(std::memory_order_relaxed), entries.back().get());
+  }
+
+  // cast an entry to the concrete subscriber collection type, or return NULL if the type does not match.
+  template<typename Collection>
+  static Collection* castEntry(const Entry* entry)
+  {
+    if (entry->type == detail::getTypeTag<Collection>())
+    {
+      return static_cast<Collection*>(entry->subscribers);
+    }
+    // the type tags may differ across shared library boundaries, use dynamic_cast to be sure.
+    return dynamic_cast<Collection*>(entry->subscribers);
+  }
+
+  // throw the error for mismatched argument types.
+  template<typename ...Args>
+  static void throwArgsMismatch(const EventName& name, const Entry* entry)
+  {
+    std::ostringstream os;
+    os << "The argument types for the event named '" << name << "' are:" << std::endl <<"\t";
+    entry->subscribers->appendEventArgsDescription(os);
+    os << std::endl << "but getHandlers was invoked with:" << std::endl <<"\t";
+    appendArgsDescription<Args...>(os);
+    throw std::invalid_argument(os.str());
+  }
+
+  // write a string as quoted JSON string.
+  static void writeJsonString(std::ostream& os, const std::string& text)
+  {
+    static const char hexDigits[] = "0123456789abcdef";
+    os << '"';
+    for (char c : text)
+    {
+      unsigned char u = static_cast<unsigned char>(c);
+      if (c == '"' || c == '\\')
+      {
+        os << '\\' << c;
+      }
+      else if (u < 0x20)
+      {
+        os << "\\u00" << hexDigits[u >> 4] << hexDigits[u & 0xF];
+      }
+      else
+      {
+        os << c;
+      }
+    }
+    os << '"';
+  }
+
 public:
 
+  EventRegistry() :
+      lookupTable(NULL), frozenTable(NULL)
+  {
+    lookupTables.emplace_back(new LookupTable(16));
+    lookupTable.store(lookupTables.back().get(), std::memory_order_release);
+  }
+
   ~EventRegistry()
   {
     // delete all registered subscriber collections
-    for (auto& entry: subscribersByEventName)
+    for (auto& entry: entries)
     {
-      delete entry.second;
+      if (entry->owned)
+      {
+        delete entry->subscribers;
+      }
     }
+    entries.clear();
     subscribersByEventName.clear();
   }
 
   /**
-   * @brief Get the mutex which guards all interactions with the registry.
+   * @brief Get the mutex which guards registering events.
    *
-   * This mutex ensures that the registry is thread-safe. However, the
-   * individual subscriber collections are not guarded by this mutex.
+   * This mutex ensures that the registry is thread-safe. Looking up events does not need it.
+   * The individual subscriber collections are not guarded by this mutex.
    */
   std::mutex& getRegistryMutex() const
   {
@@ -123,25 +522,19 @@ public:
   }
 
   template<typename ...Args>
-  bool hasRegisteredEvent(std::string name)
+  bool hasRegisteredEvent(const EventName& name)
   {
-    // aquire mutex - released automatically on return
-    std::unique_lock<std::mutex> lock(registryMutex);
-
     // check if the event was registered before
-    auto existing = subscribersByEventName.find(name);
+    const Entry* existing = findEntry(name);
 
     // no such name - return failure
-    if (existing == subscribersByEventName.end())
+    if (existing == NULL)
     {
       return false;
     }
 
     // duplicate, check that the template args match
-    SubscriberCollectionBase* hcBase = existing->second;
-
-    // use dynamic_cast to properly detect failure
-    auto hc = dynamic_cast<SubscriberCollectionDecay<Args...>* >(hcBase);
+    auto hc = castEntry<SubscriberCollectionDecay<Args...>>(existing);
 
     if (hc == NULL)
     {
@@ -161,32 +554,76 @@ public:
      * @tparam Args event argument types
      * @param name event name
      *
-     * @return subscriber collection for the registered event.
+     * @return handle of the subscriber collection for the registered event.
      *
      * @throws std::invalid_argument if the event is already registered.
+     * @throws std::logic_error if the registry is frozen.
      */
   template<typename ...Args>
-  SubscriberCollectionDecay<Args...>* registerEvent(std::string name)
+  EventHandleDecay<Args...> registerEvent(const EventName& name)
   {
     // aquire mutex - released automatically on return
     std::unique_lock<std::mutex> lock(registryMutex);
     // check if the event was registered before
-    auto existing = subscribersByEventName.find(name);
-    if (existing != subscribersByEventName.end())
+    if (findEntry(name) != NULL)
     {
       // duplicate
       std::ostringstream os;
       os << "The event named '" << name << "' has already been registered!";
       throw std::invalid_argument(os.str());
     }
+    checkNotFrozen(name);
 
-    // allocate subscriber collection
-    auto hc = new SubscriberCollectionDecay<Args...>;
+    // allocate subscriber collection, owned by the registry once it is stored
+    std::unique_ptr<SubscriberCollectionDecay<Args...>> hc(new SubscriberCollectionDecay<Args...>);
 
     // store it
-    subscribersByEventName.emplace(name, hc);
+    addEntry(name, hc.get(), true);
 
     // return the new subscriber collection
+    return hc.release();
+  }
+
+  /**
+   * @brief Add a static event to the registry.
+   *
+   * The static event's subscriber collection is made available under the tag name, so it can be
+   * found through getRegisteredEvents() and the by-name methods. It is not owned by the registry.
+   *
+   * Unlike registerEvent(), registering the same static event again is allowed and does nothing.
+   *
+   * @tparam Tag static event tag, defined using ES_DEFINE_EVENT
+   *
+   * @return handle of the static event's subscriber collection.
+   *
+   * @throws std::invalid_argument if a different event with the tag name is already registered.
+   * @throws std::logic_error if the event is not registered yet and the registry is frozen.
+   */
+  template<typename Tag>
+  typename Tag::Handle registerStaticEvent()
+  {
+    auto hc = &Tag::getSubscribers();
+
+    // aquire mutex - released automatically on return
+    std::unique_lock<std::mutex> lock(registryMutex);
+    // check if the event was registered before
+    const Entry* existing = findEntry(Tag::getName());
+    if (existing != NULL)
+    {
+      if (existing->subscribers != hc)
+      {
+        // a dynamic event or a static event of another namespace has the same name
+        std::ostringstream os;
+        os << "The event named '" << Tag::getName() << "' has already been registered!";
+        throw std::invalid_argument(os.str());
+      }
+      return hc;
+    }
+    checkNotFrozen(Tag::getName());
+
+    // store it, but remember not to delete it
+    addEntry(Tag::getName(), hc, false);
+
     return hc;
   }
 
@@ -204,30 +641,21 @@ public:
    * @throws std::invalid_argument if the event argument types don't match.
    */
   template<typename ...Args>
-  SubscriberCollectionDecay<Args...>* getSubscribers(std::string name)
+  SubscriberCollectionDecay<Args...>* getSubscribers(const EventName& name)
   {
-    // aquire mutex - released automatically on return
-    std::unique_lock<std::mutex> lock(registryMutex);
-    // locate in map
-    auto entry = subscribersByEventName.find(name);
-    if (entry == subscribersByEventName.end())
+    // locate in table
+    const Entry* entry = findEntry(name);
+    if (entry == NULL)
     {
       // does not exist
       return NULL;
     }
-    SubscriberCollectionBase* hcBase = entry->second;
     // now, cast to the concrete templated SubscriberCollection.
-    // use dynamic_cast to properly detect failure
-    auto hc = dynamic_cast<SubscriberCollectionDecay<Args...>* >(hcBase);
+    auto hc = castEntry<SubscriberCollectionDecay<Args...>>(entry);
     if (hc == NULL)
     {
       // the cast failed, so the template arguments do not match.
-      std::ostringstream os;
-      os << "The argument types for the event named '" << name << "' are:" << std::endl <<"\t";
-      hcBase->appendEventArgsDescription(os);
-      os << std::endl << "but getHandlers was invoked with:" << std::endl <<"\t";
-      appendArgsDescription<Args...>(os);
-      throw std::invalid_argument(os.str());
+      throwArgsMismatch<Args...>(name, entry);
     }
     // return it
     return hc;
@@ -243,18 +671,16 @@ public:
    *
    * @return subscriber collection for the registered event, or NULL if the event was not registered.
    */
-  SubscriberCollectionBase* getSubscribers(std::string name)
+  SubscriberCollectionBase* getSubscribers(const EventName& name)
   {
-    // aquire mutex - released automatically on return
-    std::unique_lock<std::mutex> lock(registryMutex);
-    // locate in map
-    auto entry = subscribersByEventName.find(name);
-    if (entry == subscribersByEventName.end())
+    // locate in table
+    const Entry* entry = findEntry(name);
+    if (entry == NULL)
     {
       // does not exist
       return NULL;
     }
-    return entry->second;
+    return entry->subscribers;
   }
 
   /**
@@ -270,45 +696,216 @@ public:
    * @tparam Args event argument types
    * @param name event name
    *
-   * @return subscriber collection for the registered event.
+   * @return handle of the subscriber collection for the registered event.
    *
    * @throws std::invalid_argument if the event is known and the event argument types don't match.
+   * @throws std::logic_error if the event is not known and the registry is frozen.
    */
   template<typename ...Args>
-  SubscriberCollectionDecay<Args...>* getOrRegister(std::string name)
+  EventHandleDecay<Args...> getOrRegister(const EventName& name)
   {
-    // aquire mutex - released automatically on return
-    std::unique_lock<std::mutex> lock(registryMutex);
-    // check if the event was registered before
-    auto existing = subscribersByEventName.find(name);
-    if (existing != subscribersByEventName.end())
+    // check if the event was registered before, without locking
+    const Entry* existing = findEntry(name);
+    std::unique_lock<std::mutex> lock(registryMutex, std::defer_lock);
+    if (existing == NULL)
+    {
+      // aquire mutex and check again, another thread may have registered it meanwhile
+      lock.lock();
+      existing = findEntry(name);
+    }
+    if (existing != NULL)
     {
       // duplicate, check that the template args match
-      SubscriberCollectionBase* hcBase = existing->second;
-      // use dynamic_cast to properly detect failure
-      auto hc = dynamic_cast<SubscriberCollectionDecay<Args...>* >(hcBase);
+      auto hc = castEntry<SubscriberCollectionDecay<Args...>>(existing);
       if (hc == NULL)
       {
         // the cast failed, so the template arguments do not match.
-        std::ostringstream os;
-        os << "The argument types for the event named '" << name << "' are:" << std::endl <<"\t";
-        hcBase->appendEventArgsDescription(os);
-        os << std::endl << "but getHandlers was invoked with:" << std::endl <<"\t";
-        appendArgsDescription<Args...>(os);
-        throw std::invalid_argument(os.str());
+        throwArgsMismatch<Args...>(name, existing);
       }
       // return it
       return hc;
     }
+    checkNotFrozen(name);
 
-    // allocate subscriber collection
-    auto hc = new SubscriberCollectionDecay<Args...>;
+    // allocate subscriber collection, owned by the registry once it is stored
+    std::unique_ptr<SubscriberCollectionDecay<Args...>> hc(new SubscriberCollectionDecay<Args...>);
 
     // store it
-    subscribersByEventName.emplace(name, hc);
+    addEntry(name, hc.get(), true);
 
     // return the new subscriber collection
-    return hc;
+    return hc.release();
+  }
+
+  /**
+   * @brief Prepare the registry for the given total number of events.
+   *
+   * Registering many events one by one repeatedly grows the lookup table. Reserving the final
+   * number of events first sizes it once. It is not an error to register more events later.
+   *
+   * @param count expected total number of registered events.
+   */
+  void reserve(std::size_t count)
+  {
+    // aquire mutex - released automatically on return
+    std::unique_lock<std::mutex> lock(registryMutex);
+    if (!frozen)
+    {
+      reserveEntries(count);
+    }
+  }
+
+  /**
+   * @brief Retrieve or register several events with the same argument types in one pass.
+   *
+   * This behaves like calling getOrRegister() for every name, but the registry mutex is only
+   * acquired once and the lookup table is sized for all new events up front. All names are
+   * checked before anything is registered, and the new events are only added once all of them are
+   * allocated. So if an exception is thrown, no event was added.
+   *
+   * @tparam Args event argument types
+   * @param names event names. A name may be listed more than once.
+   *
+   * @return handles of the subscriber collections, in the order of the names.
+   *
+   * @throws std::invalid_argument if a known event has different argument types.
+   * @throws std::logic_error if a name is not registered yet and the registry is frozen.
+   */
+  template<typename ...Args>
+  std::vector<EventHandleDecay<Args...>> registerEvents(const std::vector<EventName>& names)
+  {
+    std::vector<EventHandleDecay<Args...>> result(names.size());
+
+    // aquire mutex - released automatically on return
+    std::unique_lock<std::mutex> lock(registryMutex);
+
+    // resolve the known events first
+    std::size_t missing = 0;
+    for (std::size_t i = 0; i < names.size(); ++i)
+    {
+      const Entry* existing = findEntry(names[i]);
+      if (existing == NULL)
+      {
+        checkNotFrozen(names[i]);
+        missing++;
+        continue;
+      }
+      auto hc = castEntry<SubscriberCollectionDecay<Args...>>(existing);
+      if (hc == NULL)
+      {
+        // the cast failed, so the template arguments do not match.
+        throwArgsMismatch<Args...>(names[i], existing);
+      }
+      result[i] = hc;
+    }
+    if (missing == 0)
+    {
+      return result;
+    }
+
+    // register the rest. Everything that may throw is done before the first entry is published,
+    // and undone if it fails, so readers never see an event that is removed again.
+    typedef SubscriberCollectionDecay<Args...> Collection;
+    reserveEntries(entries.size() + missing);
+    std::vector<std::unique_ptr<Collection>> collections;
+    std::vector<std::unique_ptr<Entry>> added;
+    std::vector<std::map<std::string, SubscriberCollectionBase*>::iterator> named;
+    collections.reserve(missing);
+    added.reserve(missing);
+    named.reserve(missing);
+    try
+    {
+      for (std::size_t i = 0; i < names.size(); ++i)
+      {
+        if (result[i].get() != NULL)
+        {
+          continue;
+        }
+        // the name may have been listed before
+        auto previous = subscribersByEventName.find(names[i].str());
+        if (previous != subscribersByEventName.end())
+        {
+          result[i] = static_cast<Collection*>(previous->second);
+          continue;
+        }
+        collections.emplace_back(new Collection);
+        added.emplace_back(new Entry {names[i].str(), names[i].getHash(), collections.back().get(),
+            detail::getTypeTag<Collection>(), true});
+        named.push_back(subscribersByEventName.emplace(added.back()->name, collections.back().get()).first);
+        result[i] = collections.back().get();
+      }
+    }
+    catch (...)
+    {
+      for (auto& name : named)
+      {
+        subscribersByEventName.erase(name);
+      }
+      throw;
+    }
+
+    // the space is reserved, so publishing doesn't throw
+    for (std::size_t i = 0; i < added.size(); ++i)
+    {
+      entries.push_back(std::move(added[i]));
+      insertEntry(*lookupTable.load(std::memory_order_relaxed), entries.back().get());
+      collections[i].release();
+    }
+    return result;
+  }
+
+  /**
+   * @brief Make the set of registered events immutable.
+   *
+   * Afterwards, all attempts to register a new event throw std::logic_error, while events that
+   * are already known can still be retrieved by every method, including getOrRegister(). The
+   * lookups use a compact table that holds copies of all entries in one array, which is faster
+   * than the growable table used before.
+   *
+   * Subscribing to and publishing events is not affected. Freezing an already frozen registry
+   * does nothing.
+   */
+  void freeze()
+  {
+    // aquire mutex - released automatically on return
+    std::unique_lock<std::mutex> lock(registryMutex);
+    if (frozen)
+    {
+      return;
+    }
+
+    std::unique_ptr<FrozenTable> table(new FrozenTable);
+    std::size_t capacity = 16;
+    while (entries.size() * 2 > capacity)
+    {
+      capacity *= 2;
+    }
+    table->mask = capacity - 1;
+    table->slots.resize(capacity, FrozenTable::Slot {0, NULL});
+    table->entries.reserve(entries.size());
+    for (auto& entry : entries)
+    {
+      table->entries.push_back(*entry);
+      const Entry* copy = &table->entries.back();
+      std::size_t i = copy->hash & table->mask;
+      while (table->slots[i].entry != NULL)
+      {
+        i = (i + 1) & table->mask;
+      }
+      table->slots[i] = FrozenTable::Slot {copy->hash, copy};
+    }
+
+    frozen = std::move(table);
+    // release: publish the table contents to readers
+    frozenTable.store(frozen.get(), std::memory_order_release);
+  }
+
+  /**
+   * @brief Check whether freeze() was called.
+   */
+  bool isFrozen() const
+  {
+    return frozenTable.load(std::memory_order_acquire) != NULL;
   }
 
   /**
@@ -375,6 +972,225 @@ public:
 
     }
   }
+
+  /**
+   * @brief Get the instrumentation data of all registered events, ordered by name.
+   *
+   * The data is only recorded while the instrumentation is enabled, see setInstrumentationEnabled().
+   * The values are read without stopping the writers, so a snapshot taken while events are
+   * published or processed may be slightly inconsistent.
+   */
+  std::vector<EventInstrumentationSnapshot> getInstrumentation() const
+  {
+    // aquire mutex - released automatically on return
+    std::unique_lock<std::mutex> lock(registryMutex);
+
+    std::vector<EventInstrumentationSnapshot> result(subscribersByEventName.size());
+    std::size_t idx = 0;
+    for (auto& entry : subscribersByEventName)
+    {
+      result[idx].name = entry.first;
+      entry.second->getInstrumentation(result[idx]);
+      idx++;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Print the instrumentation data of all registered events to the given output stream.
+   *
+   * Events that were neither queued nor called are skipped. Times are given in microseconds.
+   *
+   * @param os Output stream to print to.
+   */
+  void printInstrumentation(std::ostream& os) const
+  {
+    for (auto& event : getInstrumentation())
+    {
+      bool called = false;
+      for (auto& subscriber : event.subscribers)
+      {
+        called = called || subscriber.calls != 0;
+      }
+      if (event.published == 0 && event.fired == 0 && !called)
+      {
+        continue;
+      }
+
+      os << "Event " << event.name << ": " << event.published << " queued (" << event.publishRate << "/s), "
+         << event.fired << " processed" << std::endl;
+      if (event.fired != 0)
+      {
+        os << "\tqueue delay mean " << event.queueDelay.getMeanNs() / 1000
+           << " p99 " << event.queueDelay.getPercentileNs(99) / 1000.0
+           << " max " << event.queueDelay.maxNs / 1000.0 << std::endl;
+        os << "\tresidency mean " << event.residency.getMeanNs() / 1000
+           << " p99 " << event.residency.getPercentileNs(99) / 1000.0
+           << " max " << event.residency.maxNs / 1000.0 << std::endl;
+      }
+      for (auto& subscriber : event.subscribers)
+      {
+        os << "\tsubscriber " << subscriber.id;
+        if (subscriber.pinnedRoute != 0)
+        {
+          os << " (pinned route " << subscriber.pinnedRoute << ")";
+        }
+        os << ": " << subscriber.calls << " calls, mean "
+           << (subscriber.calls == 0 ? 0.0 : subscriber.totalNs / 1000.0 / subscriber.calls)
+           << " max " << subscriber.maxNs / 1000.0 << std::endl;
+      }
+    }
+  }
+
+  /**
+   * @brief Write the graph of the registered events as JSON, for the event graph viewer.
+   *
+   * The output has the format read by utils/event_visualization/event-graph.html, an array of
+   * cytoscape elements like the one produced offline by utils/event-graph.py. Every event becomes
+   * a group containing one publisher node and one node per subscriber, with an edge from the
+   * publisher to every subscriber. At runtime, subscribers are only known by their id, so the nodes
+   * don't have a sourceLine, and subscriber nodes have a subscriberId instead.
+   *
+   * The nodes and edges carry the current instrumentation data, see getInstrumentation(). Times are
+   * given in microseconds, and a summary is put into the comments shown by the viewer.
+   * - publisher: subscriberCount, published, publishRate, fired, queueDelayMeanUs, queueDelayP99Us,
+   *   residencyMeanUs and residencyP99Us
+   * - subscriber and edge: calls, rate, meanUs, maxUs, load and pinnedRoute
+   *
+   * Subscribers pinned to another queue, see EventSystem::subscribeOn(), are part of their event's
+   * group. Their pinnedRoute is non-zero, and it is part of their node id.
+   *
+   * The rate of a subscriber is estimated from the publish rate of it's event. The load is the
+   * fraction of the time spent in all subscribers of all events that was spent in this subscriber,
+   * which the viewer uses as edge width.
+   *
+   * @param os Output stream to write to.
+   */
+  void exportGraph(std::ostream& os) const
+  {
+    struct Event
+    {
+      EventInstrumentationSnapshot snapshot;
+      std::string signature;
+      std::size_t subscriberCount;
+    };
+    std::vector<Event> events;
+    {
+      // aquire mutex - released at the end of the block
+      std::unique_lock<std::mutex> lock(registryMutex);
+      events.resize(subscribersByEventName.size());
+      std::size_t idx = 0;
+      for (auto& entry : subscribersByEventName)
+      {
+        Event& event = events[idx++];
+        event.snapshot.name = entry.first;
+        entry.second->getInstrumentation(event.snapshot);
+        std::ostringstream signature;
+        entry.second->appendEventArgsDescription(signature);
+        // strip the brackets, the viewer expects comma separated types like event-graph.py writes them
+        event.signature = signature.str().substr(1, signature.str().size() - 2);
+        if (event.signature.empty())
+        {
+          event.signature = "(void)";
+        }
+        event.subscriberCount = entry.second->getHandlerCount();
+      }
+    }
+
+    double totalNs = 0;
+    for (auto& event : events)
+    {
+      for (auto& subscriber : event.snapshot.subscribers)
+      {
+        totalNs += subscriber.totalNs;
+      }
+    }
+
+    const char* separator = "\n  ";
+    os << "[";
+    for (auto& event : events)
+    {
+      const EventInstrumentationSnapshot& snapshot = event.snapshot;
+      const std::string publisherId = snapshot.name + "::publisher";
+
+      // the group node
+      os << separator << "{\"data\": {\"id\": ";
+      writeJsonString(os, snapshot.name);
+      os << "}, \"classes\": \"group\"}";
+      separator = ",\n  ";
+
+      std::ostringstream comments;
+      comments << event.subscriberCount << " subscribers\n" << snapshot.published << " queued ("
+               << snapshot.publishRate << "/s), " << snapshot.fired << " processed\nqueue delay mean "
+               << snapshot.queueDelay.getMeanNs() / 1000 << " us, p99 " << snapshot.queueDelay.getPercentileNs(99) / 1000.0
+               << " us\nresidency mean " << snapshot.residency.getMeanNs() / 1000 << " us, p99 "
+               << snapshot.residency.getPercentileNs(99) / 1000.0 << " us";
+
+      os << separator << "{\"data\": {\"id\": ";
+      writeJsonString(os, publisherId);
+      os << ", \"kind\": \"publisher\", \"eventName\": ";
+      writeJsonString(os, snapshot.name);
+      os << ", \"parent\": ";
+      writeJsonString(os, snapshot.name);
+      os << ", \"signature\": ";
+      writeJsonString(os, event.signature);
+      os << ", \"sourceFile\": \"runtime\", \"comments\": ";
+      writeJsonString(os, comments.str());
+      os << ", \"subscriberCount\": " << event.subscriberCount << ", \"published\": " << snapshot.published
+         << ", \"publishRate\": " << snapshot.publishRate << ", \"fired\": " << snapshot.fired
+         << ", \"queueDelayMeanUs\": " << snapshot.queueDelay.getMeanNs() / 1000
+         << ", \"queueDelayP99Us\": " << snapshot.queueDelay.getPercentileNs(99) / 1000.0
+         << ", \"residencyMeanUs\": " << snapshot.residency.getMeanNs() / 1000
+         << ", \"residencyP99Us\": " << snapshot.residency.getPercentileNs(99) / 1000.0
+         << "}, \"classes\": \"publisher\"}";
+
+      for (auto& subscriber : snapshot.subscribers)
+      {
+        // ids are only unique per collection, so pinned subscribers get the route in their node id
+        const std::string subscriberId = snapshot.name
+            + (subscriber.pinnedRoute == 0 ? "" : "::pinned" + std::to_string(subscriber.pinnedRoute))
+            + "::subscriber" + std::to_string(subscriber.id);
+        double rate = snapshot.published == 0 ? 0.0 : snapshot.publishRate * subscriber.calls / snapshot.published;
+        double meanUs = subscriber.calls == 0 ? 0.0 : subscriber.totalNs / 1000.0 / subscriber.calls;
+        double load = totalNs == 0 ? 0.0 : subscriber.totalNs / totalNs;
+
+        std::ostringstream statistics;
+        statistics << ", \"calls\": " << subscriber.calls << ", \"rate\": " << rate << ", \"meanUs\": " << meanUs
+                   << ", \"maxUs\": " << subscriber.maxNs / 1000.0 << ", \"load\": " << load
+                   << ", \"pinnedRoute\": " << subscriber.pinnedRoute;
+        std::ostringstream subscriberComments;
+        subscriberComments << subscriber.calls << " calls (" << rate << "/s)\nmean " << meanUs << " us, max "
+                           << subscriber.maxNs / 1000.0 << " us\n" << load * 100 << "% of the subscriber time";
+        if (subscriber.pinnedRoute != 0)
+        {
+          subscriberComments << "\npinned to queue route " << subscriber.pinnedRoute;
+        }
+
+        os << separator << "{\"data\": {\"id\": ";
+        writeJsonString(os, subscriberId);
+        os << ", \"kind\": \"subscriber\", \"eventName\": ";
+        writeJsonString(os, snapshot.name);
+        os << ", \"parent\": ";
+        writeJsonString(os, snapshot.name);
+        os << ", \"signature\": ";
+        writeJsonString(os, event.signature);
+        os << ", \"sourceFile\": \"runtime\", \"subscriberId\": " << subscriber.id << ", \"comments\": ";
+        writeJsonString(os, subscriberComments.str());
+        os << statistics.str() << "}, \"classes\": \"subscriber\"}";
+
+        os << separator << "{\"data\": {\"id\": ";
+        writeJsonString(os, publisherId + "__" + subscriberId);
+        os << ", \"source\": ";
+        writeJsonString(os, publisherId);
+        os << ", \"target\": ";
+        writeJsonString(os, subscriberId);
+        os << ", \"eventName\": ";
+        writeJsonString(os, snapshot.name);
+        os << statistics.str() << "}, \"classes\": \"\"}";
+      }
+    }
+    os << "\n]\n";
+  }
 };
 
 }  // namespace ES
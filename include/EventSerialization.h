@@ -0,0 +1,473 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTSERIALIZATION_H
+#define EVENTSERIALIZATION_H
+
+#include "EventSystemUtils.h"
+#include "EventSubscription.h"
+#include "EventShared.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ES {
+
+// forward define event queue and handler collection, they are required for the forward-declared methods.
+class EventQueue;
+
+template<typename... Args>
+class SubscriberCollection;
+
+/**
+ * @brief Appends binary values to a byte buffer.
+ *
+ * Values are written in the native byte order, so serialized data can only be read on machines
+ * of the same architecture.
+ */
+class BinaryWriter
+{
+private:
+  std::vector<char>& buffer;
+
+public:
+  /**
+   * @brief Create a writer appending to the given buffer.
+   */
+  explicit BinaryWriter(std::vector<char>& buffer) :
+      buffer(buffer)
+  {
+  }
+
+  /// @brief Append raw bytes.
+  void writeBytes(const void* data, std::size_t size)
+  {
+    const char* bytes = static_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+  }
+
+  /// @brief Append a trivially copyable value.
+  template<typename T>
+  void writeValue(const T& value)
+  {
+    writeBytes(&value, sizeof(T));
+  }
+
+  /**
+   * @brief Append a length or element count.
+   *
+   * @throws std::invalid_argument if the size exceeds 32 bits.
+   */
+  void writeSize(std::size_t size)
+  {
+    if (size > 0xFFFFFFFFu)
+    {
+      throw std::invalid_argument("Serialized size exceeds 32 bits");
+    }
+    writeValue(static_cast<std::uint32_t>(size));
+  }
+};
+
+/**
+ * @brief Reads binary values from a byte range. The range is not copied.
+ */
+class BinaryReader
+{
+private:
+  const char* cur;
+  const char* end;
+
+public:
+  /**
+   * @brief Create a reader for the given byte range.
+   */
+  BinaryReader(const char* data, std::size_t size) :
+      cur(data), end(data + size)
+  {
+  }
+
+  /**
+   * @brief Consume the given number of bytes and return a pointer to them, without copying.
+   *
+   * @throws std::invalid_argument if less bytes are left.
+   */
+  const char* readBytes(std::size_t size)
+  {
+    if (static_cast<std::size_t>(end - cur) < size)
+    {
+      throw std::invalid_argument("Truncated binary data");
+    }
+    const char* result = cur;
+    cur += size;
+    return result;
+  }
+
+  /// @brief Read a trivially copyable value.
+  template<typename T>
+  T readValue()
+  {
+    T value;
+    std::memcpy(&value, readBytes(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  /// @brief Read a length or element count written by BinaryWriter::writeSize().
+  std::size_t readSize()
+  {
+    return readValue<std::uint32_t>();
+  }
+
+  /// @brief Get the number of bytes left.
+  std::size_t remaining() const
+  {
+    return end - cur;
+  }
+};
+
+namespace detail
+{
+
+// std::is_trivially_copyable is missing in GCC 4.8
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+template<typename T>
+struct is_trivially_copyable : std::integral_constant<bool, __has_trivial_copy(T)>
+{
+};
+#else
+template<typename T>
+struct is_trivially_copyable : std::is_trivially_copyable<T>
+{
+};
+#endif
+
+// types that are serialized by copying their bytes. Pointers are excluded, they are meaningless in another process.
+template<typename T>
+struct is_bitwise_serializable : std::integral_constant<bool,
+    is_trivially_copyable<T>::value && !std::is_pointer<T>::value && !std::is_member_pointer<T>::value>
+{
+};
+
+}  // namespace detail
+
+/**
+ * @brief Converts event arguments to and from a binary representation.
+ *
+ * Like ParameterValueParser, specialize this template struct to support more types.
+ * Every specialization must define:
+ * - A static constexpr bool field 'supported'.
+ * - A static method write, taking a BinaryWriter& and a const T&.
+ * - A static method read, taking a BinaryReader& and returning the value.
+ *
+ * Specializations are provided for trivially copyable types except pointers, std::string,
+ * std::vector of supported types and Shared of supported types.
+ *
+ * The default specialization is not supported, it's methods throw std::logic_error.
+ *
+ * @tparam T argument type
+ * @tparam SFINAE unused, but may be used to enable conditional specializations.
+ */
+template<typename T, typename SFINAE = void>
+struct BinarySerializer {
+  /// @brief True if T can be serialized.
+  static constexpr bool supported = false;
+
+  /**
+   * @brief Append the value to the writer.
+   *
+   * @throws std::logic_error for the default specialization.
+   */
+  static void write(BinaryWriter&, const T&) {
+    throw std::logic_error("Cannot serialize an unsupported argument type.");
+  }
+
+  /**
+   * @brief Read a value written with write().
+   *
+   * @throws std::invalid_argument if the data is truncated.
+   * @throws std::logic_error for the default specialization.
+   */
+  static T read(BinaryReader&) {
+    throw std::logic_error("Cannot deserialize an unsupported argument type.");
+  }
+};
+
+/// @brief BinarySerializer for trivially copyable types, which are copied byte by byte.
+template<typename T>
+struct BinarySerializer<T, typename std::enable_if<detail::is_bitwise_serializable<T>::value>::type> {
+  static constexpr bool supported = true;
+
+  static void write(BinaryWriter& out, const T& value) {
+    out.writeValue(value);
+  }
+
+  static T read(BinaryReader& in) {
+    return in.readValue<T>();
+  }
+};
+
+/// @brief BinarySerializer for std::string, stored as length and characters.
+template<>
+struct BinarySerializer<std::string> {
+  static constexpr bool supported = true;
+
+  static void write(BinaryWriter& out, const std::string& value) {
+    out.writeSize(value.size());
+    out.writeBytes(value.data(), value.size());
+  }
+
+  static std::string read(BinaryReader& in) {
+    std::size_t size = in.readSize();
+    return std::string(in.readBytes(size), size);
+  }
+};
+
+/// @brief BinarySerializer for std::vector, stored as element count and elements.
+template<typename T, typename Allocator>
+struct BinarySerializer<std::vector<T, Allocator>, typename std::enable_if<BinarySerializer<T>::supported>::type> {
+  static constexpr bool supported = true;
+
+  static void write(BinaryWriter& out, const std::vector<T, Allocator>& value) {
+    out.writeSize(value.size());
+    writeElements(out, value, std::integral_constant<bool, bulk>());
+  }
+
+  static std::vector<T, Allocator> read(BinaryReader& in) {
+    std::size_t size = in.readSize();
+    std::vector<T, Allocator> result;
+    readElements(in, size, result, std::integral_constant<bool, bulk>());
+    return result;
+  }
+
+private:
+  // trivially copyable elements are copied as a whole. std::vector<bool> has no contiguous storage.
+  static constexpr bool bulk = detail::is_bitwise_serializable<T>::value && !std::is_same<T, bool>::value;
+
+  static void writeElements(BinaryWriter& out, const std::vector<T, Allocator>& value, std::true_type) {
+    out.writeBytes(value.data(), value.size() * sizeof(T));
+  }
+  static void writeElements(BinaryWriter& out, const std::vector<T, Allocator>& value, std::false_type) {
+    for (std::size_t i = 0; i < value.size(); ++i) {
+      BinarySerializer<T>::write(out, value[i]);
+    }
+  }
+  static void readElements(BinaryReader& in, std::size_t size, std::vector<T, Allocator>& result, std::true_type) {
+    // check the size before allocating
+    if (in.remaining() / sizeof(T) < size) {
+      throw std::invalid_argument("Truncated binary data");
+    }
+    result.resize(size);
+    std::memcpy(result.data(), in.readBytes(size * sizeof(T)), size * sizeof(T));
+  }
+  static void readElements(BinaryReader& in, std::size_t size, std::vector<T, Allocator>& result, std::false_type) {
+    for (std::size_t i = 0; i < size; ++i) {
+      result.push_back(BinarySerializer<T>::read(in));
+    }
+  }
+};
+
+/// @brief BinarySerializer for shared payloads, stored as presence flag and payload.
+template<typename T>
+struct BinarySerializer<Shared<T>, typename std::enable_if<BinarySerializer<T>::supported>::type> {
+  static constexpr bool supported = true;
+
+  static void write(BinaryWriter& out, const Shared<T>& value) {
+    out.writeValue<std::uint8_t>(value ? 1 : 0);
+    if (value) {
+      BinarySerializer<T>::write(out, *value);
+    }
+  }
+
+  static Shared<T> read(BinaryReader& in) {
+    if (in.readValue<std::uint8_t>() == 0) {
+      return Shared<T>();
+    }
+    return Shared<T>(std::make_shared<T>(BinarySerializer<T>::read(in)));
+  }
+};
+
+namespace detail
+{
+// checks if all types can be serialized.
+template<typename... T>
+struct all_serializable;
+template<>
+struct all_serializable<> : std::true_type
+{
+};
+template<typename T, typename... Rest>
+struct all_serializable<T, Rest...> : std::integral_constant<bool,
+    BinarySerializer<T>::supported && all_serializable<Rest...>::value>
+{
+};
+}  // namespace detail
+
+/**
+ * @brief Interface for binary serialization of a generic event.
+ *
+ * Obtained from SubscriberCollectionBase::getSerializer(). Used to record and replay events.
+ */
+class EventSerializerBase {
+public:
+  virtual ~EventSerializerBase() = default;
+
+  /**
+   * @brief Checks if all arguments can be serialized.
+   */
+  virtual bool canSerialize() const = 0;
+
+  /**
+   * @brief Append the serialized event arguments to the writer.
+   *
+   * @param out writer to append to
+   * @param args pointer to a std::tuple of the event argument types
+   *
+   * @throws std::logic_error if canSerialize() returns false.
+   */
+  virtual void writeArgs(BinaryWriter& out, const void* args) const = 0;
+
+  /**
+   * @brief Call the event immediately, reading the arguments from the reader.
+   *
+   * @throws std::invalid_argument if the data is truncated.
+   * @throws std::logic_error if canSerialize() returns false.
+   */
+  virtual void callEvent(BinaryReader& in) const = 0;
+
+  /**
+   * @brief Enqueue the event, reading the arguments from the reader.
+   *
+   * @throws std::invalid_argument if the data is truncated.
+   * @throws std::logic_error if canSerialize() returns false.
+   */
+  virtual void enqueueEvent(EventQueue* queue, BinaryReader& in, EventPriority priority) const = 0;
+};
+
+/**
+ * @brief EventSerializerBase implementation for a specific set of argument types.
+ */
+template<typename... Args>
+class EventSerializer : public EventSerializerBase {
+private:
+  // read the event arguments into a tuple. The braced initializer evaluates the reads in order.
+  static std::tuple<Args...> readArgs(BinaryReader& in) {
+    std::tuple<Args...> args {BinarySerializer<Args>::read(in)...};
+    return args;
+  }
+
+  template<std::size_t... I>
+  static void writeArgsImpl(BinaryWriter& out, const std::tuple<Args...>& args, detail::index_sequence<I...>) {
+    // expand in order
+    int expand[] = {0, (BinarySerializer<Args>::write(out, std::get<I>(args)), 0)...};
+    (void) expand;
+  }
+
+  // handler collection this serializer was created for
+  // not owned
+  SubscriberCollection<Args...>* subscriberCollection;
+
+  // allow constructor access to subscriber collection
+  friend class SubscriberCollection<Args...>;
+  EventSerializer(SubscriberCollection<Args...>* subscriberCollection) :
+      subscriberCollection(subscriberCollection) {}
+
+public:
+  virtual ~EventSerializer() = default;
+
+  virtual bool canSerialize() const {
+    return detail::all_serializable<Args...>::value;
+  }
+
+  virtual void writeArgs(BinaryWriter& out, const void* args) const {
+    writeArgsImpl(out, *static_cast<const std::tuple<Args...>*>(args), detail::make_index_sequence<sizeof...(Args)> {});
+  }
+
+  // the call operators are defined later, since they depend on the SubscriberCollection/EventQueue implementation.
+  virtual void callEvent(BinaryReader& in) const;
+  virtual void enqueueEvent(EventQueue* queue, BinaryReader& in, EventPriority priority) const;
+};
+
+/**
+ * @brief Receives every event published to an EventQueue, see EventQueue::setRecorder().
+ */
+class EventRecorderBase {
+public:
+  virtual ~EventRecorderBase() = default;
+
+  /**
+   * @brief Called for every published event, before the queue applies it's capacity limits.
+   *
+   * May be called concurrently from all publishing threads.
+   *
+   * @param subscribers subscriber collection of the event
+   * @param args pointer to a std::tuple of the event argument types, see EventSerializerBase::writeArgs().
+   * @param priority event priority
+   */
+  virtual void recordEvent(const SubscriberCollectionBase* subscribers, const void* args, EventPriority priority) = 0;
+};
+
+/**
+ * @brief Passes every event to several recorders, e.g. to record and bridge the events of one queue.
+ *
+ * An EventQueue has a single recorder, see EventQueue::setRecorder(). The recorders are called in
+ * the given order. They are not owned, and can't be changed after construction, so no locking is needed.
+ */
+class EventRecorderGroup : public EventRecorderBase {
+private:
+  std::vector<EventRecorderBase*> recorders;
+
+public:
+  /**
+   * @brief Create a group of the given recorders.
+   *
+   * @param recorders recorders to call, must outlive the group
+   */
+  explicit EventRecorderGroup(std::vector<EventRecorderBase*> recorders) :
+      recorders(std::move(recorders)) {
+  }
+
+  virtual void recordEvent(const SubscriberCollectionBase* subscribers, const void* args, EventPriority priority) {
+    for (EventRecorderBase* recorder : recorders) {
+      recorder->recordEvent(subscribers, args, priority);
+    }
+  }
+};
+
+}  // namespace ES
+
+#endif /* EVENTSERIALIZATION_H */
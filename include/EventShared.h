@@ -0,0 +1,177 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTSHARED_H
+#define EVENTSHARED_H
+
+#include "EventSystemUtils.h"
+#include "EventParametersParser.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace ES {
+
+/**
+ * @brief Reference-counted, immutable event payload.
+ *
+ * Use Shared<T> as event argument type for large payloads like images or point clouds.
+ * The payload is allocated once when the event is published; every subscriber, as well as
+ * the event queue, only shares ownership of it. Copying a Shared<T> increments a reference
+ * count, it never copies the payload itself.
+ *
+ * Since all subscribers see the same object, the payload is const. A subscriber may take the
+ * argument as const Shared<T>& (to keep the payload alive beyond the call), or directly as
+ * const T& through the implicit conversion:
+ * @code
+ * auto handle = es.registerEvent<ES::Shared<Image>>("Image");
+ * es.subscribe<ES::Shared<Image>>("Image", [](const Image& image) {...});
+ * es.publish(handle, ES::makeShared<Image>(640, 480));
+ * @endcode
+ *
+ * @tparam T payload type
+ */
+template<typename T>
+class Shared
+{
+public:
+  /// @brief The payload type.
+  typedef T element_type;
+
+  /**
+   * @brief Creates an empty payload reference.
+   *
+   * Accessing the payload of an empty reference is undefined behaviour.
+   */
+  Shared() = default;
+
+  /**
+   * @brief Takes shared ownership of an existing payload.
+   */
+  explicit Shared(std::shared_ptr<const T> payload) :
+      payload(std::move(payload))
+  {
+  }
+
+  /**
+   * @brief Moves an existing value into a new shared payload.
+   *
+   * This allows to publish a plain T to a Shared<T> event. The value is moved once, into the
+   * shared allocation.
+   */
+  Shared(T&& value) :
+      payload(std::make_shared<T>(std::move(value)))
+  {
+  }
+
+  /// @brief Returns the payload, or NULL if empty.
+  const T* get() const
+  {
+    return payload.get();
+  }
+
+  /// @brief Returns the payload. Must not be empty.
+  const T& operator*() const
+  {
+    return *payload;
+  }
+
+  /// @brief Accesses the payload. Must not be empty.
+  const T* operator->() const
+  {
+    return payload.get();
+  }
+
+  /// @brief Converts to the payload, allowing subscribers to take a const T&. Must not be empty.
+  operator const T&() const
+  {
+    return *payload;
+  }
+
+  /// @brief Checks if a payload is set.
+  explicit operator bool() const
+  {
+    return payload != nullptr;
+  }
+
+  /// @brief Returns the number of Shared instances currently referencing the payload.
+  long useCount() const
+  {
+    return payload.use_count();
+  }
+
+  /// @brief Returns the underlying shared pointer.
+  const std::shared_ptr<const T>& getPointer() const
+  {
+    return payload;
+  }
+
+private:
+  std::shared_ptr<const T> payload;
+};
+
+/**
+ * @brief Allocates a new shared payload, constructing it in place from the given arguments.
+ */
+template<typename T, typename... CtorArgs>
+Shared<T> makeShared(CtorArgs&&... args)
+{
+  return Shared<T>(std::make_shared<T>(std::forward<CtorArgs>(args)...));
+}
+
+namespace detail
+{
+/// @brief Describe shared payloads by their payload type.
+template<typename T>
+struct TypeName<Shared<T>>
+{
+  static std::string get()
+  {
+    return "ES::Shared<" + TypeName<T>::get() + ">";
+  }
+};
+}  // namespace detail
+
+/// @brief ParameterValueParser for shared payloads, delegates to the parser for the payload type.
+template<typename T>
+struct ParameterValueParser<Shared<T>> {
+  static constexpr ParameterType valueType = ParameterValueParser<T>::valueType;
+
+  static Shared<T> parse(StringView stringValue) {
+    return Shared<T>(std::make_shared<T>(ParameterValueParser<T>::parse(stringValue)));
+  }
+};
+
+}  // namespace ES
+
+#endif /* EVENTSHARED_H */
@@ -0,0 +1,128 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTSTATIC_H
+#define EVENTSTATIC_H
+
+#include "EventRegistry.h"
+
+#include <type_traits>
+
+namespace ES {
+
+/**
+ * @brief Common base of all static event tags, used to detect them.
+ */
+struct StaticEventBase
+{
+};
+
+/**
+ * @brief Base class for static event tags, see ES_DEFINE_EVENT.
+ *
+ * A static event is identified by a tag type instead of a runtime name. The subscriber collection
+ * of a static event is a single object per tag type, so publishing to it requires neither a
+ * name lookup nor a dynamic type check. The argument types are part of the tag, so they are
+ * checked by the compiler.
+ *
+ * Since the subscriber collection belongs to the tag and not to an EventRegistry, subscriptions
+ * to a static event are process-wide. Each EventSystem still uses its own queue, so an event
+ * published to a static event is processed by the EventSystem it was published to. For the same
+ * reason, a static event always uses the default queue of an EventSystem, and its subscribers
+ * cannot be pinned to other queues, see EventSystem::setEventQueue().
+ *
+ * @tparam Tag the derived tag type
+ * @tparam Signature event argument types, as function type `void(Args...)`
+ */
+template<typename Tag, typename Signature>
+class StaticEvent;
+
+template<typename Tag, typename... Args>
+class StaticEvent<Tag, void(Args...)> : public StaticEventBase
+{
+public:
+  /// @brief Subscriber collection type of the event.
+  typedef SubscriberCollectionDecay<Args...> Subscribers;
+  /// @brief Handle type of the event.
+  typedef EventHandleDecay<Args...> Handle;
+
+  /**
+   * @brief Get the subscriber collection of this event.
+   *
+   * The collection is created on first use and lives until the program exits.
+   */
+  static Subscribers& getSubscribers()
+  {
+    static Subscribers subscribers(process_wide);
+    return subscribers;
+  }
+
+  /**
+   * @brief Get a handle to the subscriber collection of this event.
+   */
+  static Handle getHandle()
+  {
+    return &getSubscribers();
+  }
+};
+
+/**
+ * @brief Checks if T is a static event tag, defined with ES_DEFINE_EVENT.
+ */
+template<typename T>
+struct is_static_event : std::is_base_of<StaticEventBase, T>
+{
+};
+
+}  // namespace ES
+
+/**
+ * @brief Defines a static event tag type.
+ *
+ * The first macro argument is the name of the tag type, which is also used as event name in the
+ * registry. The remaining arguments are the event argument types, and may be omitted for events
+ * without arguments.
+ *
+ * @code
+ * ES_DEFINE_EVENT(ImageReceived, std::string, int);
+ *
+ * es.subscribe<ImageReceived>([](const std::string& path, int index) {...});
+ * es.publish<ImageReceived>("image.png", 3);
+ * @endcode
+ */
+#define ES_DEFINE_EVENT(Name, ...) \
+  struct Name : public ::ES::StaticEvent<Name, void(__VA_ARGS__)> \
+  { \
+    static const char* getName() { return #Name; } \
+  }
+
+#endif /* EVENTSTATIC_H */
@@ -36,12 +36,21 @@
 #include "EventSystemUtils.h"
 #include "EventSubscription.h"
 #include "EventParametersParser.h"
+#include "EventShared.h"
+#include "EventSerialization.h"
+#include "EventDelegate.h"
+#include "EventInstrumentation.h"
 
-#include <functional>
+#include <algorithm>
 #include <vector>
+#include <unordered_map>
 #include <tuple>
 #include <ostream>
 #include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 
 namespace ES {
 
@@ -60,6 +69,32 @@ struct ignore_result_t
  */
 constexpr ignore_result_t ignore_result { };
 
+/**
+ * @brief Type of conflating.
+ */
+struct conflating_t
+{
+};
+/**
+ * @brief Tag value to register a latest-value event.
+ *
+ * See SubscriberCollectionBase::setConflating().
+ */
+constexpr conflating_t conflating { };
+
+/**
+ * @brief Type of process_wide.
+ */
+struct process_wide_t
+{
+};
+/**
+ * @brief Tag value to create the subscriber collection of a static event.
+ *
+ * See SubscriberCollectionBase::isProcessWide().
+ */
+constexpr process_wide_t process_wide { };
+
 /**
  * @brief Append a description of the template args to the given output stream.
  */
@@ -105,6 +140,13 @@ void appendArgsDescription(std::ostream& os)
  *
  * The event type is defined by the argument types of it's subscriber functions.
  *
+ * When an event is passed to the subscribers, every subscriber but the last one receives the
+ * argument values as lvalues. If the caller passed ownership of the arguments, the last
+ * subscriber receives them as rvalues, so a subscriber taking the argument by value or by
+ * rvalue reference can take it without copying. Queued events always pass ownership.
+ *
+ * This also allows events with move-only argument types, e.g. std::unique_ptr. Such events
+ * can have at most one subscriber.
  *
  * @tparam Args argument types for the event function
  */
@@ -116,40 +158,371 @@ private:
   {
     // handler id, used for subscription handles
     SubscriberIdType id;
-    // use std::function to mask the actual form of the defined function
-    std::function<void(Args...)> function;
+    // use a Delegate to mask the actual form of the defined function
+    Delegate<void(Args...)> function;
+    // cleared when the subscriber is removed. Checked by the dispatch loop without locking, thus atomic.
+    std::atomic<bool> active;
+    // time spent in the function, recorded if the instrumentation is enabled
+    detail::SubscriberTiming timing;
 
-    Subscriber(SubscriberIdType id, std::function<void(Args...)> function) :
-        id(id), function(function)
+    Subscriber(SubscriberIdType id, Delegate<void(Args...)> function) :
+        id(id), function(std::move(function)), active(true)
     {
     }
+    Subscriber(Subscriber&& other) noexcept :
+        id(other.id), function(std::move(other.function)), active(other.active.load(std::memory_order_relaxed)),
+        timing(std::move(other.timing))
+    {
+    }
+    Subscriber& operator=(Subscriber&& other) noexcept
+    {
+      id = other.id;
+      function = std::move(other.function);
+      active.store(other.active.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      timing = std::move(other.timing);
+      return *this;
+    }
   };
 
-  // list of subscriber implementations.
+  /*
+   * List of subscriber implementations, in the order they were added.
+   *
+   * Removed subscribers are left in place and marked inactive, so removal does not need to
+   * shift the later entries. The list is compacted once more than half of it's entries are
+   * removed, and trailing removed entries are dropped immediately. Thus, the dispatch loop
+   * walks a mostly dense array.
+   *
+   * While a dispatch is in progress, the list is not modified structurally. Removed subscribers
+   * are only marked inactive, so the dispatch skips them, but their functions are kept alive,
+   * since one of them might be executing right now. New subscribers are put into addedHandlers.
+   * Both changes are applied when the last dispatch finishes. This way, subscribers may be added
+   * or removed at any time, even from within a subscriber, without copying the list per dispatch.
+   */
   std::vector<Subscriber> handlers;
 
+  // subscribers added while a dispatch was in progress. Merged into handlers afterwards.
+  std::vector<Subscriber> addedHandlers;
+
+  // marks an index into addedHandlers in handlerIndexById
+  static constexpr std::size_t addedFlag = ~(~std::size_t(0) >> 1);
+
+  // marks a keyed subscriber in handlerIndexById
+  static constexpr std::size_t keyedMarker = ~std::size_t(0);
+
+  // the event arguments as passed to keyed subscribers
+  typedef std::tuple<const typename std::remove_reference<Args>::type&...> ArgRefs;
+
+  /*
+   * Keyed subscribers are only called for events whose key argument equals their key. They are kept
+   * in a hash index separate from handlers, so an event only visits the matching ones. The index is
+   * created with the first keyed subscriber, which also selects the key argument.
+   *
+   * Like handlers, the index is not modified structurally while a dispatch is in progress.
+   * The changes are deferred the same way. All methods but dispatch() need subscribersMutex.
+   */
+  class KeyedSubscribersBase
+  {
+  public:
+    virtual ~KeyedSubscribersBase() = default;
+    // index of the key argument
+    virtual std::size_t getKeyIndex() const = 0;
+    // call the subscribers matching the event
+    virtual void dispatch(const ArgRefs& args, bool timed) const = 0;
+    // remove a subscriber. If deferred, it's function is kept alive until applyDeferredChanges().
+    virtual void remove(SubscriberIdType subscriberId, bool deferred) = 0;
+    virtual bool hasDeferredChanges() const = 0;
+    virtual void applyDeferredChanges() = 0;
+    virtual void appendStatistics(std::vector<SubscriberStatistics>& statistics) const = 0;
+  };
+
+  template<std::size_t KeyIndex>
+  class KeyedSubscribers : public KeyedSubscribersBase
+  {
+  public:
+    typedef typename std::decay<typename std::tuple_element<KeyIndex, std::tuple<Args...>>::type>::type Key;
+
+  private:
+    // subscribers by key, in the order they were added
+    std::unordered_map<Key, std::vector<Subscriber>> buckets;
+    std::unordered_map<SubscriberIdType, Key> keysById;
+    // subscribers added while a dispatch was in progress
+    std::vector<std::pair<Key, Subscriber>> added;
+    // true if subscribers were removed while a dispatch was in progress
+    bool deferredRemoval;
+
+  public:
+    KeyedSubscribers() :
+        deferredRemoval(false)
+    {
+    }
+
+    void add(const Key& key, Subscriber&& subscriber, bool deferred)
+    {
+      keysById.emplace(subscriber.id, key);
+      if (deferred)
+      {
+        added.emplace_back(key, std::move(subscriber));
+      }
+      else
+      {
+        buckets[key].push_back(std::move(subscriber));
+      }
+    }
+
+    virtual std::size_t getKeyIndex() const
+    {
+      return KeyIndex;
+    }
+
+    virtual void dispatch(const ArgRefs& args, bool timed) const
+    {
+      auto bucket = buckets.find(std::get<KeyIndex>(args));
+      if (bucket == buckets.end())
+      {
+        return;
+      }
+      for (auto& handler : bucket->second)
+      {
+        if (handler.active.load(std::memory_order_acquire))
+        {
+          invoke(handler, args, timed);
+        }
+      }
+    }
+
+    virtual void remove(SubscriberIdType subscriberId, bool deferred)
+    {
+      auto keyEntry = keysById.find(subscriberId);
+      if (keyEntry == keysById.end())
+      {
+        return;
+      }
+      Key key = std::move(keyEntry->second);
+      keysById.erase(keyEntry);
+
+      for (auto& pending : added)
+      {
+        if (pending.second.id == subscriberId)
+        {
+          // not dispatched yet, so we can release the function right away
+          pending.second.active.store(false, std::memory_order_relaxed);
+          pending.second.function = Delegate<void(Args...)>();
+          return;
+        }
+      }
+      auto bucket = buckets.find(key);
+      if (bucket == buckets.end())
+      {
+        return;
+      }
+      std::vector<Subscriber>& handlers = bucket->second;
+      for (std::size_t idx = 0; idx < handlers.size(); ++idx)
+      {
+        if (handlers[idx].id != subscriberId)
+        {
+          continue;
+        }
+        handlers[idx].active.store(false, std::memory_order_release);
+        if (deferred)
+        {
+          // the function might be running
+          deferredRemoval = true;
+        }
+        else if (handlers.size() == 1)
+        {
+          buckets.erase(bucket);
+        }
+        else
+        {
+          handlers.erase(handlers.begin() + idx);
+        }
+        return;
+      }
+    }
+
+    virtual bool hasDeferredChanges() const
+    {
+      return deferredRemoval || !added.empty();
+    }
+
+    virtual void applyDeferredChanges()
+    {
+      if (deferredRemoval)
+      {
+        for (auto bucket = buckets.begin(); bucket != buckets.end();)
+        {
+          std::vector<Subscriber>& handlers = bucket->second;
+          handlers.erase(std::remove_if(handlers.begin(), handlers.end(), [](const Subscriber& handler) {
+            return !handler.active.load(std::memory_order_relaxed);
+          }), handlers.end());
+          if (handlers.empty())
+          {
+            bucket = buckets.erase(bucket);
+          }
+          else
+          {
+            ++bucket;
+          }
+        }
+        deferredRemoval = false;
+      }
+      for (auto& pending : added)
+      {
+        if (pending.second.active.load(std::memory_order_relaxed))
+        {
+          buckets[pending.first].push_back(std::move(pending.second));
+        }
+      }
+      added.clear();
+    }
+
+    virtual void appendStatistics(std::vector<SubscriberStatistics>& statistics) const
+    {
+      for (auto& bucket : buckets)
+      {
+        for (auto& handler : bucket.second)
+        {
+          if (handler.active.load(std::memory_order_relaxed))
+          {
+            SubscriberStatistics entry;
+            entry.id = handler.id;
+            entry.pinnedRoute = 0;
+            handler.timing.snapshot(entry);
+            statistics.push_back(entry);
+          }
+        }
+      }
+    }
+  };
+
+  // position of every active subscriber in handlers or addedHandlers
+  std::unordered_map<SubscriberIdType, std::size_t> handlerIndexById;
+
+  // number of removed entries in handlers
+  std::size_t removedCount;
+
+  // number of entries removed during a dispatch, whose functions are still alive
+  std::size_t deferredRemovalCount;
+
+  // number of dispatches in progress
+  mutable int dispatchDepth;
+
+  // guards all of the above. Not held while subscribers are called.
+  mutable std::mutex subscribersMutex;
+
   // handler id counter, produces incrementing ids for new handlers
   SubscriberIdType newIdCounter;
 
   // parameter from string parser
   EventParametersParser<Args...> paramParser;
 
+  // binary serializer, used to record and replay events
+  EventSerializer<Args...> serializer;
+
+  // latest-value flag, see setConflating()
+  std::atomic<bool> conflatingFlag;
+
+  // default priority when enqueued
+  std::atomic<EventPriority> priority;
+
+  // queue timing, recorded if the instrumentation is enabled
+  detail::TopicInstrumentationSlot instrumentation;
+
+  // keyed subscribers, created on demand and owned. Read without lock by the dispatch.
+  std::atomic<KeyedSubscribersBase*> keyedSubscribers;
+
+public:
+  /**
+   * @brief Queues an EventSystem enqueues this event to, see EventSystem::subscribeOn().
+   */
+  struct QueueRoutes
+  {
+    /// @brief queue for the subscribers of this collection, NULL if not set
+    EventQueue* queue;
+    /// @brief queues with pinned subscribers, and the collection holding the subscribers of each
+    std::vector<std::pair<EventQueue*, SubscriberCollection*>> pinned;
+  };
+
+private:
+  // current queue routes, NULL until set. Read without lock by the publishers.
+  std::atomic<const QueueRoutes*> queueRoutes;
+  // all versions of the queue routes. Replaced versions are kept, since concurrent publishers may
+  // still read them. Guarded by subscribersMutex.
+  std::vector<std::unique_ptr<QueueRoutes>> queueRouteVersions;
+  // collections for subscribers pinned to other queues, owned. Guarded by subscribersMutex.
+  std::vector<std::unique_ptr<SubscriberCollection>> pinnedSubscribers;
+  // true for the collection of a static event, see isProcessWide()
+  const bool processWide;
+
+  // publish a modified copy of the queue routes. subscribersMutex must be held.
+  template<typename Modify>
+  void updateQueueRoutes(Modify modify)
+  {
+    std::unique_ptr<QueueRoutes> routes(new QueueRoutes());
+    routes->queue = NULL;
+    const QueueRoutes* current = queueRoutes.load(std::memory_order_relaxed);
+    if (current != NULL)
+    {
+      *routes = *current;
+    }
+    modify(*routes);
+    queueRouteVersions.push_back(std::move(routes));
+    // release: publish the routes to the publishers
+    queueRoutes.store(queueRouteVersions.back().get(), std::memory_order_release);
+  }
+
+  // the event queue records the queue timing
+  friend class EventQueue;
+
 public:
   /**
    * @brief Creates an new, empty handler collection.
    */
   SubscriberCollection() :
-      newIdCounter(0), paramParser(this)
+      removedCount(0), deferredRemovalCount(0), dispatchDepth(0), newIdCounter(0), paramParser(this), serializer(this),
+      conflatingFlag(false), priority(EventPriority::NORMAL), keyedSubscribers(NULL), queueRoutes(NULL),
+      processWide(false)
+  {
+  }
+  /**
+   * @brief Create a collection that is shared by all EventSystems, see isProcessWide().
+   */
+  explicit SubscriberCollection(process_wide_t) :
+      removedCount(0), deferredRemovalCount(0), dispatchDepth(0), newIdCounter(0), paramParser(this), serializer(this),
+      conflatingFlag(false), priority(EventPriority::NORMAL), keyedSubscribers(NULL), queueRoutes(NULL),
+      processWide(true)
+  {
+  }
+  virtual ~SubscriberCollection()
   {
+    delete keyedSubscribers.load(std::memory_order_relaxed);
   }
-  virtual ~SubscriberCollection() = default;
 
   /*
-   * @brief Returns the number of subscribers in this handler collection
+   * @brief Returns the number of subscribers in this handler collection, including the pinned ones
    */
   virtual std::size_t getHandlerCount() const
   {
-    return handlers.size();
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    std::size_t count = handlerIndexById.size();
+    const QueueRoutes* routes = queueRoutes.load(std::memory_order_relaxed);
+    if (routes != NULL)
+    {
+      for (auto& route : routes->pinned)
+      {
+        count += route.second->getLocalHandlerCount();
+      }
+    }
+    return count;
+  }
+
+  /**
+   * @brief Returns the number of subscribers in this collection, without those pinned to other queues.
+   */
+  std::size_t getLocalHandlerCount() const
+  {
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    return handlerIndexById.size();
   }
   /**
    * @brief Append a description of the event arguments to the given output stream.
@@ -167,13 +540,208 @@ public:
     return &paramParser;
   }
 
+  /**
+   * @brief Get the binary serializer, which can record and replay this event.
+   */
+  virtual const EventSerializerBase* getSerializer() const
+  {
+    return &serializer;
+  }
+
+  /**
+   * @brief Make this a latest-value event, see SubscriberCollectionBase::setConflating().
+   */
+  virtual void setConflating(bool conflate)
+  {
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    conflatingFlag.store(conflate, std::memory_order_relaxed);
+    // the pinned subscribers receive the same events
+    for (auto& pinned : pinnedSubscribers)
+    {
+      pinned->setConflating(conflate);
+    }
+  }
+
+  /**
+   * @brief Check if this is a latest-value event.
+   */
+  virtual bool isConflating() const
+  {
+    return conflatingFlag.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Set the default priority used when the event is enqueued.
+   */
+  virtual void setPriority(EventPriority newPriority)
+  {
+    priority.store(newPriority, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Get the default priority used when the event is enqueued.
+   */
+  virtual EventPriority getPriority() const
+  {
+    return priority.load(std::memory_order_relaxed);
+  }
+
+  virtual void setTargetQueue(EventQueue* queue)
+  {
+    if (processWide && queue != NULL)
+    {
+      throw std::logic_error("The queue of a static event cannot be set, it is shared by all event systems.");
+    }
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    updateQueueRoutes([queue](QueueRoutes& routes) {
+      routes.queue = queue;
+    });
+  }
+
+  virtual EventQueue* getTargetQueue() const
+  {
+    const QueueRoutes* routes = getQueueRoutes();
+    return routes == NULL ? NULL : routes->queue;
+  }
+
+  virtual void clearQueueRoutes()
+  {
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    if (queueRoutes.load(std::memory_order_relaxed) != NULL)
+    {
+      updateQueueRoutes([](QueueRoutes& routes) {
+        routes.queue = NULL;
+        routes.pinned.clear();
+      });
+    }
+  }
+
+  virtual bool isProcessWide() const
+  {
+    return processWide;
+  }
+
+  /**
+   * @brief Get the queue routes maintained by the EventSystem, or NULL if there are none.
+   *
+   * The returned object is immutable and stays valid as long as this collection exists.
+   */
+  const QueueRoutes* getQueueRoutes() const
+  {
+    return queueRoutes.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Get the collection for the subscribers pinned to the given queue, creating it if needed.
+   *
+   * The collection is owned by this one, and it is added to the queue routes, so that an
+   * EventSystem enqueues this event to the queue for it as well. It follows the conflating flag of
+   * this collection, see setConflating().
+   *
+   * @throws std::logic_error if the event arguments are not copyable, or this is the collection of
+   *         a static event, see isProcessWide().
+   */
+  SubscriberCollection& getPinnedSubscribers(EventQueue* queue)
+  {
+    if (!copyableArgs)
+    {
+      throw std::logic_error("An event with move-only argument types cannot have subscribers on several queues.");
+    }
+    if (processWide)
+    {
+      throw std::logic_error("Subscribers of a static event cannot be pinned to a queue, it is shared by all event systems.");
+    }
+
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    const QueueRoutes* current = queueRoutes.load(std::memory_order_relaxed);
+    if (current != NULL)
+    {
+      for (auto& route : current->pinned)
+      {
+        if (route.first == queue)
+        {
+          return *route.second;
+        }
+      }
+    }
+
+    pinnedSubscribers.emplace_back(new SubscriberCollection());
+    SubscriberCollection* pinned = pinnedSubscribers.back().get();
+    pinned->setConflating(conflatingFlag.load(std::memory_order_relaxed));
+    updateQueueRoutes([queue, pinned](QueueRoutes& routes) {
+      routes.pinned.emplace_back(queue, pinned);
+    });
+    return *pinned;
+  }
+
+  virtual void getInstrumentation(EventInstrumentationSnapshot& snapshot) const
+  {
+    instrumentation.snapshot(snapshot);
+
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    snapshot.subscribers.clear();
+    for (auto& handler : handlers)
+    {
+      if (handler.active.load(std::memory_order_relaxed))
+      {
+        SubscriberStatistics statistics;
+        statistics.id = handler.id;
+        statistics.pinnedRoute = 0;
+        handler.timing.snapshot(statistics);
+        snapshot.subscribers.push_back(statistics);
+      }
+    }
+    KeyedSubscribersBase* keyed = keyedSubscribers.load(std::memory_order_relaxed);
+    if (keyed != NULL)
+    {
+      keyed->appendStatistics(snapshot.subscribers);
+    }
+
+    // queues and subscribers of the pinned collections, numbered by route
+    const QueueRoutes* routes = queueRoutes.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; routes != NULL && i < routes->pinned.size(); ++i)
+    {
+      EventInstrumentationSnapshot pinnedSnapshot;
+      routes->pinned[i].second->getInstrumentation(pinnedSnapshot);
+      snapshot.published += pinnedSnapshot.published;
+      snapshot.publishRate += pinnedSnapshot.publishRate;
+      snapshot.fired += pinnedSnapshot.fired;
+      snapshot.queueDelay.merge(pinnedSnapshot.queueDelay);
+      snapshot.residency.merge(pinnedSnapshot.residency);
+      for (auto& statistics : pinnedSnapshot.subscribers)
+      {
+        statistics.pinnedRoute = static_cast<unsigned int>(i + 1);
+        snapshot.subscribers.push_back(statistics);
+      }
+    }
+  }
+
 private:
+  // true if the event arguments can be passed to more than one subscriber
+  static constexpr bool copyableArgs = detail::all_copy_constructible<Args...>::value;
+
   // add the given subscriber function. Common code for addSubscriber(func) and addSubscriber(func, ignore_result)
-  SubscriptionHandle addSubscriberImpl(std::function<void(Args...)>&& function)
+  SubscriptionHandle addSubscriberImpl(Delegate<void(Args...)>&& function)
   {
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+
+    if (!copyableArgs && !handlerIndexById.empty())
+    {
+      throw std::logic_error("An event with move-only argument types can only have one subscriber.");
+    }
 
     SubscriberIdType newId = newIdCounter++;
-    handlers.emplace_back(newId, function);
+    if (dispatchDepth > 0)
+    {
+      // defer until the dispatch is done
+      handlerIndexById.emplace(newId, addedFlag | addedHandlers.size());
+      addedHandlers.emplace_back(newId, std::move(function));
+    }
+    else
+    {
+      handlerIndexById.emplace(newId, handlers.size());
+      handlers.emplace_back(newId, std::move(function));
+    }
 
     // return subscription handle.
     return
@@ -182,30 +750,156 @@ private:
 
   virtual void removeSubscriber(SubscriberIdType subscriberId)
   {
-    // look for the referenced handler in list
-    for (auto it = handlers.begin(); it != handlers.end(); it++)
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+
+    // look for the referenced handler
+    auto entry = handlerIndexById.find(subscriberId);
+    if (entry == handlerIndexById.end())
+    {
+      // already removed
+      return;
+    }
+    std::size_t index = entry->second;
+    handlerIndexById.erase(entry);
+
+    if (index == keyedMarker)
+    {
+      keyedSubscribers.load(std::memory_order_relaxed)->remove(subscriberId, dispatchDepth > 0);
+      return;
+    }
+
+    if (index & addedFlag)
+    {
+      // not dispatched yet, so we can release the function right away
+      Subscriber& added = addedHandlers[index & ~addedFlag];
+      added.active.store(false, std::memory_order_relaxed);
+      added.function = Delegate<void(Args...)>();
+      return;
+    }
+
+    // found handler, mark it as removed
+    handlers[index].active.store(false, std::memory_order_release);
+    removedCount++;
+    if (dispatchDepth > 0)
+    {
+      // the function might be running, so keep it until the dispatch is done
+      deferredRemovalCount++;
+      return;
+    }
+    handlers[index].function = Delegate<void(Args...)>();
+
+    // drop removed entries at the end
+    while (!handlers.empty() && !handlers.back().active.load(std::memory_order_relaxed))
+    {
+      handlers.pop_back();
+      removedCount--;
+    }
+    // compact if too many entries were removed
+    if (removedCount * 2 > handlers.size())
     {
-      if (it->id == subscriberId)
+      compact();
+    }
+  }
+
+  // remove the entries of removed subscribers from handlers, keeping the order of the active ones.
+  // subscribersMutex must be held, and no dispatch may be in progress.
+  void compact()
+  {
+    std::size_t target = 0;
+    for (std::size_t source = 0; source < handlers.size(); ++source)
+    {
+      if (!handlers[source].active.load(std::memory_order_relaxed))
       {
-        // found handler, remove it
-        handlers.erase(it);
-        return;
+        continue;
+      }
+      if (target != source)
+      {
+        handlers[target] = std::move(handlers[source]);
+        handlerIndexById[handlers[target].id] = target;
       }
+      target++;
     }
+    handlers.erase(handlers.begin() + target, handlers.end());
+    removedCount = 0;
+    deferredRemovalCount = 0;
   }
 
-  virtual bool isSubscribed(SubscriberIdType subscriberId) const
+  // apply the changes made during dispatch. subscribersMutex must be held, and no dispatch may be in progress.
+  void applyDeferredChanges()
   {
-    // look for the referenced handler in list
-    for (auto it = handlers.begin(); it != handlers.end(); it++)
+    if (deferredRemovalCount > 0)
+    {
+      compact();
+    }
+    for (auto& added : addedHandlers)
     {
-      if (it->id == subscriberId)
+      if (added.active.load(std::memory_order_relaxed))
       {
-        // found handler
-        return true;
+        handlerIndexById[added.id] = handlers.size();
+        handlers.push_back(std::move(added));
       }
     }
-    return false;
+    // clear keeps the capacity, so the next deferred addition won't allocate
+    addedHandlers.clear();
+
+    KeyedSubscribersBase* keyed = keyedSubscribers.load(std::memory_order_relaxed);
+    if (keyed != NULL)
+    {
+      keyed->applyDeferredChanges();
+    }
+  }
+
+  // check if changes were made during dispatch. subscribersMutex must be held.
+  bool hasDeferredChanges() const
+  {
+    if (deferredRemovalCount > 0 || !addedHandlers.empty())
+    {
+      return true;
+    }
+    KeyedSubscribersBase* keyed = keyedSubscribers.load(std::memory_order_relaxed);
+    return keyed != NULL && keyed->hasDeferredChanges();
+  }
+
+  // mark a dispatch as started. While a dispatch is running, handlers is not modified structurally.
+  void beginDispatch() const
+  {
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    dispatchDepth++;
+  }
+
+  // mark a dispatch as finished. The last finishing dispatch applies pending changes.
+  void endDispatch() const
+  {
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    dispatchDepth--;
+    if (dispatchDepth == 0 && hasDeferredChanges())
+    {
+      // the collection is never created as const object, so this is safe.
+      const_cast<SubscriberCollection*>(this)->applyDeferredChanges();
+    }
+  }
+
+  // RAII helper for beginDispatch/endDispatch, which handles exceptions thrown by the subscribers.
+  class DispatchGuard
+  {
+  private:
+    const SubscriberCollection* owner;
+  public:
+    DispatchGuard(const SubscriberCollection* owner) :
+        owner(owner)
+    {
+      owner->beginDispatch();
+    }
+    ~DispatchGuard()
+    {
+      owner->endDispatch();
+    }
+  };
+
+  virtual bool isSubscribed(SubscriberIdType subscriberId) const
+  {
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    return handlerIndexById.count(subscriberId) != 0;
   }
 
 public:
@@ -219,8 +913,11 @@ public:
    * By default, only functions returning void are allowed as subscribers.
    * A non-void return value can be explicitly ignored using the ignore_result overload.
    *
-   * IMPORTANT: This must not be called while the event that the handler collection was
-   * registered for is processed. Otherwise, you might get unexpected errors.
+   * This is thread safe, and may be called while the event is dispatched, even from within a
+   * subscriber. A subscriber added during a dispatch is only called for later events.
+   *
+   * All overloads throw std::logic_error when adding a second subscriber to an event with
+   * move-only argument types.
    */
   //@{
   /**
@@ -235,14 +932,14 @@ public:
   template<typename Func>
   SubscriptionHandle addSubscriber(Func function)
   {
-    // on c++11, std::function<void> silently ignores void results. We don't want that.
+    // a delegate would silently ignore non-void results. We don't want that.
     static_assert(std::is_void<decltype(function(std::declval<Args>()...)) >::value,
         "Only functions returning void are allowed as handlers. If the return value should be ignored, "
         "use the ignore_result_t overload. ");
 
-    // construct a std::function from func.
+    // construct a delegate from func.
     // this will handle the signature check, and it works for any callable object.
-    std::function<void(Args...)> func_wrapper(function);
+    Delegate<void(Args...)> func_wrapper(std::move(function));
 
     return addSubscriberImpl(std::move(func_wrapper));
   }
@@ -260,10 +957,9 @@ public:
   SubscriptionHandle addSubscriber(Func function, ignore_result_t)
   {
 
-    // construct a std::function from func, ignoring the return value
+    // construct a delegate from func, ignoring the return value
     // this will handle the signature check, and it works for any callable object.
-    std::function<void(Args...)> func_wrapper =
-        detail::ignore_return_value_wrapper<Func, Args...>(function);
+    Delegate<void(Args...)> func_wrapper(detail::ignore_return_value_wrapper<Func>(std::move(function)));
 
     return addSubscriberImpl(std::move(func_wrapper));
   }
@@ -285,7 +981,7 @@ public:
   SubscriptionHandle addSubscriber(void (T::*fp)(MFArgs...),
       type_identity_t<T>* obj)
   {
-    return addSubscriber(detail::bind_owner(fp, obj));
+    return addSubscriber(detail::bind_member(fp, obj));
   }
   /**
    * @brief Add a bound const member function as subscriber. The handler function must return void.
@@ -303,7 +999,7 @@ public:
   SubscriptionHandle addSubscriber(void (T::*fp)(MFArgs...) const,
       const type_identity_t<T>* obj)
   {
-    return addSubscriber(detail::bind_owner(fp, obj));
+    return addSubscriber(detail::bind_member(fp, obj));
   }
 
   /**
@@ -322,7 +1018,7 @@ public:
   SubscriptionHandle addSubscriber(Result (T::*fp)(MFArgs...),
       type_identity_t<T>* obj, ignore_result_t)
   {
-    return addSubscriber(detail::bind_owner(fp, obj), ignore_result);
+    return addSubscriber(detail::bind_member(fp, obj), ignore_result);
   }
 
   /**
@@ -341,30 +1037,91 @@ public:
   SubscriptionHandle addSubscriber(Result (T::*fp)(MFArgs...) const,
       const type_identity_t<T>* obj, ignore_result_t)
   {
-    return addSubscriber(detail::bind_owner(fp, obj), ignore_result);
+    return addSubscriber(detail::bind_member(fp, obj), ignore_result);
   }
   //@}
 
+  /**
+   * @brief Type of the event argument at the given index, used as subscriber key.
+   */
+  template<std::size_t KeyIndex>
+  using KeyType = typename KeyedSubscribers<KeyIndex>::Key;
+
+  /**
+   * @brief Add a subscriber that is only called for events whose argument at KeyIndex equals the given key.
+   *
+   * Keyed subscribers are kept in a hash index, so dispatching an event only visits the subscribers
+   * with a matching key, and the unkeyed ones. This is much cheaper than many unkeyed subscribers that
+   * each filter the events themselves. The key type must be supported by std::hash.
+   *
+   * Matching keyed subscribers are called before the unkeyed ones, and receive the arguments as const lvalues.
+   * All keyed subscribers of one event must use the same key argument. Events with move-only argument
+   * types can't have keyed subscribers.
+   *
+   * Otherwise, keyed subscribers behave like the ones added by addSubscriber(). In particular, they may be
+   * added or removed at any time.
+   *
+   * @tparam KeyIndex index of the key argument
+   * @tparam Func function object type. Must be callable with Args, and return void.
+   *
+   * @param key key to match
+   * @param function subscriber function object
+   *
+   * @return a handle that can be used to remove the newly registered subscriber.
+   *
+   * @throws std::logic_error if other keyed subscribers use a different key argument.
+   */
+  template<std::size_t KeyIndex = 0, typename Func>
+  SubscriptionHandle addKeyedSubscriber(const KeyType<KeyIndex>& key, Func function)
+  {
+    static_assert(std::is_void<decltype(function(std::declval<Args>()...)) >::value,
+        "Only functions returning void are allowed as handlers.");
+    static_assert(copyableArgs, "Events with move-only argument types can't have keyed subscribers.");
+
+    Delegate<void(Args...)> func_wrapper(std::move(function));
+
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    KeyedSubscribersBase* keyed = keyedSubscribers.load(std::memory_order_relaxed);
+    if (keyed == NULL)
+    {
+      keyed = new KeyedSubscribers<KeyIndex>();
+      keyedSubscribers.store(keyed, std::memory_order_release);
+    }
+    else if (keyed->getKeyIndex() != KeyIndex)
+    {
+      throw std::logic_error("The keyed subscribers of this event use a different key argument.");
+    }
+
+    SubscriberIdType newId = newIdCounter++;
+    static_cast<KeyedSubscribers<KeyIndex>*>(keyed)->add(key, Subscriber(newId, std::move(func_wrapper)),
+        dispatchDepth > 0);
+    handlerIndexById[newId] = keyedMarker;
+
+    return
+    { this, newId};
+  }
+
   /**
    * @brief Call all registered subscribers using the specified arguments.
    *
-   * Since this will loop through all subscribers, you must not add or remove handlers while a call is in progress.
+   * Subscribers may be added or removed while a call is in progress. Removed subscribers will not be
+   * called anymore, added ones only for later calls.
+   *
+   * The last subscriber receives the arguments as rvalues.
    *
    * @param args event argument values
    */
   void call(Args ... args) const
   {
-    // loop through subscribers
-    for (auto& handler : handlers)
-    {
-      // invoke one handler
-      handler.function(args...);
-    }
+    call_tuple(std::forward_as_tuple(std::move(args)...));
   }
   /**
    * @brief Call all registered subscribers, extracting event arguments from the given tuple.
    *
-   * Since this will loop through all subscribers, you must not add or remove handlers while a call is in progress.
+   * Subscribers may be added or removed while a call is in progress. Removed subscribers will not be
+   * called anymore, added ones only for later calls.
+   *
+   * If the tuple is passed as rvalue, the last subscriber receives the tuple elements as rvalues.
    *
    * @tparam Tuple argument tuple type
    * @param args argument tuple
@@ -372,14 +1129,82 @@ public:
   template<class Tuple>
   void call_tuple(Tuple&& args) const
   {
-    // loop through subscribers
-    for (auto& handler : handlers)
+    call_tuple_impl(std::forward<Tuple>(args), std::integral_constant<bool, copyableArgs>());
+  }
+
+private:
+  // invoke one subscriber, measuring the time spent if requested
+  template<class Tuple>
+  static void invoke(const Subscriber& handler, Tuple&& args, bool timed)
+  {
+    if (timed)
     {
-      // invoke one handler
-      detail::apply(handler.function, args);
+      std::int64_t start = detail::instrumentationClock();
+      detail::apply(handler.function, std::forward<Tuple>(args));
+      handler.timing.record(detail::instrumentationClock() - start);
+      return;
     }
+    detail::apply(handler.function, std::forward<Tuple>(args));
   }
 
+  // reference the tuple elements for the keyed subscribers
+  template<class Tuple, std::size_t... I>
+  static ArgRefs makeArgRefs(const Tuple& args, detail::index_sequence<I...>)
+  {
+    return ArgRefs(std::get<I>(args)...);
+  }
+
+  // call_tuple for copyable arguments
+  template<class Tuple>
+  void call_tuple_impl(Tuple&& args, std::true_type) const
+  {
+    DispatchGuard guard(this);
+    bool timed = isInstrumentationEnabled();
+    // keyed subscribers first, since the last unkeyed one may consume the arguments
+    const KeyedSubscribersBase* keyed = keyedSubscribers.load(std::memory_order_acquire);
+    if (keyed != NULL)
+    {
+      keyed->dispatch(makeArgRefs(args, detail::make_index_sequence<sizeof...(Args)> {}), timed);
+    }
+    // the size is fixed during dispatch, new subscribers are deferred.
+    std::size_t count = handlers.size();
+    if (count == 0)
+    {
+      return;
+    }
+    // loop through all subscribers but the last one
+    std::size_t last = count - 1;
+    for (std::size_t idx = 0; idx < last; ++idx)
+    {
+      const Subscriber& handler = handlers[idx];
+      // skip removed subscribers
+      if (!handler.active.load(std::memory_order_acquire))
+      {
+        continue;
+      }
+      // invoke one handler, passing lvalues
+      invoke(handler, args, timed);
+    }
+    // the last handler may consume the arguments
+    if (handlers[last].active.load(std::memory_order_acquire))
+    {
+      invoke(handlers[last], std::forward<Tuple>(args), timed);
+    }
+  }
+  // call_tuple for move-only arguments, there is at most one subscriber
+  template<class Tuple>
+  void call_tuple_impl(Tuple&& args, std::false_type) const
+  {
+    DispatchGuard guard(this);
+    for (auto& handler : handlers)
+    {
+      if (handler.active.load(std::memory_order_acquire))
+      {
+        invoke(handler, std::forward<Tuple>(args), isInstrumentationEnabled());
+        return;
+      }
+    }
+  }
 };
 
 // now, we can define the implementation of EventParametersParser::callEvent
@@ -390,6 +1215,25 @@ inline void EventParametersParser<Args...>::callEvent(
   subscriberCollection->call_tuple(parseArgs(parameterStrings));
 }
 
+template<typename ... Args>
+inline void EventParametersParser<Args...>::callEvent(const StringView* parameters, std::size_t count) const
+{
+  subscriberCollection->call_tuple(parseArgs(parameters, count));
+}
+
+template<typename ... Args>
+inline void EventParametersParser<Args...>::callEventLine(StringView arguments) const
+{
+  subscriberCollection->call_tuple(parseArgs(arguments));
+}
+
+// now, we can define the implementation of EventSerializer::callEvent
+template<typename ... Args>
+inline void EventSerializer<Args...>::callEvent(BinaryReader& in) const
+{
+  subscriberCollection->call_tuple(readArgs(in));
+}
+
 }  // namespace ES
 
 #endif /* EVENTSUBSCRIBERCOLLECTION_H */
@@ -46,6 +46,30 @@ namespace ES {
 
 // forward-define types that are only referred to
 class EventParametersParserBase;
+class EventSerializerBase;
+class EventQueue;
+struct EventInstrumentationSnapshot;
+
+/**
+ * @brief Priority class of queued events.
+ *
+ * An EventQueue keeps one FIFO lane per priority. Events in higher priority lanes are processed first.
+ */
+enum class EventPriority {
+  /// @brief Highest priority, e.g. for emergency stops
+  CRITICAL,
+  /// @brief Elevated priority
+  HIGH,
+  /// @brief Default priority
+  NORMAL,
+  /// @brief Lowest priority, e.g. for logging
+  LOW
+};
+
+/**
+ * @brief Number of EventPriority values.
+ */
+constexpr unsigned int eventPriorityCount = 4;
 
 /**
  * @brief Template-free base class for handler collections.
@@ -81,6 +105,80 @@ public:
    */
   virtual const EventParametersParserBase* getParametersParser() const = 0;
 
+  /**
+   * @brief Get the binary serializer, which can record and replay this event.
+   */
+  virtual const EventSerializerBase* getSerializer() const = 0;
+
+  /**
+   * @brief Make this a latest-value event.
+   *
+   * An event queue keeps at most one queued event for a conflating event. Enqueuing the event while
+   * another one is still queued overwrites the arguments of the queued event, so the subscribers are
+   * called at most once per EventQueue::process() call, with the newest values. This is intended for
+   * state snapshots where only the newest value matters. If the overwriting event has a higher
+   * priority, the queued one is moved to the end of the higher priority lane.
+   *
+   * Argument types that can be neither move assigned nor moved without exceptions are not conflated.
+   *
+   * Should be set before the event is published.
+   */
+  virtual void setConflating(bool conflate) = 0;
+
+  /**
+   * @brief Check if this is a latest-value event, see setConflating().
+   */
+  virtual bool isConflating() const = 0;
+
+  /**
+   * @brief Set the default priority used when the event is enqueued.
+   *
+   * The priority can be overridden for single events when publishing.
+   * The initial priority is EventPriority::NORMAL.
+   */
+  virtual void setPriority(EventPriority priority) = 0;
+
+  /**
+   * @brief Get the default priority used when the event is enqueued, see setPriority().
+   */
+  virtual EventPriority getPriority() const = 0;
+
+  /**
+   * @brief Fill in the instrumentation data of this event, except for the name.
+   *
+   * See setInstrumentationEnabled().
+   */
+  virtual void getInstrumentation(EventInstrumentationSnapshot& snapshot) const = 0;
+
+  /**
+   * @brief Set the queue an EventSystem enqueues this event to, see EventSystem::setEventQueue().
+   *
+   * Events that are already queued are not moved.
+   *
+   * @throws std::logic_error if this collection is process wide, see isProcessWide().
+   */
+  virtual void setTargetQueue(EventQueue* queue) = 0;
+
+  /**
+   * @brief Get the queue set by setTargetQueue(), or NULL if none was set.
+   */
+  virtual EventQueue* getTargetQueue() const = 0;
+
+  /**
+   * @brief Remove the queue assignment and the routes to pinned subscribers, e.g. because the queues are destroyed.
+   *
+   * The pinned subscribers are not called anymore.
+   */
+  virtual void clearQueueRoutes() = 0;
+
+  /**
+   * @brief Check if this collection is shared by all EventSystems, i.e. it belongs to a static event.
+   *
+   * The queues of such an event cannot be configured, since they belong to one EventSystem. Thus,
+   * setTargetQueue() throws std::logic_error for these collections.
+   */
+  virtual bool isProcessWide() const = 0;
+
 private:
   /*
    * The handler id system is private, clients should use the SubscriptionHandle wrapper.
@@ -155,8 +253,9 @@ public:
    * Does nothing on an empty handle.
    * This handle is automatically turned into an empty handle when done.
    *
-   * IMPORTANT: This must not be called while the event that the handler was
-   * registered for is processed. Otherwise, you might get unexpected errors.
+   * This may be called while the event is dispatched, even from within the subscriber itself.
+   * The subscriber will not be called again, but if it is currently running, it's function object
+   * is kept alive until the dispatch is done.
    *
    */
   void unsubscribe()
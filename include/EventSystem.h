@@ -35,9 +35,75 @@
 
 #include "EventRegistry.h"
 #include "EventQueue.h"
+#include "EventStatic.h"
+#include "EventRecorder.h"
+#include "EventBridge.h"
+#include "EventWorkerPool.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace ES {
 
+// awaitable types, defined in the C++20 header EventAwait.h
+template<typename... Args>
+class NextEvent;
+template<typename... Args>
+class EventStream;
+
+/**
+ * @brief Identifies an event queue of an EventSystem, see EventSystem::addQueue().
+ *
+ * A default-constructed id refers to the default queue, which every event system has.
+ */
+class QueueId
+{
+private:
+  unsigned int index;
+
+public:
+  /**
+   * @brief Refer to the default queue.
+   */
+  QueueId() :
+      index(0)
+  {
+  }
+
+  /**
+   * @brief Refer to the queue with the given index.
+   */
+  explicit QueueId(unsigned int index) :
+      index(index)
+  {
+  }
+
+  /**
+   * @brief Get the queue index, in the order the queues were added. The default queue has index 0.
+   */
+  unsigned int getIndex() const
+  {
+    return index;
+  }
+
+  bool operator==(const QueueId& other) const
+  {
+    return index == other.index;
+  }
+
+  bool operator!=(const QueueId& other) const
+  {
+    return index != other.index;
+  }
+};
+
 /**
  * @brief Wrapper around EventRegistry and EventQueue to provide a simplified interface.
  *
@@ -51,27 +117,96 @@ class EventSystem : public EventRegistry
 {
 public:
 
+  /**
+   * @brief Create an event system.
+   *
+   * @param queueMode synchronization strategy of the inner event queue. Use EventQueueMode::LOCK_FREE
+   *                  if many threads publish events concurrently.
+   */
+  explicit EventSystem(EventQueueMode queueMode = EventQueueMode::LOCKING) :
+      dynamicQueue(queueMode), queueCount(1)
+  {
+    queues.fill(NULL);
+    queues[0] = &dynamicQueue;
+    queueNames.push_back("default");
+  }
+
+  /**
+   * @brief Destroy the event system, removing the queue assignments of the registered events.
+   */
+  ~EventSystem()
+  {
+    // collections may outlive the queues, e.g. if they are referenced by other event systems
+    std::lock_guard<std::mutex> lock(getRegistryMutex());
+    for (auto& entry : getRegisteredEvents())
+    {
+      entry.second->clearQueueRoutes();
+    }
+  }
+
   /**
    * @brief Register a named event and return the handler collection for it.
    *
    * The handler collection will be owned by the event system.
    *
+   * The returned handle may be stored and passed to publish() and call() to skip the
+   * lookup by name.
+   *
    * @tparam Args event argument types
    * @param name event name
    *
-   * @return handler collection for the registered event.
+   * @return handle of the handler collection for the registered event.
    */
   template<typename ...Args>
-  SubscriberCollectionDecay<Args...>* registerEvent(std::string name)
+  EventHandleDecay<Args...> registerEvent(const EventName& name)
   {
     return getOrRegister<Args...>(name);
   }
 
+  /**
+   * @brief Register a named latest-value event and return the handler collection for it.
+   *
+   * Publishing a latest-value event while another one is still queued overwrites the queued arguments,
+   * so its subscribers are called at most once per process() call, with the newest values.
+   * See SubscriberCollectionBase::setConflating().
+   *
+   * @tparam Args event argument types
+   * @param name event name
+   *
+   * @return handle of the handler collection for the registered event.
+   */
+  template<typename ...Args>
+  EventHandleDecay<Args...> registerEvent(const EventName& name, conflating_t)
+  {
+    auto e = getOrRegister<Args...>(name);
+    e->setConflating(true);
+    return e;
+  }
+
+  /**
+   * @brief Register a named event with a default priority and return the handler collection for it.
+   *
+   * Published events are queued in the lane for the priority, see EventQueue.
+   *
+   * @tparam Args event argument types
+   * @param name event name
+   * @param priority default priority of published events
+   *
+   * @return handle of the handler collection for the registered event.
+   */
+  template<typename ...Args>
+  EventHandleDecay<Args...> registerEvent(const EventName& name, EventPriority priority)
+  {
+    auto e = getOrRegister<Args...>(name);
+    e->setPriority(priority);
+    return e;
+  }
+
 private:
   // helper to get a HandlerCollection for a specific signature
   // the function pointer parameter allows to deduce Args from a function type
   template<typename Return, typename ...Args>
-  SubscriberCollectionDecay<Args...>* getForSignature(std::string name, Return (*)(Args...)) {
+  SubscriberCollectionDecay<Args...>* getForSignature(const EventName& name, Return (*)(Args...)) {
     return getOrRegister<Args...>(name);
   }
 public:
@@ -92,8 +227,8 @@ public:
    * By default, only functions returning void are allowed as subscribers.
    * A non-void return value can be explicitly ignored using the ignore_result overload.
    *
-   * IMPORTANT: This must not be called while the event that the handler collection was
-   * registered for is processed. Otherwise, you might get unexpected errors.
+   * This may be called while the event is processed, even from within a subscriber. A subscriber
+   * added during processing is only called for later events.
    */
   //@{
 
@@ -110,7 +245,7 @@ public:
    * @return          a handle that can be used to remove the newly registered subscriber.
    */
   template<typename Func>
-    SubscriptionHandle subscribe(std::string name, Func function)
+    SubscriptionHandle subscribe(const EventName& name, Func function)
   {
     auto e = getForSignature(name, (detail::function_signature_t<Func>*) nullptr);
     return e->addSubscriber(function);
@@ -129,7 +264,7 @@ public:
    * @return          a handle that can be used to remove the newly registered subscriber.
    */
   template<typename Func>
-    SubscriptionHandle subscribe(std::string name, Func function, ignore_result_t)
+    SubscriptionHandle subscribe(const EventName& name, Func function, ignore_result_t)
   {
     auto e = getForSignature(name, (detail::function_signature_t<Func>*) nullptr);
     return e->addSubscriber(function, ignore_result);
@@ -149,7 +284,7 @@ public:
    * @return          a handle that can be used to remove the newly registered subscriber.
    */
   template<typename... Args, typename Func, typename = typename std::enable_if<sizeof...(Args) != 0>::type>
-    SubscriptionHandle subscribe(std::string name, Func function)
+    SubscriptionHandle subscribe(const EventName& name, Func function)
   {
     auto e = getOrRegister<Args...>(name);
     return e->addSubscriber(function);
@@ -169,7 +304,7 @@ public:
    * @return          a handle that can be used to remove the newly registered subscriber.
    */
   template<typename... Args, typename Func, typename = typename std::enable_if<sizeof...(Args) != 0>::type>
-    SubscriptionHandle subscribe(std::string name, Func function, ignore_result_t)
+    SubscriptionHandle subscribe(const EventName& name, Func function, ignore_result_t)
   {
     auto e = getOrRegister<Args...>(name);
     return e->addSubscriber(function, ignore_result);
@@ -192,7 +327,7 @@ public:
    * @return      a handle that can be used to remove the newly registered subscriber.
    */
   template<typename ...Args, typename T>
-    SubscriptionHandle subscribe(std::string name, void(T::*fp)(Args...), type_identity_t<T>* obj)
+    SubscriptionHandle subscribe(const EventName& name, void(T::*fp)(Args...), type_identity_t<T>* obj)
   {
     auto e = getOrRegister<Args...>(name);
     return e->addSubscriber(fp, obj);
@@ -215,7 +350,7 @@ public:
    * @return      a handle that can be used to remove the newly registered subscriber.
    */
   template<typename ...Args, typename T>
-    SubscriptionHandle subscribe(std::string name, void(T::*fp)(Args...) const, const type_identity_t<T>* obj)
+    SubscriptionHandle subscribe(const EventName& name, void(T::*fp)(Args...) const, const type_identity_t<T>* obj)
   {
     auto e = getOrRegister<Args...>(name);
     return e->addSubscriber(fp, obj);
@@ -238,7 +373,7 @@ public:
    * @return      a handle that can be used to remove the newly registered subscriber.
    */
   template<typename ...Args, typename Return, typename T>
-  SubscriptionHandle subscribe(std::string name, Return(T::*fp)(Args...), type_identity_t<T>* obj, ignore_result_t)
+  SubscriptionHandle subscribe(const EventName& name, Return(T::*fp)(Args...), type_identity_t<T>* obj, ignore_result_t)
   {
     auto e = getOrRegister<Args...>(name);
     return e->addSubscriber(fp, obj, ignore_result);
@@ -261,14 +396,94 @@ public:
    * @return      a handle that can be used to remove the newly registered subscriber.
    */
   template<typename ...Args, typename Return, typename T>
-  SubscriptionHandle subscribe(std::string name, Return(T::*fp)(Args...) const, const type_identity_t<T>* obj,
+  SubscriptionHandle subscribe(const EventName& name, Return(T::*fp)(Args...) const, const type_identity_t<T>* obj,
       ignore_result_t)
   {
     auto e = getOrRegister<Args...>(name);
     return e->addSubscriber(fp, obj, ignore_result);
   }
+
+  /**
+   * @brief Subscribe to a static event with a free function or lambda.
+   *
+   * The static event is added to the registry if required. Note that subscriptions to static
+   * events are process-wide, see StaticEvent.
+   *
+   * @tparam Tag static event tag, defined using ES_DEFINE_EVENT
+   *
+   * @param function  handler function
+   * @return          a handle that can be used to remove the newly registered subscriber.
+   */
+  template<typename Tag, typename Func, typename = typename std::enable_if<is_static_event<Tag>::value>::type>
+    SubscriptionHandle subscribe(Func function)
+  {
+    auto e = registerStaticEvent<Tag>();
+    return e->addSubscriber(function);
+  }
+
+  /**
+   * @brief Subscribe to a static event with a free function or lambda. The return value of the
+   * handler function is ignored.
+   *
+   * @tparam Tag static event tag, defined using ES_DEFINE_EVENT
+   *
+   * @param function  handler function
+   * @return          a handle that can be used to remove the newly registered subscriber.
+   */
+  template<typename Tag, typename Func, typename = typename std::enable_if<is_static_event<Tag>::value>::type>
+    SubscriptionHandle subscribe(Func function, ignore_result_t)
+  {
+    auto e = registerStaticEvent<Tag>();
+    return e->addSubscriber(function, ignore_result);
+  }
   //@}
 
+  /**
+   * @brief Subscribe to the events whose argument at KeyIndex equals the given key.
+   *
+   * The event argument types are derived from the function signature, like subscribe(). Dispatching an
+   * event only calls the keyed subscribers with a matching key, see SubscriberCollection::addKeyedSubscriber().
+   *
+   * @tparam KeyIndex index of the key argument, the first one by default
+   *
+   * @param name      event name
+   * @param key       key to match
+   * @param function  handler function
+   * @return          a handle that can be used to remove the newly registered subscriber.
+   *
+   * @throws std::logic_error if other keyed subscribers of the event use a different key argument.
+   */
+  template<std::size_t KeyIndex = 0, typename Key, typename Func>
+    SubscriptionHandle subscribeKeyed(const EventName& name, const Key& key, Func function)
+  {
+    auto e = getForSignature(name, (detail::function_signature_t<Func>*) nullptr);
+    return e->template addKeyedSubscriber<KeyIndex>(key, function);
+  }
+
+  /**
+   * @brief Subscribe to the events whose argument at KeyIndex equals the given key, using a
+   * pre-resolved event handle. See subscribeKeyed().
+   *
+   * @tparam KeyIndex index of the key argument, the first one by default
+   *
+   * @param event     event handle, as returned by registerEvent() or getOrRegister()
+   * @param key       key to match
+   * @param function  handler function
+   * @return          a handle that can be used to remove the newly registered subscriber.
+   *
+   * @throws std::invalid_argument if the handle is empty.
+   * @throws std::logic_error if other keyed subscribers of the event use a different key argument.
+   */
+  template<std::size_t KeyIndex = 0, typename... Args, typename Key, typename Func>
+    SubscriptionHandle subscribeKeyed(const EventHandle<Args...>& event, const Key& key, Func function)
+  {
+    if (event.get() == NULL)
+    {
+      throw std::invalid_argument("Empty event handle");
+    }
+    return event->template addKeyedSubscriber<KeyIndex>(key, function);
+  }
+
   /**
    * @brief Enqueue an event.
    *
@@ -276,85 +491,1045 @@ public:
    *
    * This method is thread safe, it can be invoked from a background thread.
    *
+   * The argument values are moved into the queue, so passing rvalues avoids copying them.
+   * When the event is processed, the last subscriber receives the values as rvalues. This
+   * allows to publish move-only types like std::unique_ptr to an event with a single subscriber.
+   *
    * @tparam Args event argument types
    * @param name event name
    * @param args event argument values
    *
-   * @return `false` if the event was not registered because there are no subscribers.
+   * @return the outcome, which converts to `false` if the event was not registered because there are
+   *         no subscribers, or if it was rejected by a full queue.
    */
   template<typename ...Args>
-  bool publish(std::string name, Args... args)
+  PublishResult publish(const EventName& name, Args... args)
   {
     auto e = getSubscribers<Args...>(name);
     if (e == NULL)
     {
       // not registered
-      return false;
+      return PublishStatus::NOT_REGISTERED;
     }
 
     // enqueue event
-    dynamicQueue.enqueue(e, args...);
+    return enqueueRouted(e, std::tuple<typename std::decay<Args>::type...>(std::move(args)...), e->getPriority());
+  }
 
-    return true;
+  /**
+   * @brief Enqueue an event using a pre-resolved event handle.
+   *
+   * Unlike the by-name overload, this does not need to look up the event in the registry,
+   * so it is considerably faster for events that are published frequently.
+   *
+   * This method is thread safe, it can be invoked from a background thread.
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   * @param args event argument values
+   *
+   * @return the outcome, which converts to `false` if the handle is empty, or if the event was
+   *         rejected by a full queue.
+   */
+  template<typename ...Args>
+  PublishResult publish(const EventHandle<Args...>& event, type_identity_t<Args>... args)
+  {
+    if (event.get() == NULL)
+    {
+      // empty handle
+      return PublishStatus::NOT_REGISTERED;
+    }
+
+    // enqueue event
+    return enqueueRouted(event.get(), std::tuple<Args...>(std::move(args)...), event->getPriority());
   }
 
   /**
-   * @brief Call an event.
+   * @brief Enqueue a static event.
    *
-   * The event is called directlz.
+   * The subscriber collection is resolved at compile time, so this neither looks up the event
+   * in the registry nor checks the argument types at runtime. The argument values must be
+   * convertible to the event argument types.
    *
-   * This method is not thread safe.
+   * This method is thread safe, it can be invoked from a background thread.
+   *
+   * @tparam Tag static event tag, defined using ES_DEFINE_EVENT
+   * @param args event argument values
+   *
+   * @return the outcome, which converts to `false` if the event was rejected by a full queue.
+   */
+  template<typename Tag, typename ...Args>
+  typename std::enable_if<is_static_event<Tag>::value, PublishResult>::type publish(Args&&... args)
+  {
+    return publish(Tag::getHandle(), std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Enqueue an event with an explicit priority.
+   *
+   * Like publish(), but overrides the default priority of the event.
    *
    * @tparam Args event argument types
+   * @param priority priority of this event
    * @param name event name
    * @param args event argument values
    *
-   * @return `false` if the event was not registered because there are no subscribers.
+   * @return the outcome, see publish().
    */
   template<typename ...Args>
-  bool call(std::string name, Args... args)
+  PublishResult publishWithPriority(EventPriority priority, const EventName& name, Args... args)
   {
     auto e = getSubscribers<Args...>(name);
     if (e == NULL)
     {
       // not registered
-      return false;
+      return PublishStatus::NOT_REGISTERED;
     }
 
     // enqueue event
-    e->call(args...);
+    return enqueueRouted(e, std::tuple<typename std::decay<Args>::type...>(std::move(args)...), priority);
+  }
 
-    return true;
+  /**
+   * @brief Enqueue an event with an explicit priority using a pre-resolved event handle.
+   *
+   * Like publish(), but overrides the default priority of the event.
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param priority priority of this event
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   * @param args event argument values
+   *
+   * @return the outcome, see publish().
+   */
+  template<typename ...Args>
+  PublishResult publishWithPriority(EventPriority priority, const EventHandle<Args...>& event,
+      type_identity_t<Args>... args)
+  {
+    if (event.get() == NULL)
+    {
+      // empty handle
+      return PublishStatus::NOT_REGISTERED;
+    }
+
+    // enqueue event
+    return enqueueRouted(event.get(), std::tuple<Args...>(std::move(args)...), priority);
   }
 
   /**
-   * @brief Process all queued events from the inner event queue.
+   * @brief Enqueue an event after the given delay.
+   *
+   * The event is kept in the queue's timer wheel until it is due, see EventQueue::enqueueAt().
+   * Arguments and priority are handled like publish().
+   *
+   * This method is thread safe, it can be invoked from a background thread.
+   *
+   * @tparam Args event argument types
+   * @param name event name
+   * @param delay time until the event is enqueued
+   * @param args event argument values
+   *
+   * @return a handle to cancel the event, which is empty if the event was not registered.
    */
-  void process()
+  template<typename Rep, typename Period, typename ...Args>
+  TimerHandle publishAfter(const EventName& name, const std::chrono::duration<Rep, Period>& delay, Args... args)
   {
-    dynamicQueue.process();
+    auto e = getSubscribers<Args...>(name);
+    if (e == NULL)
+    {
+      // not registered
+      return TimerHandle();
+    }
+    return getTargetQueue(e).enqueueAfter(e, delay, std::tuple<Args...>(std::move(args)...), e->getPriority());
   }
 
   /**
-   * @brief Process all events in the queue. If more events are queued during processing, they are picked up as well.
+   * @brief Enqueue an event after the given delay using a pre-resolved event handle, see publishAfter().
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   * @param delay time until the event is enqueued
+   * @param args event argument values
+   *
+   * @return a handle to cancel the event, which is empty if the event handle is empty.
    */
-  int  processUntilEmpty(int maxProcessCalls=-1)
+  template<typename ...Args, typename Rep, typename Period>
+  TimerHandle publishAfter(const EventHandle<Args...>& event, const std::chrono::duration<Rep, Period>& delay,
+      type_identity_t<Args>... args)
   {
-    return dynamicQueue.processUntilEmpty(maxProcessCalls);
+    if (event.get() == NULL)
+    {
+      // empty handle
+      return TimerHandle();
+    }
+    return getTargetQueue(event.get()).enqueueAfter(event.get(), delay, std::tuple<Args...>(std::move(args)...),
+        event->getPriority());
   }
 
   /**
-   * @brief Process all queued events for a single named event.
+   * @brief Enqueue an event at the given point in time, see publishAfter().
+   *
+   * @tparam Args event argument types
    * @param name event name
+   * @param deadline time at which the event is enqueued
+   * @param args event argument values
+   *
+   * @return a handle to cancel the event, which is empty if the event was not registered.
    */
-  void processNamed(std::string name)
+  template<typename ...Args>
+  TimerHandle publishAt(const EventName& name, std::chrono::steady_clock::time_point deadline, Args... args)
+  {
+    auto e = getSubscribers<Args...>(name);
+    if (e == NULL)
+    {
+      // not registered
+      return TimerHandle();
+    }
+    return getTargetQueue(e).enqueueAt(e, deadline, std::tuple<Args...>(std::move(args)...), e->getPriority());
+  }
+
+  /**
+   * @brief Enqueue an event at the given point in time using a pre-resolved event handle, see publishAfter().
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   * @param deadline time at which the event is enqueued
+   * @param args event argument values
+   *
+   * @return a handle to cancel the event, which is empty if the event handle is empty.
+   */
+  template<typename ...Args>
+  TimerHandle publishAt(const EventHandle<Args...>& event, std::chrono::steady_clock::time_point deadline,
+      type_identity_t<Args>... args)
+  {
+    if (event.get() == NULL)
+    {
+      // empty handle
+      return TimerHandle();
+    }
+    return getTargetQueue(event.get()).enqueueAt(event.get(), deadline, std::tuple<Args...>(std::move(args)...),
+        event->getPriority());
+  }
+
+  /**
+   * @brief Enqueue an event periodically, starting one period from now, until it is cancelled.
+   *
+   * See EventQueue::enqueuePeriodic().
+   *
+   * @tparam Args event argument types, must be copyable
+   * @param name event name
+   * @param period time between the events, at least one millisecond
+   * @param args event argument values, copied for each event
+   *
+   * @return a handle to cancel the events, which is empty if the event was not registered.
+   *
+   * @throws std::invalid_argument if the period is less than one millisecond.
+   */
+  template<typename Rep, typename Period, typename ...Args>
+  TimerHandle publishEvery(const EventName& name, const std::chrono::duration<Rep, Period>& period, Args... args)
+  {
+    auto e = getSubscribers<Args...>(name);
+    if (e == NULL)
+    {
+      // not registered
+      return TimerHandle();
+    }
+    return getTargetQueue(e).enqueuePeriodic(e, std::chrono::steady_clock::now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(period), period,
+        std::tuple<Args...>(std::move(args)...), e->getPriority());
+  }
+
+  /**
+   * @brief Enqueue an event periodically using a pre-resolved event handle, see publishEvery().
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   * @param period time between the events, at least one millisecond
+   * @param args event argument values, copied for each event
+   *
+   * @return a handle to cancel the events, which is empty if the event handle is empty.
+   *
+   * @throws std::invalid_argument if the period is less than one millisecond.
+   */
+  template<typename ...Args, typename Rep, typename Period>
+  TimerHandle publishEvery(const EventHandle<Args...>& event, const std::chrono::duration<Rep, Period>& period,
+      type_identity_t<Args>... args)
+  {
+    if (event.get() == NULL)
+    {
+      // empty handle
+      return TimerHandle();
+    }
+    return getTargetQueue(event.get()).enqueuePeriodic(event.get(), std::chrono::steady_clock::now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(period), period,
+        std::tuple<Args...>(std::move(args)...), event->getPriority());
+  }
+
+  /**
+   * @brief Cancel an event scheduled with publishAfter(), publishAt() or publishEvery().
+   *
+   * @param timer handle returned when scheduling
+   * @return false if the event was already enqueued, or cancelled before.
+   */
+  bool cancelTimer(TimerHandle timer)
+  {
+    // the timer ids are unique across all queues
+    unsigned int count = queueCount.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      if (queues[i]->cancelTimer(timer))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Await the next occurrence of an event in a C++20 coroutine.
+   *
+   * Only available if EventAwait.h is included. Registers the event if needed, like subscribe().
+   * The coroutine is resumed from within process(), see NextEvent.
+   *
+   * @tparam Args event argument types
+   * @param name event name
+   */
+  template<typename... Args>
+  NextEvent<typename std::decay<Args>::type...> next(const EventName& name);
+
+  /**
+   * @brief Create a stream of the occurrences of an event, to be awaited in a C++20 coroutine.
+   *
+   * Only available if EventAwait.h is included. Registers the event if needed, like subscribe().
+   * See EventStream.
+   *
+   * @tparam Args event argument types
+   * @param name event name
+   */
+  template<typename... Args>
+  EventStream<typename std::decay<Args>::type...> events(const EventName& name);
+
+  /**
+   * @brief Create a BatchPublisher to enqueue many events at once.
+   *
+   * The events are added to the queue when the batch is flushed or destroyed.
+   * See EventQueue::BatchPublisher.
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   *
+   * @throws std::invalid_argument if the handle is empty.
+   */
+  template<typename ...Args>
+  EventQueue::BatchPublisher<Args...> createBatch(const EventHandle<Args...>& event)
+  {
+    if (event.get() == NULL)
+    {
+      throw std::invalid_argument("Empty event handle");
+    }
+    return getTargetQueue(event.get()).batch(event.get());
+  }
+
+  /**
+   * @brief Enqueue an event for every element of a range, using a single queue operation.
+   *
+   * The elements are either argument tuples, or the argument values for events with one argument.
+   *
+   * @tparam Args event argument types
+   * @param name event name
+   * @param values range of event arguments
+   *
+   * @return the number of queued events. Zero if the event was not registered.
+   */
+  template<typename ...Args, typename Range>
+  std::size_t publishBatch(const EventName& name, Range&& values)
+  {
+    auto e = getSubscribers<Args...>(name);
+    if (e == NULL)
+    {
+      // not registered
+      return 0;
+    }
+
+    auto batch = getTargetQueue(e).batch(e);
+    batch.publishRange(std::forward<Range>(values));
+    return batch.flush();
+  }
+
+  /**
+   * @brief Enqueue an event for every element of a range, using a pre-resolved event handle.
+   *
+   * The elements are either argument tuples, or the argument values for events with one argument.
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   * @param values range of event arguments
+   *
+   * @return the number of queued events. Zero if the handle is empty.
+   */
+  template<typename ...Args, typename Range>
+  std::size_t publishBatch(const EventHandle<Args...>& event, Range&& values)
+  {
+    if (event.get() == NULL)
+    {
+      // empty handle
+      return 0;
+    }
+
+    auto batch = getTargetQueue(event.get()).batch(event.get());
+    batch.publishRange(std::forward<Range>(values));
+    return batch.flush();
+  }
+
+  /**
+   * @brief Call an event.
+   *
+   * The event is called directlz. Subscribers pinned to other queues, see subscribeOn(), are
+   * called as well, on the calling thread.
+   *
+   * This method is not thread safe.
+   *
+   * @tparam Args event argument types
+   * @param name event name
+   * @param args event argument values
+   *
+   * @return `false` if the event was not registered because there are no subscribers.
+   */
+  template<typename ...Args>
+  bool call(const EventName& name, Args... args)
+  {
+    auto e = getSubscribers<Args...>(name);
+    if (e == NULL)
+    {
+      // not registered
+      return false;
+    }
+
+    // call event, the pinned subscribers first, since the others may consume the arguments
+    callPinned(e, std::forward_as_tuple(args...),
+        std::integral_constant<bool, detail::all_copy_constructible<Args...>::value>());
+    e->call(std::move(args)...);
+
+    return true;
+  }
+
+  /**
+   * @brief Call an event using a pre-resolved event handle.
+   *
+   * The event is called directly, without looking it up in the registry. Subscribers pinned to
+   * other queues are called as well, on the calling thread.
+   *
+   * This method is not thread safe.
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   * @param args event argument values
+   *
+   * @return `false` if the handle is empty.
+   */
+  template<typename ...Args>
+  bool call(const EventHandle<Args...>& event, type_identity_t<Args>... args)
+  {
+    if (event.get() == NULL)
+    {
+      // empty handle
+      return false;
+    }
+
+    // call event, the pinned subscribers first, since the others may consume the arguments
+    callPinned(event.get(), std::forward_as_tuple(args...),
+        std::integral_constant<bool, detail::all_copy_constructible<Args...>::value>());
+    event->call(std::move(args)...);
+
+    return true;
+  }
+
+  /**
+   * @brief Call a static event.
+   *
+   * The subscriber collection is resolved at compile time, see publish().
+   *
+   * This method is not thread safe.
+   *
+   * @tparam Tag static event tag, defined using ES_DEFINE_EVENT
+   * @param args event argument values
+   */
+  template<typename Tag, typename ...Args>
+  typename std::enable_if<is_static_event<Tag>::value>::type call(Args&&... args)
+  {
+    call(Tag::getHandle(), std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Get the inner event queue, which holds published events until they are processed.
+   */
+  EventQueue& getQueue()
+  {
+    return dynamicQueue;
+  }
+
+  /**
+   * @brief Pre-allocate memory in the inner event queue for events with the given argument types.
+   *
+   * See EventQueue::reserve() for details.
+   *
+   * @tparam Args event argument types
+   * @param count number of event nodes to reserve
+   */
+  template<typename ...Args>
+  void reserveQueuedEvents(std::size_t count)
+  {
+    dynamicQueue.reserve<Args...>(count);
+  }
+
+  /**
+   * @brief Limit the number of queued events.
+   *
+   * See EventQueue::setCapacity().
+   *
+   * @param maxEvents maximum number of queued events, zero means unbounded.
+   * @param policy what to do if an event is published while the queue is full.
+   */
+  void setQueueCapacity(std::size_t maxEvents, OverflowPolicy policy = OverflowPolicy::BLOCK)
+  {
+    dynamicQueue.setCapacity(maxEvents, policy);
+  }
+
+  /**
+   * @brief Limit the number of queued events for a single event.
+   *
+   * See EventQueue::setTopicCapacity(). The limit applies to the event's queue, and separately to
+   * every queue with subscribers pinned using subscribeOn(), including ones added later. It moves
+   * with the event when it is assigned to another queue, see setEventQueue().
+   *
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   * @param maxEvents maximum number of queued events, zero means unbounded.
+   * @param policy what to do if the event is published while its limit is reached.
+   * @throws std::invalid_argument if the handle is empty.
+   */
+  template<typename ...Args>
+  void setEventCapacity(const EventHandle<Args...>& event, std::size_t maxEvents,
+      OverflowPolicy policy = OverflowPolicy::BLOCK)
+  {
+    if (event.get() == NULL)
+    {
+      throw std::invalid_argument("Empty event handle");
+    }
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    TopicLimit& limit = eventLimits[event.get()];
+    limit.maxEvents = maxEvents;
+    limit.policy = policy;
+    applyEventLimit(event.get(), limit);
+  }
+
+  /**
+   * @brief Set the number of background threads used by process() and processUntilEmpty().
+   *
+   * With a non-zero thread count, events for different named events are processed concurrently,
+   * see EventQueue::processParallel(). Events of the same named event are still processed in order,
+   * and their subscribers are never called concurrently. The thread calling process() helps out.
+   *
+   * With zero threads, which is the default, all events are processed by the calling thread in the
+   * order they were published.
+   *
+   * Must not be called while events are processed.
+   *
+   * @param threadCount number of background threads
+   */
+  void setProcessingThreads(unsigned int threadCount)
+  {
+    workers.reset();
+    if (threadCount > 0)
+    {
+      workers.reset(new EventWorkerPool(threadCount));
+    }
+  }
+
+  /**
+   * @brief Get the number of background threads used by process(), as set by setProcessingThreads().
+   */
+  unsigned int getProcessingThreads() const
+  {
+    return workers ? workers->getThreadCount() : 0;
+  }
+
+  /**
+   * @brief Process all queued events from the inner event queue.
+   */
+  void process()
+  {
+    if (workers)
+    {
+      dynamicQueue.processParallel(*workers);
+    }
+    else
+    {
+      dynamicQueue.process();
+    }
+  }
+
+  /**
+   * @brief Process all events in the queue. If more events are queued during processing, they are picked up as well.
+   */
+  int  processUntilEmpty(int maxProcessCalls=-1)
+  {
+    if (workers)
+    {
+      return dynamicQueue.processUntilEmpty(*workers, maxProcessCalls);
+    }
+    return dynamicQueue.processUntilEmpty(maxProcessCalls);
+  }
+
+  /**
+   * @brief Block until an event is published or the timeout expires, then process all queued events.
+   *
+   * See EventQueue::wait().
+   *
+   * @param timeout maximum time to wait for the first event
+   * @return true if any events were processed.
+   */
+  template<typename Rep, typename Period>
+  bool waitAndProcess(const std::chrono::duration<Rep, Period>& timeout)
+  {
+    if (!dynamicQueue.wait(timeout))
+    {
+      return false;
+    }
+    if (workers)
+    {
+      return dynamicQueue.processParallel(*workers);
+    }
+    return dynamicQueue.process();
+  }
+
+  /**
+   * @brief Process events as they are published for the given duration, sleeping while there are none.
+   *
+   * @param duration time to spend processing.
+   * @return the number of process calls that processed events.
+   */
+  template<typename Rep, typename Period>
+  int processFor(const std::chrono::duration<Rep, Period>& duration)
+  {
+    auto deadline = std::chrono::steady_clock::now() + duration;
+    int nProcessCalls = 0;
+    while (true)
+    {
+      auto now = std::chrono::steady_clock::now();
+      if (now >= deadline)
+      {
+        break;
+      }
+      if (waitAndProcess(deadline - now))
+      {
+        nProcessCalls++;
+      }
+    }
+    return nProcessCalls;
+  }
+
+  /**
+   * @brief Wake up all threads blocked in waitAndProcess() or processFor().
+   */
+  void wakeUp()
+  {
+    dynamicQueue.wakeUp();
+  }
+
+  /**
+   * @brief Process all queued events for a single named event.
+   * @param name event name
+   */
+  void processNamed(const EventName& name)
+  {
+    auto subscribers = getSubscribers(name);
+    EventQueue* queue = subscribers == NULL ? NULL : subscribers->getTargetQueue();
+    (queue == NULL ? dynamicQueue : *queue).processForSubscribers(subscribers);
+  }
+
+  /**
+   * @brief Process all queued events for a single event, using a pre-resolved event handle.
+   *
+   * Unlike the by-name overload, this does not need to look up the event in the registry.
+   *
+   * @tparam Args event argument types, taken from the handle
+   * @param event event handle, as returned by registerEvent() or getOrRegister()
+   */
+  template<typename ...Args>
+  void processNamed(const EventHandle<Args...>& event)
+  {
+    if (event.get() == NULL)
+    {
+      // empty handle
+      return;
+    }
+    getTargetQueue(event.get()).processForSubscribers(event.get());
+  }
+
+  /**
+   * @name queues
+   *
+   * An event system can have several queues sharing one registry, so that different events are
+   * processed by different threads, e.g. GUI events by the GUI thread, control events by a
+   * real-time thread and logging by a background thread.
+   *
+   * Every event belongs to one queue, initially the default queue, see setEventQueue(). Single
+   * subscribers can additionally be pinned to another queue using subscribeOn(). publish() adds
+   * the event directly to every queue with pinned subscribers, without any forwarding, and to the
+   * event's queue unless all of it's subscribers are pinned. Delayed, periodic and batched events
+   * are distributed the same way when they are due or flushed, and call() calls the pinned
+   * subscribers directly. Each thread processes its queue with process(QueueId). When a queue
+   * processes the event, it calls the subscribers that belong to it.
+   *
+   * Pinned subscribers follow the event's conflating flag and it's limit set by setEventCapacity(),
+   * which applies to each queue separately. processNamed() only uses the event's queue. The methods
+   * without queue id, like process() and getQueue(), refer to the default queue.
+   *
+   * The queue assignment is stored in the subscriber collection, and removed when the event system
+   * is destroyed. Static events are shared by all event systems, so they always use the default
+   * queue, and setEventQueue() and subscribeOn() reject them.
+   */
+  //@{
+
+  /// @brief Maximum number of queues of an event system, including the default queue.
+  static constexpr unsigned int maxQueueCount = 64;
+
+  /**
+   * @brief Add a named event queue.
+   *
+   * Queues should be added during startup. They exist as long as the event system.
+   *
+   * @param name queue name, must be unique. The default queue is named "default".
+   * @param queueMode synchronization strategy of the queue.
+   * @return the id of the new queue.
+   *
+   * @throws std::invalid_argument if a queue with the name exists.
+   * @throws std::logic_error if there are maxQueueCount queues already.
+   */
+  QueueId addQueue(const std::string& name, EventQueueMode queueMode = EventQueueMode::LOCKING)
+  {
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    for (auto& existing : queueNames)
+    {
+      if (existing == name)
+      {
+        throw std::invalid_argument("The queue named '" + name + "' already exists!");
+      }
+    }
+    unsigned int index = queueCount.load(std::memory_order_relaxed);
+    if (index >= maxQueueCount)
+    {
+      throw std::logic_error("Too many event queues");
+    }
+
+    ownedQueues.emplace_back(new EventQueue(queueMode));
+    queueNames.push_back(name);
+    queues[index] = ownedQueues.back().get();
+    // release: publish the queue to getQueue()
+    queueCount.store(index + 1, std::memory_order_release);
+    return QueueId(index);
+  }
+
+  /**
+   * @brief Get the id of a queue by name.
+   *
+   * @throws std::invalid_argument if there is no queue with the name.
+   */
+  QueueId getQueueId(const std::string& name) const
+  {
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    for (std::size_t i = 0; i < queueNames.size(); ++i)
+    {
+      if (queueNames[i] == name)
+      {
+        return QueueId(static_cast<unsigned int>(i));
+      }
+    }
+    throw std::invalid_argument("There is no queue named '" + name + "'!");
+  }
+
+  /**
+   * @brief Get the number of queues, including the default queue.
+   */
+  unsigned int getQueueCount() const
+  {
+    return queueCount.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Get an event queue by id.
+   *
+   * @throws std::invalid_argument if there is no queue with the id.
+   */
+  EventQueue& getQueue(QueueId queue)
+  {
+    if (queue.getIndex() >= queueCount.load(std::memory_order_acquire))
+    {
+      throw std::invalid_argument("Invalid queue id");
+    }
+    return *queues[queue.getIndex()];
+  }
+
+  /**
+   * @brief Assign an event to a queue.
+   *
+   * Later published events are added to that queue. Events that are already queued stay in their
+   * queue. Subscribers pinned to a queue using subscribeOn() are not affected.
+   *
+   * @param name event name
+   * @param queue id of the queue
+   *
+   * @throws std::invalid_argument if the event is not registered, or there is no queue with the id.
+   * @throws std::logic_error if the event is a static event.
+   */
+  void setEventQueue(const EventName& name, QueueId queue)
+  {
+    auto e = getSubscribers(name);
+    if (e == NULL)
+    {
+      std::ostringstream os;
+      os << "The event named '" << name << "' is not registered!";
+      throw std::invalid_argument(os.str());
+    }
+    assignQueue(e, getQueue(queue));
+  }
+
+  /**
+   * @brief Assign an event to a queue using a pre-resolved event handle, see setEventQueue().
+   *
+   * @throws std::invalid_argument if the handle is empty, or there is no queue with the id.
+   * @throws std::logic_error if the event is a static event.
+   */
+  template<typename ...Args>
+  void setEventQueue(const EventHandle<Args...>& event, QueueId queue)
+  {
+    if (event.get() == NULL)
+    {
+      throw std::invalid_argument("Empty event handle");
+    }
+    assignQueue(event.get(), getQueue(queue));
+  }
+
+  /**
+   * @brief Get the queue an event is assigned to, see setEventQueue().
+   *
+   * @throws std::invalid_argument if the event is not registered.
+   */
+  QueueId getEventQueue(const EventName& name)
+  {
+    auto e = getSubscribers(name);
+    if (e == NULL)
+    {
+      std::ostringstream os;
+      os << "The event named '" << name << "' is not registered!";
+      throw std::invalid_argument(os.str());
+    }
+    EventQueue* target = e->getTargetQueue();
+    unsigned int count = queueCount.load(std::memory_order_acquire);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      if (queues[i] == target)
+      {
+        return QueueId(i);
+      }
+    }
+    return QueueId();
+  }
+
+  /**
+   * @brief Subscribe a function which is called by the given queue, regardless of the queue the event is assigned to.
+   *
+   * The event argument types are derived from the function signature, see subscribe(). The event is
+   * registered if needed.
+   *
+   * @param queue     id of the queue that calls the subscriber
+   * @param name      event name
+   * @param function  handler function
+   * @return          a handle that can be used to remove the newly registered subscriber.
+   *
+   * @throws std::invalid_argument if there is no queue with the id.
+   * @throws std::logic_error if the event arguments are not copyable, or the event is a static event.
+   */
+  template<typename Func>
+  SubscriptionHandle subscribeOn(QueueId queue, const EventName& name, Func function)
+  {
+    EventQueue& target = getQueue(queue);
+    auto e = getForSignature(name, (detail::function_signature_t<Func>*) nullptr);
+    return pin(e, target).addSubscriber(function);
+  }
+
+  /**
+   * @brief Subscribe a function which is called by the given queue, using a pre-resolved event handle.
+   *
+   * See subscribeOn().
+   *
+   * @throws std::invalid_argument if the handle is empty, or there is no queue with the id.
+   * @throws std::logic_error if the event arguments are not copyable, or the event is a static event.
+   */
+  template<typename ...Args, typename Func>
+  SubscriptionHandle subscribeOn(QueueId queue, const EventHandle<Args...>& event, Func function)
+  {
+    if (event.get() == NULL)
+    {
+      throw std::invalid_argument("Empty event handle");
+    }
+    EventQueue& target = getQueue(queue);
+    return pin(event.get(), target).addSubscriber(function);
+  }
+
+  /**
+   * @brief Process all queued events of the given queue on the calling thread.
+   *
+   * The processing threads set by setProcessingThreads() are not used.
+   *
+   * @throws std::invalid_argument if there is no queue with the id.
+   */
+  void process(QueueId queue)
+  {
+    getQueue(queue).process();
+  }
+
+  /**
+   * @brief Process all events in the given queue, including events queued during processing.
+   *
+   * @throws std::invalid_argument if there is no queue with the id.
+   */
+  int processUntilEmpty(QueueId queue, int maxProcessCalls = -1)
+  {
+    return getQueue(queue).processUntilEmpty(maxProcessCalls);
+  }
+
+  /**
+   * @brief Block until an event is added to the given queue or the timeout expires, then process it's events.
+   *
+   * @return true if any events were processed.
+   * @throws std::invalid_argument if there is no queue with the id.
+   */
+  template<typename Rep, typename Period>
+  bool waitAndProcess(QueueId queue, const std::chrono::duration<Rep, Period>& timeout)
+  {
+    EventQueue& target = getQueue(queue);
+    if (!target.wait(timeout))
+    {
+      return false;
+    }
+    return target.process();
+  }
+
+  /**
+   * @brief Wake up all threads blocked in waitAndProcess() for the given queue.
+   *
+   * @throws std::invalid_argument if there is no queue with the id.
+   */
+  void wakeUp(QueueId queue)
+  {
+    getQueue(queue).wakeUp();
+  }
+  //@}
+protected:
+  /// @brief queue for published events
+  EventQueue dynamicQueue;
+  /// @brief worker threads for processing, NULL if processing on the calling thread only
+  std::unique_ptr<EventWorkerPool> workers;
+private:
+  // queues by index, the first one is dynamicQueue. Only the first queueCount entries are set.
+  std::array<EventQueue*, maxQueueCount> queues;
+  std::atomic<unsigned int> queueCount;
+  // queues created by addQueue(), owned. Guarded by queuesMutex.
+  std::vector<std::unique_ptr<EventQueue>> ownedQueues;
+  // queue names by index. Guarded by queuesMutex.
+  std::vector<std::string> queueNames;
+  // per-event limits set by setEventCapacity(), by the event's own collection
+  struct TopicLimit
+  {
+    std::size_t maxEvents;
+    OverflowPolicy policy;
+  };
+  // guarded by queuesMutex
+  std::unordered_map<const SubscriberCollectionBase*, TopicLimit> eventLimits;
+  mutable std::mutex queuesMutex;
+
+  // apply an event's limit to it's queue and to the pinned collections on their queues. queuesMutex must be held.
+  template<typename ...Args>
+  void applyEventLimit(SubscriberCollection<Args...>* e, const TopicLimit& limit)
+  {
+    getTargetQueue(e).setTopicCapacity(e, limit.maxEvents, limit.policy);
+    auto routes = e->getQueueRoutes();
+    if (routes != NULL)
+    {
+      for (auto& route : routes->pinned)
+      {
+        route.first->setTopicCapacity(route.second, limit.maxEvents, limit.policy);
+      }
+    }
+  }
+
+  // assign an event to a queue, moving it's limit along
+  void assignQueue(SubscriberCollectionBase* e, EventQueue& queue)
+  {
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    auto limit = eventLimits.find(e);
+    EventQueue* previous = e->getTargetQueue();
+    e->setTargetQueue(&queue);
+    if (limit != eventLimits.end())
+    {
+      (previous == NULL ? dynamicQueue : *previous).setTopicCapacity(e, 0);
+      queue.setTopicCapacity(e, limit->second.maxEvents, limit->second.policy);
+    }
+  }
+
+  // get the collection for subscribers pinned to a queue, applying the event's limit to it
+  template<typename ...Args>
+  SubscriberCollection<Args...>& pin(SubscriberCollection<Args...>* e, EventQueue& queue)
+  {
+    std::lock_guard<std::mutex> lock(queuesMutex);
+    SubscriberCollection<Args...>& pinned = e->getPinnedSubscribers(&queue);
+    auto limit = eventLimits.find(e);
+    if (limit != eventLimits.end())
+    {
+      queue.setTopicCapacity(&pinned, limit->second.maxEvents, limit->second.policy);
+    }
+    return pinned;
+  }
+
+  // get the queue an event is assigned to
+  template<typename ...Args>
+  EventQueue& getTargetQueue(const SubscriberCollection<Args...>* e)
+  {
+    auto routes = e->getQueueRoutes();
+    return routes == NULL || routes->queue == NULL ? dynamicQueue : *routes->queue;
+  }
+
+  // enqueue an event to the queue it's assigned to and to all queues with pinned subscribers
+  template<typename ...Args>
+  PublishResult enqueueRouted(SubscriberCollection<Args...>* e, std::tuple<Args...>&& args, EventPriority priority)
+  {
+    return getTargetQueue(e).enqueueRouted(e, std::move(args), priority);
+  }
+
+  // call the pinned subscribers of an event with copies of the arguments
+  template<typename ...Args, class Tuple>
+  static void callPinned(SubscriberCollection<Args...>* e, const Tuple& args, std::true_type)
+  {
+    auto routes = e->getQueueRoutes();
+    if (routes == NULL)
+    {
+      return;
+    }
+    for (auto& route : routes->pinned)
+    {
+      if (route.second->getLocalHandlerCount() != 0)
+      {
+        route.second->call_tuple(args);
+      }
+    }
+  }
+
+  // move-only events can't have pinned subscribers
+  template<typename ...Args, class Tuple>
+  static void callPinned(SubscriberCollection<Args...>*, const Tuple&, std::false_type)
   {
-    auto subscribers = getSubscribers(name);
-    dynamicQueue.processForSubscribers(subscribers);
   }
-protected:
-  /// @brief queue for published events
-  EventQueue dynamicQueue;
 };
 
 }  // namespace ES
@@ -82,6 +82,107 @@ struct type_identity {
 template<typename T>
 using type_identity_t = typename type_identity<T>::type;
 
+/**
+ * @brief Non-owning reference to a range of characters.
+ *
+ * A minimal replacement for std::string_view, which is added by C++17. The member names follow the
+ * standard library, so the class can be replaced once the library moves to a newer language level.
+ *
+ * A StringView is implicitly created from a C string or a std::string, and converts implicitly to
+ * a std::string. The referenced characters are not copied, so they must outlive the view.
+ */
+class StringView
+{
+private:
+  const char* ptr;
+  std::size_t length;
+
+public:
+  /// @brief Creates an empty view.
+  StringView() :
+      ptr(""), length(0)
+  {
+  }
+
+  /// @brief References a null-terminated C string.
+  StringView(const char* str) :
+      ptr(str), length(std::strlen(str))
+  {
+  }
+
+  /// @brief References a character range, which does not need to be null-terminated.
+  StringView(const char* str, std::size_t length) :
+      ptr(str), length(length)
+  {
+  }
+
+  /// @brief References the characters of a std::string.
+  StringView(const std::string& str) :
+      ptr(str.data()), length(str.size())
+  {
+  }
+
+  /// @brief Get the referenced characters. They are not necessarily null-terminated.
+  const char* data() const
+  {
+    return ptr;
+  }
+
+  /// @brief Get the number of characters.
+  std::size_t size() const
+  {
+    return length;
+  }
+
+  /// @brief Check if the view is empty.
+  bool empty() const
+  {
+    return length == 0;
+  }
+
+  /// @brief Pointer to the first character.
+  const char* begin() const
+  {
+    return ptr;
+  }
+
+  /// @brief Pointer past the last character.
+  const char* end() const
+  {
+    return ptr + length;
+  }
+
+  /// @brief Access a character.
+  char operator[](std::size_t idx) const
+  {
+    return ptr[idx];
+  }
+
+  /// @brief Copy the characters to a std::string.
+  std::string str() const
+  {
+    return std::string(ptr, length);
+  }
+
+  /// @brief Copy the characters to a std::string.
+  operator std::string() const
+  {
+    return str();
+  }
+
+  /// @brief Compare the characters.
+  bool operator==(const StringView& other) const
+  {
+    return length == other.length && std::memcmp(ptr, other.ptr, length) == 0;
+  }
+
+  /// @brief Compare the characters.
+  bool operator!=(const StringView& other) const
+  {
+    return !(*this == other);
+  }
+};
+
 
 
 // helpers to call a function with a tuple
@@ -101,85 +202,50 @@ template<size_t ...S> struct make_index_sequence_impl <0, S...>
 };
 template<size_t N> using make_index_sequence = typename make_index_sequence_impl<N>::type;
 
-// apply is only available in C++17
-// this is a stripped-down version limited to std::function and void return types
-// for explanation see https://en.cppreference.com/w/cpp/utility/apply
-template <class F, class Tuple, std::size_t... I>
-void apply_impl(const std::function<F>& f, Tuple&& t, index_sequence<I...>)
+// checks if all types are copy constructible.
+// events with non-copyable arguments can have only one subscriber, which receives the arguments as rvalues.
+template<typename... T>
+struct all_copy_constructible;
+template<>
+struct all_copy_constructible<> : std::true_type
 {
-  f(std::get<I>(std::forward<Tuple>(t))...);
-}
-template <class F, class Tuple>
-void apply(const std::function<F>& f, Tuple&& t)
+};
+template<typename T, typename... Rest>
+struct all_copy_constructible<T, Rest...> : std::integral_constant<bool,
+    std::is_copy_constructible<T>::value && all_copy_constructible<Rest...>::value>
 {
-  apply_impl(f, std::forward<Tuple>(t),
-             make_index_sequence<std::tuple_size<typename std::remove_reference<Tuple>::type>::value> {});
-}
+};
 
 
 // getting a a type name from a template argument
 // returns std::string to deal with demangling (which allocates memory)
+// specialize TypeName to give a type a more readable description.
 template <typename T>
-std::string getTypeName(void)
+struct TypeName
 {
-  const char* name = typeid(T).name();
+  static std::string get()
+  {
+    const char* name = typeid(T).name();
 
 #if !defined (_MSC_VER)
-  // demangle name on linux
-  char* demangled = __cxa_demangle(name, NULL, 0, NULL);
-  std::string demStr = demangled;
-  free(demangled);
+    // demangle name on linux
+    char* demangled = __cxa_demangle(name, NULL, 0, NULL);
+    std::string demStr = demangled;
+    free(demangled);
 
-  return demStr;
+    return demStr;
 #else
-  return name;
+    return name;
 #endif
-}
-
-
-// std::bind with a variable argument count. For explanation see
-// https://stackoverflow.com/questions/21192659/variadic-templates-and-stdbind?lq=1
-
-template<int> // begin with 0 here!
-struct placeholder_template
-{};
-
-}  // namespace detail
+  }
+};
 
-}  // namespace ES
-// MUST BE TOP LEVEL NAMESPACE
-namespace std
+template <typename T>
+std::string getTypeName(void)
 {
-template<int N>
-struct is_placeholder< ES::detail::placeholder_template<N> >
-  : integral_constant<int, N+1> // the one is important
-{};
+  return TypeName<T>::get();
 }
 
-namespace ES {
-
-namespace detail {
-
-// helper that is aware of the indices
-template<typename Func, typename T, std::size_t... I>
-inline auto bind_owner_helper(Func f, T* obj, index_sequence<I...>)
-  -> decltype(std::bind(f, obj, placeholder_template<I>()...))
-{
-  return std::bind(f, obj, placeholder_template<I>()...);
-}
-// this helper function binds a member function to it's owner object
-template<typename T, typename Return, typename...Args>
-inline auto bind_owner(Return(T::*fp)(Args...), type_identity_t<T>* obj)
-  -> decltype(bind_owner_helper(fp, obj, make_index_sequence<sizeof...(Args)>{}))
-{
-  return bind_owner_helper(fp, obj, make_index_sequence<sizeof...(Args)>{});
-}
-template<typename T, typename Return, typename...Args>
-inline auto bind_owner(Return(T::*fp)(Args...)const, const type_identity_t<T>* obj)
--> decltype(bind_owner_helper(fp, obj, make_index_sequence<sizeof...(Args)>{}))
-{
-  return bind_owner_helper(fp, obj, make_index_sequence<sizeof...(Args)>{});
-}
 
 // To support lambdas in subscribe, we need to deduce the function arguments.
 // How do we do that? ask pybind11.
@@ -215,21 +281,37 @@ using function_signature_t = conditional_t<
 >;
 
 
-// Turns out using a non-void returning function in a std::function<void(...)> is
-// not generally supported, and actually forbidden in c++14.
+// Subscribers must return void, so non-void returning functions are wrapped.
 // This wrapper functor forwards all arguments to the function, but discards the return value.
-template<typename Func, typename...Args>
+template<typename Func>
 struct ignore_return_value_wrapper
 {
 private:
   Func func;
 public:
-  ignore_return_value_wrapper(Func func): func(func) {}
-  void operator()(Args...args) {
-    func(args...);
+  ignore_return_value_wrapper(Func func): func(std::move(func)) {}
+  template<typename... A>
+  auto operator()(A&&... args) -> decltype((void) std::declval<Func&>()(std::forward<A>(args)...)) {
+    func(std::forward<A>(args)...);
   }
 };
 
+// cheap type identity: the address of a static per-type object.
+// Shared libraries usually merge these, but may not, so a mismatch must be verified by other means.
+template<typename T>
+struct TypeTag
+{
+  static const char id;
+};
+template<typename T>
+const char TypeTag<T>::id = 0;
+
+template<typename T>
+const void* getTypeTag()
+{
+  return &TypeTag<T>::id;
+}
+
 }  // namespace detail
 
 }  // namespace ES
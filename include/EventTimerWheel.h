@@ -0,0 +1,333 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTTIMERWHEEL_H
+#define EVENTTIMERWHEEL_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace ES {
+
+namespace detail
+{
+
+/**
+ * @brief Intrusive base of the entries of a TimerWheel.
+ */
+struct TimerWheelEntry
+{
+  TimerWheelEntry() :
+      next(NULL), prev(NULL), tick(0), level(0), slot(0)
+  {
+  }
+  virtual ~TimerWheelEntry() = default;
+
+  // links within the wheel slot, or the due list
+  TimerWheelEntry* next;
+  TimerWheelEntry* prev;
+  // due tick
+  std::uint64_t tick;
+  // position in the wheel
+  unsigned int level;
+  unsigned int slot;
+};
+
+/**
+ * @brief Hierarchical timer wheel.
+ *
+ * Entries are sorted into levels of 64 slots each, level n covering 64^(n+1) ticks. When the
+ * current tick crosses the boundary of a higher level slot, it's entries are redistributed into the
+ * lower levels. Thus, inserting and removing is O(1), and advancing is O(1) amortized per entry.
+ * Empty level 0 slots are skipped using an occupancy mask.
+ *
+ * The wheel does not own it's entries and is not thread-safe.
+ */
+class TimerWheel
+{
+public:
+  static constexpr unsigned int levelBits = 6;
+  static constexpr unsigned int slotCount = 1u << levelBits;
+  static constexpr unsigned int levelCount = 4;
+
+private:
+  TimerWheelEntry* slots[levelCount][slotCount];
+  // bit i is set if slot i of the level is not empty
+  std::uint64_t occupied[levelCount];
+  std::uint64_t currentTick;
+  std::size_t entryCount;
+
+  static unsigned int slotIndex(std::uint64_t tick, unsigned int level)
+  {
+    return static_cast<unsigned int>(tick >> (levelBits * level)) & (slotCount - 1);
+  }
+
+  static unsigned int lowestBit(std::uint64_t mask)
+  {
+#if defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    unsigned int index = 0;
+    while ((mask & 1) == 0)
+    {
+      mask >>= 1;
+      index++;
+    }
+    return index;
+#endif
+  }
+
+  // link the entry into the slot for it's tick. Returns false if it's due already.
+  bool place(TimerWheelEntry* entry)
+  {
+    if (entry->tick <= currentTick)
+    {
+      return false;
+    }
+    std::uint64_t delta = entry->tick - currentTick;
+    std::uint64_t slotTick = entry->tick;
+    unsigned int level = 0;
+    while (level + 1 < levelCount && delta >= (std::uint64_t(1) << (levelBits * (level + 1))))
+    {
+      level++;
+    }
+    if (delta >= (std::uint64_t(1) << (levelBits * levelCount)))
+    {
+      // beyond the range of the wheel, park it in the farthest slot. It is placed again when cascading.
+      slotTick = currentTick + (std::uint64_t(1) << (levelBits * levelCount)) - 1;
+    }
+    unsigned int slot = slotIndex(slotTick, level);
+    entry->level = level;
+    entry->slot = slot;
+    entry->prev = NULL;
+    entry->next = slots[level][slot];
+    if (entry->next != NULL)
+    {
+      entry->next->prev = entry;
+    }
+    slots[level][slot] = entry;
+    occupied[level] |= std::uint64_t(1) << slot;
+    return true;
+  }
+
+  // unlink and return all entries of a slot
+  TimerWheelEntry* takeSlot(unsigned int level, unsigned int slot)
+  {
+    TimerWheelEntry* head = slots[level][slot];
+    slots[level][slot] = NULL;
+    occupied[level] &= ~(std::uint64_t(1) << slot);
+    return head;
+  }
+
+  // redistribute the current slot of the level into the lower levels, cascading higher levels first
+  void cascade(unsigned int level, TimerWheelEntry*& dueHead, TimerWheelEntry*& dueTail)
+  {
+    if (level >= levelCount)
+    {
+      return;
+    }
+    unsigned int slot = slotIndex(currentTick, level);
+    if (slot == 0)
+    {
+      cascade(level + 1, dueHead, dueTail);
+    }
+    TimerWheelEntry* cur = takeSlot(level, slot);
+    while (cur != NULL)
+    {
+      TimerWheelEntry* next = cur->next;
+      if (!place(cur))
+      {
+        appendDue(cur, dueHead, dueTail);
+      }
+      cur = next;
+    }
+  }
+
+  void appendDue(TimerWheelEntry* entry, TimerWheelEntry*& dueHead, TimerWheelEntry*& dueTail)
+  {
+    entry->next = NULL;
+    entry->prev = dueTail;
+    if (dueTail == NULL)
+    {
+      dueHead = entry;
+    }
+    else
+    {
+      dueTail->next = entry;
+    }
+    dueTail = entry;
+    entryCount--;
+  }
+
+public:
+  /**
+   * @brief Create an empty wheel starting at tick 0.
+   */
+  TimerWheel() :
+      currentTick(0), entryCount(0)
+  {
+    for (unsigned int level = 0; level < levelCount; ++level)
+    {
+      for (unsigned int slot = 0; slot < slotCount; ++slot)
+      {
+        slots[level][slot] = NULL;
+      }
+      occupied[level] = 0;
+    }
+  }
+
+  /**
+   * @brief Get the tick the wheel was advanced to.
+   */
+  std::uint64_t getCurrentTick() const
+  {
+    return currentTick;
+  }
+
+  /**
+   * @brief Get the number of entries in the wheel.
+   */
+  std::size_t size() const
+  {
+    return entryCount;
+  }
+
+  /**
+   * @brief Insert an entry. Entries that are due already become due on the next tick.
+   */
+  void insert(TimerWheelEntry* entry)
+  {
+    if (entry->tick <= currentTick)
+    {
+      entry->tick = currentTick + 1;
+    }
+    place(entry);
+    entryCount++;
+  }
+
+  /**
+   * @brief Remove an entry that was inserted and is not due yet.
+   */
+  void remove(TimerWheelEntry* entry)
+  {
+    if (entry->prev != NULL)
+    {
+      entry->prev->next = entry->next;
+    }
+    else
+    {
+      slots[entry->level][entry->slot] = entry->next;
+      if (entry->next == NULL)
+      {
+        occupied[entry->level] &= ~(std::uint64_t(1) << entry->slot);
+      }
+    }
+    if (entry->next != NULL)
+    {
+      entry->next->prev = entry->prev;
+    }
+    entry->next = NULL;
+    entry->prev = NULL;
+    entryCount--;
+  }
+
+  /**
+   * @brief Advance to the given tick, and return the entries that became due, ordered by tick.
+   *
+   * The due entries are removed from the wheel and linked through their next pointer.
+   *
+   * @param tick tick to advance to. Earlier ticks are ignored.
+   * @return first due entry, or NULL
+   */
+  TimerWheelEntry* advance(std::uint64_t tick)
+  {
+    TimerWheelEntry* dueHead = NULL;
+    TimerWheelEntry* dueTail = NULL;
+    while (currentTick < tick && entryCount != 0)
+    {
+      // skip to the next occupied level 0 slot, or the end of the level 0 rotation
+      unsigned int slot = slotIndex(currentTick, 0);
+      std::uint64_t ahead = slot == slotCount - 1 ? 0 : occupied[0] & (~std::uint64_t(0) << (slot + 1));
+      std::uint64_t rotationStart = currentTick & ~std::uint64_t(slotCount - 1);
+      std::uint64_t target = ahead != 0 ? rotationStart + lowestBit(ahead) : rotationStart + slotCount;
+      if (target > tick)
+      {
+        break;
+      }
+      currentTick = target;
+      if (slotIndex(currentTick, 0) == 0)
+      {
+        cascade(1, dueHead, dueTail);
+      }
+      TimerWheelEntry* cur = takeSlot(0, slotIndex(currentTick, 0));
+      while (cur != NULL)
+      {
+        TimerWheelEntry* next = cur->next;
+        appendDue(cur, dueHead, dueTail);
+        cur = next;
+      }
+    }
+    if (currentTick < tick)
+    {
+      currentTick = tick;
+    }
+    return dueHead;
+  }
+
+  /**
+   * @brief Get the earliest tick at which advance() may return entries.
+   *
+   * This is exact for entries due within the current level 0 rotation. Otherwise, it is the end
+   * of the rotation, where the next entries are redistributed.
+   *
+   * @param tick set to the next tick
+   * @return false if the wheel is empty.
+   */
+  bool getNextTick(std::uint64_t& tick) const
+  {
+    if (entryCount == 0)
+    {
+      return false;
+    }
+    unsigned int slot = slotIndex(currentTick, 0);
+    std::uint64_t ahead = slot == slotCount - 1 ? 0 : occupied[0] & (~std::uint64_t(0) << (slot + 1));
+    std::uint64_t rotationStart = currentTick & ~std::uint64_t(slotCount - 1);
+    tick = ahead != 0 ? rotationStart + lowestBit(ahead) : rotationStart + slotCount;
+    return true;
+  }
+};
+
+}  // namespace detail
+
+}  // namespace ES
+
+#endif /* EVENTTIMERWHEEL_H */
@@ -0,0 +1,242 @@
+/*******************************************************************************
+
+  Copyright (c) 2017, Honda Research Institute Europe GmbH.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  3. Neither the name of the copyright holder nor the names of its
+     contributors may be used to endorse or promote products derived from
+     this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER "AS IS" AND ANY EXPRESS OR
+  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+  IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef EVENTWORKERPOOL_H
+#define EVENTWORKERPOOL_H
+
+#include "EventDelegate.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ES {
+
+/**
+ * @brief A pool of worker threads for processing queued events in parallel.
+ *
+ * The pool executes one job at a time. A job consists of a number of independent tasks, which are
+ * distributed dynamically: every participating thread repeatedly grabs the next unprocessed task,
+ * so threads that finish early take over the remaining work. The thread calling run() participates
+ * as well, and run() only returns after all tasks are done.
+ *
+ * See EventQueue::processParallel().
+ */
+class EventWorkerPool
+{
+public:
+  /// @brief Type of a job task, called with the task index.
+  typedef Delegate<void(std::size_t)> Task;
+
+private:
+  // worker threads
+  std::vector<std::thread> threads;
+
+  // guards the job state below
+  std::mutex jobMutex;
+  // notifies workers about a new job or shutdown
+  std::condition_variable jobCondition;
+  // notifies run() when all workers are done
+  std::condition_variable doneCondition;
+
+  // current job, only valid while run() is active
+  const Task* task;
+  std::size_t taskCount;
+  // index of the next task to execute
+  std::atomic<std::size_t> nextTask;
+  // incremented for every job, so workers can detect new jobs
+  unsigned long jobGeneration;
+  // number of workers that did not finish the current job yet
+  unsigned int busyWorkers;
+  // first exception thrown by a task
+  std::exception_ptr error;
+  // set on destruction
+  bool stopping;
+
+  // execute tasks of the current job until none are left
+  void work()
+  {
+    while (true)
+    {
+      std::size_t idx = nextTask.fetch_add(1, std::memory_order_relaxed);
+      if (idx >= taskCount)
+      {
+        return;
+      }
+      try
+      {
+        task->invoke(idx);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        if (!error)
+        {
+          error = std::current_exception();
+        }
+      }
+    }
+  }
+
+  // main loop of the worker threads
+  void workerLoop()
+  {
+    unsigned long seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(jobMutex);
+    while (true)
+    {
+      jobCondition.wait(lock, [&] { return stopping || jobGeneration != seenGeneration; });
+      if (stopping)
+      {
+        return;
+      }
+      seenGeneration = jobGeneration;
+
+      lock.unlock();
+      work();
+      lock.lock();
+
+      busyWorkers--;
+      if (busyWorkers == 0)
+      {
+        doneCondition.notify_one();
+      }
+    }
+  }
+
+public:
+  /**
+   * @brief Start the worker threads.
+   *
+   * @param threadCount number of background threads. Since the thread calling run() helps out,
+   *                    up to threadCount + 1 tasks are executed concurrently. Zero means that all
+   *                    tasks are executed by the calling thread.
+   */
+  explicit EventWorkerPool(unsigned int threadCount) :
+      task(NULL), taskCount(0), nextTask(0), jobGeneration(0), busyWorkers(0), stopping(false)
+  {
+    threads.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+      threads.emplace_back(&EventWorkerPool::workerLoop, this);
+    }
+  }
+
+  // not copyable
+  EventWorkerPool(const EventWorkerPool&) = delete;
+  EventWorkerPool& operator=(const EventWorkerPool&) = delete;
+
+  /**
+   * @brief Stop and join the worker threads.
+   */
+  ~EventWorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(jobMutex);
+      stopping = true;
+    }
+    jobCondition.notify_all();
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+  }
+
+  /**
+   * @brief Get the number of background threads.
+   */
+  unsigned int getThreadCount() const
+  {
+    return static_cast<unsigned int>(threads.size());
+  }
+
+  /**
+   * @brief Execute task(0) to task(count - 1) in parallel, and wait until all of them are done.
+   *
+   * Must not be called concurrently or from within a task.
+   *
+   * If a task throws, the remaining tasks are still executed. The first exception is rethrown
+   * once all tasks are done.
+   *
+   * @param count number of tasks
+   * @param job task function, called with the task index
+   */
+  void run(std::size_t count, const Task& job)
+  {
+    if (count == 0)
+    {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(jobMutex);
+    task = &job;
+    taskCount = count;
+    nextTask.store(0, std::memory_order_relaxed);
+    error = std::exception_ptr();
+    // only wake workers if there's something left for them
+    bool useWorkers = !threads.empty() && count > 1;
+    if (useWorkers)
+    {
+      busyWorkers = static_cast<unsigned int>(threads.size());
+      jobGeneration++;
+      jobCondition.notify_all();
+    }
+    lock.unlock();
+
+    // help out
+    work();
+
+    // wait for all workers, they must not access the job after we return
+    lock.lock();
+    if (useWorkers)
+    {
+      doneCondition.wait(lock, [this] { return busyWorkers == 0; });
+    }
+    task = NULL;
+    std::exception_ptr jobError = error;
+    error = std::exception_ptr();
+    lock.unlock();
+
+    if (jobError)
+    {
+      std::rethrow_exception(jobError);
+    }
+  }
+};
+
+}  // namespace ES
+
+#endif /* EVENTWORKERPOOL_H */